@@ -0,0 +1,295 @@
+#include "aggregate.h"
+#include "writer.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace parsejson {
+
+const char *const aggregate_names[] = {"count", "sum", "min", "max", "avg"};
+
+std::string Aggregate::label() const {
+  std::string text = aggregate_names[op];
+  if (!pointer.empty() || op != agg_count) {
+    text += '(';
+    text += pointer;
+    text += ')';
+  }
+  return text;
+}
+
+Aggregate parse_aggregate(std::string_view spec) {
+  for (int op = agg_count; op <= agg_avg; op++) {
+    std::string_view name = aggregate_names[op];
+    if (spec.substr(0, name.size()) != name) {
+      continue;
+    }
+    std::string_view rest = spec.substr(name.size());
+    if (rest.empty() && op == agg_count) {
+      return {agg_count, std::string()};
+    }
+    if (rest.size() >= 3 && rest.front() == '(' && rest.back() == ')' &&
+        rest[1] == '/') {
+      return {AggregateOp(op), std::string(rest.substr(1, rest.size() - 2))};
+    }
+  }
+  throw std::invalid_argument("bad aggregate: " + std::string(spec));
+}
+
+struct Accumulator {
+  size_t count = 0;
+  double sum = 0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+
+  void add(double number) {
+    count++;
+    sum += number;
+    min = std::min(min, number);
+    max = std::max(max, number);
+  }
+
+  void merge(const Accumulator &other) {
+    count += other.count;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+  }
+};
+
+// one thread's groups. each group's accumulators, one per aggregate, sit
+// together in accumulators at width times its index.
+struct GroupTable {
+  std::unordered_map<std::string, size_t> groups;
+  std::vector<Accumulator> accumulators;
+  size_t records = 0;
+
+  // a rough count of what the table has allocated
+  size_t bytes() const {
+    size_t total = groups.bucket_count() * sizeof(void *) +
+                   accumulators.capacity() * sizeof(Accumulator);
+    for (auto &group : groups) {
+      total += sizeof(void *) + sizeof(size_t) + sizeof(group);
+      if (group.first.capacity() > std::string().capacity()) {
+        total += group.first.capacity() + 1;
+      }
+    }
+    return total;
+  }
+};
+
+// appends field's JSON text, in a canonical form, to key
+void append_group_value(std::string &key, const Field &field) {
+  if (!field.found || field.type == j_null) {
+    key += "null";
+  } else if (field.type == j_number) {
+    double number;
+    auto parsed = std::from_chars(field.text.data(),
+                                  field.text.data() + field.text.size(),
+                                  number);
+    if (parsed.ec != std::errc() || !std::isfinite(number)) {
+      key.append(field.text.data(), field.text.size());
+      return;
+    }
+    char digits[32];
+    auto written = std::to_chars(digits, digits + sizeof(digits), number);
+    key.append(digits, written.ptr);
+  } else if (field.type == j_string &&
+             field.text.find('\\') != std::string_view::npos) {
+    std::string decoded;
+    append_unescaped(decoded, field.text);
+    JSONWriter writer(key);
+    writer.value(decoded);
+    writer.flush();
+  } else {
+    key.append(field.text.data(), field.text.size());
+  }
+}
+
+// the number in field, if it holds one
+bool field_number(const Field &field, double &number) {
+  if (!field.found || field.type != j_number) {
+    return false;
+  }
+  auto parsed = std::from_chars(field.text.data(),
+                                field.text.data() + field.text.size(), number);
+  return parsed.ec == std::errc();
+}
+
+AggregateResult aggregate_jsonl(std::string_view jsonl,
+                                const std::vector<std::string> &group_by,
+                                const std::vector<Aggregate> &aggregates,
+                                const AggregateOptions &options) {
+  auto start = std::chrono::steady_clock::now();
+  // grouping columns come first, then one for each aggregate with a pointer
+  std::vector<std::string> pointers = group_by;
+  std::vector<size_t> value_column(aggregates.size(), size_t(-1));
+  for (size_t i = 0; i < aggregates.size(); i++) {
+    if (!aggregates[i].pointer.empty()) {
+      value_column[i] = pointers.size();
+      pointers.push_back(aggregates[i].pointer);
+    }
+  }
+  Projection projection(pointers);
+  size_t width = aggregates.size();
+  // a limited scan goes through the records in order on this thread
+  unsigned threads =
+      options.scan.limited() ? 1u : std::max(options.threads, 1u);
+  std::vector<GroupTable> tables(threads);
+
+  // adds record to table, with fields and key as scratch space
+  auto add_record = [&](GroupTable &table, std::vector<Field> &fields,
+                        std::string &key, std::string_view record) {
+    projection.extract(record, fields, jsonl);
+    key.clear();
+    try {
+      for (size_t i = 0; i < group_by.size(); i++) {
+        if (i) {
+          key += '\n';
+        }
+        append_group_value(key, fields[i]);
+      }
+    } catch (ParseError &e) {
+      input_record_error(jsonl, record, e.what());
+    }
+    auto found = table.groups.find(key);
+    if (found == table.groups.end()) {
+      found = table.groups.emplace(key, table.groups.size()).first;
+      table.accumulators.resize(table.accumulators.size() + width);
+    }
+    Accumulator *group = &table.accumulators[found->second * width];
+    for (size_t i = 0; i < width; i++) {
+      double number;
+      if (value_column[i] == size_t(-1)) {
+        group[i].count++;
+      } else if (aggregates[i].op == agg_count) {
+        const Field &field = fields[value_column[i]];
+        group[i].count += field.found && field.type != j_null;
+      } else if (field_number(fields[value_column[i]], number)) {
+        group[i].add(number);
+      }
+    }
+    table.records++;
+  };
+
+  AggregateResult result;
+  result.group_by = group_by;
+  result.aggregates = aggregates;
+  AggregateStats &stats = result.stats;
+  stats.bytes = jsonl.size();
+  if (options.scan.limited()) {
+    std::vector<Field> fields;
+    std::string key;
+    ScanStats scan =
+        scan_jsonl(jsonl, options.scan, [&](std::string_view record) {
+          add_record(tables[0], fields, key, record);
+          return true;
+        });
+    stats.bytes = scan.bytes;
+    stats.stopped = scan.stopped;
+  } else {
+    for_each_chunk(jsonl, options.chunk_bytes, threads,
+                   [&](unsigned worker, std::string_view chunk) {
+                     std::vector<Field> fields;
+                     std::string key;
+                     for_each_line(chunk, [&](std::string_view record) {
+                       add_record(tables[worker], fields, key, record);
+                     });
+                   });
+  }
+  GroupTable &merged = tables[0];
+  for (GroupTable &table : tables) {
+    stats.records += table.records;
+    stats.table_bytes += table.bytes();
+  }
+  for (size_t t = 1; t < tables.size(); t++) {
+    for (auto &group : tables[t].groups) {
+      auto found = merged.groups.find(group.first);
+      if (found == merged.groups.end()) {
+        found = merged.groups.emplace(group.first, merged.groups.size()).first;
+        merged.accumulators.resize(merged.accumulators.size() + width);
+      }
+      for (size_t i = 0; i < width; i++) {
+        merged.accumulators[found->second * width + i].merge(
+            tables[t].accumulators[group.second * width + i]);
+      }
+    }
+    tables[t] = GroupTable();
+  }
+
+  result.rows.reserve(merged.groups.size());
+  for (auto &group : merged.groups) {
+    AggregateRow row;
+    size_t pos = 0;
+    for (size_t i = 0; i < group_by.size(); i++) {
+      size_t end = std::min(group.first.find('\n', pos), group.first.size());
+      row.key.push_back(group.first.substr(pos, end - pos));
+      pos = end + 1;
+    }
+    for (size_t i = 0; i < width; i++) {
+      const Accumulator &value = merged.accumulators[group.second * width + i];
+      double nothing = std::numeric_limits<double>::quiet_NaN();
+      switch (aggregates[i].op) {
+      case agg_count:
+        row.values.push_back(double(value.count));
+        break;
+      case agg_sum:
+        row.values.push_back(value.count ? value.sum : nothing);
+        break;
+      case agg_min:
+        row.values.push_back(value.count ? value.min : nothing);
+        break;
+      case agg_max:
+        row.values.push_back(value.count ? value.max : nothing);
+        break;
+      case agg_avg:
+        row.values.push_back(value.count ? value.sum / double(value.count)
+                                         : nothing);
+        break;
+      }
+    }
+    result.rows.push_back(std::move(row));
+  }
+  std::sort(result.rows.begin(), result.rows.end(),
+            [](const AggregateRow &a, const AggregateRow &b) {
+              return a.key < b.key;
+            });
+  stats.groups = result.rows.size();
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  return result;
+}
+
+std::string format_aggregate(const AggregateResult &result) {
+  std::string out;
+  for (const AggregateRow &row : result.rows) {
+    // the writer has to be gone before anything else is added to out
+    {
+      JSONWriter writer(out);
+      writer.begin_object();
+      for (size_t i = 0; i < row.key.size(); i++) {
+        writer.key(result.group_by[i]);
+        writer.raw(row.key[i]);
+      }
+      for (size_t i = 0; i < row.values.size(); i++) {
+        writer.key(result.aggregates[i].label());
+        if (!std::isfinite(row.values[i])) {
+          writer.null();
+        } else {
+          writer.value(row.values[i]);
+        }
+      }
+      writer.end_object();
+      writer.flush();
+    }
+    out += '\n';
+  }
+  return out;
+}
+
+} // namespace parsejson
@@ -0,0 +1,105 @@
+/*
+ * Group-by aggregation over JSONL, the equivalent of
+ *
+ *   select /country, count(*), sum(/amount) ... group by /country
+ *
+ * without parsing whole records:
+ *
+ *   MappedFile input("orders.jsonl");
+ *   AggregateResult result = aggregate_jsonl(
+ *       input.bytes(), {"/country"},
+ *       {parse_aggregate("count"), parse_aggregate("sum(/amount)")});
+ *   std::string rows = format_aggregate(result);
+ *
+ * Only the grouping and aggregated fields are pulled out of each record,
+ * with a Projection (jsonl.h). The input is split into chunks that are
+ * worked through on several threads, each adding to a hash table of its own,
+ * and the tables are merged once all the input has been seen.
+ *
+ * Given a ScanControl that samples or limits the scan (jsonl.h), records are
+ * instead aggregated one at a time on the calling thread, as export_csv()
+ * (csv.h) does. The groups then hold only the records sampled, every one of
+ * which counts towards max_matches.
+ *
+ * Groups are told apart by the JSON text of their values, after decoding
+ * string escapes and rewriting numbers in their shortest form, so "\u0041"
+ * and "A", or 1 and 1.0, are the same group. A missing field groups with
+ * null. Objects and arrays group by their text as it appears. sum, min, max
+ * and avg only look at numbers, and count(/pointer) counts the records where
+ * the field is present and not null.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "jsonl.h"
+
+namespace parsejson {
+
+enum AggregateOp { agg_count, agg_sum, agg_min, agg_max, agg_avg };
+
+struct Aggregate {
+  AggregateOp op;
+  // empty for a count of records
+  std::string pointer;
+
+  // as parse_aggregate() takes it, e.g. "sum(/amount)"
+  std::string label() const;
+};
+
+// "count", or one of count, sum, min, max or avg followed by a JSON Pointer
+// in brackets. throws std::invalid_argument if spec is none of these.
+Aggregate parse_aggregate(std::string_view spec);
+
+struct AggregateOptions {
+  unsigned threads = std::thread::hardware_concurrency();
+  size_t chunk_bytes = size_t(4) << 20;
+  ScanControl scan;
+};
+
+struct AggregateStats {
+  // records aggregated, and the input gone through to find them
+  size_t records = 0;
+  size_t bytes = 0;
+  size_t groups = 0;
+  // estimated size of the hash tables, all threads together, before merging
+  size_t table_bytes = 0;
+  double seconds = 0;
+  // whether scan's limits ended the aggregation early
+  bool stopped = false;
+};
+
+struct AggregateRow {
+  // the JSON text of each grouping value
+  std::vector<std::string> key;
+  // one per aggregate. NaN for a sum, min, max or avg that saw no numbers,
+  // which format_aggregate() writes as null, as it does infinities.
+  std::vector<double> values;
+};
+
+struct AggregateResult {
+  std::vector<std::string> group_by;
+  std::vector<Aggregate> aggregates;
+  // sorted by key
+  std::vector<AggregateRow> rows;
+  AggregateStats stats;
+};
+
+// throws ParseError for a bad record (with its byte offset in jsonl) or
+// pointer
+AggregateResult aggregate_jsonl(std::string_view jsonl,
+                                const std::vector<std::string> &group_by,
+                                const std::vector<Aggregate> &aggregates,
+                                const AggregateOptions &options =
+                                    AggregateOptions());
+
+// one JSON object per row and line, with a member for each grouping pointer
+// and each aggregate's label
+std::string format_aggregate(const AggregateResult &result);
+
+} // namespace parsejson
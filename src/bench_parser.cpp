@@ -0,0 +1,381 @@
+/*
+ * Rough throughput numbers for the parser. Each input file is read once and
+ * then parsed repeatedly in each configuration being compared, reporting the
+ * best run. The usual corpora are twitter.json, citm_catalog.json and
+ * canada.json; with no arguments, generated documents of roughly the same
+ * shape are used instead.
+ *
+ *   g++ -O2 -std=c++17 -pthread src/bench_parser.cpp -o bench_parser
+ *   ./bench_parser twitter.json citm_catalog.json canada.json
+ */
+
+#include "binary.cpp"
+#include "edit.cpp"
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "structural.cpp"
+#include "traverse.h"
+#include "writer.cpp"
+#include <fcntl.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace parsejson;
+
+struct Corpus {
+  std::string name;
+  std::string json;
+};
+
+// many small objects with short strings, like a page of tweets
+std::string make_records(size_t count) {
+  std::string out = "[";
+  for (size_t i = 0; i < count; i++) {
+    if (i) {
+      out += ",";
+    }
+    out += "{\"id\": " + std::to_string(1000000 + i) +
+           ", \"text\": \"record number " + std::to_string(i) +
+           " with some text\", \"user\": {\"name\": \"user" +
+           std::to_string(i % 97) +
+           "\", \"followers\": " + std::to_string(i * 7 % 5000) +
+           ", \"verified\": " + (i % 3 ? "false" : "true") +
+           "}, \"tags\": [\"a\", \"b\"], \"reply_to\": null}";
+  }
+  return out + "]";
+}
+
+// long arrays of number pairs, like geometry
+std::string make_coordinates(size_t count) {
+  std::string out = "{\"type\": \"Polygon\", \"coordinates\": [[";
+  char pair[64];
+  for (size_t i = 0; i < count; i++) {
+    std::snprintf(pair, sizeof(pair), "%s[%.6f, %.6f]", i ? "," : "",
+                  -65.613617 + i * 1e-4, 43.420273 - i * 1e-4);
+    out += pair;
+  }
+  return out + "]]}";
+}
+
+// an object with many keyed members each holding small objects and arrays
+std::string make_catalog(size_t count) {
+  std::string out = "{\"events\": {";
+  for (size_t i = 0; i < count; i++) {
+    if (i) {
+      out += ",";
+    }
+    out += "\"" + std::to_string(138586341 + i) +
+           "\": {\"description\": null, \"id\": " + std::to_string(i) +
+           ", \"name\": \"Event " + std::to_string(i) +
+           "\", \"subTopicIds\": [337184269, 337184283], \"topicIds\": "
+           "[324846099, 107888604]}";
+  }
+  return out + "}}";
+}
+
+std::vector<Corpus> load_corpora(int argc, char **argv) {
+  std::vector<Corpus> corpora;
+  for (int i = 1; i < argc; i++) {
+    std::ifstream file(argv[i]);
+    if (!file) {
+      std::fprintf(stderr, "can't read %s\n", argv[i]);
+      continue;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    corpora.push_back({argv[i], buffer.str()});
+  }
+  if (corpora.empty()) {
+    corpora.push_back({"records (generated)", make_records(20000)});
+    corpora.push_back({"coordinates (generated)", make_coordinates(100000)});
+    corpora.push_back({"catalog (generated)", make_catalog(10000)});
+  }
+  return corpora;
+}
+
+// best of `runs` timings of fn, reported as MB/s of input. setup, if given,
+// runs untimed before each run.
+void report(const char *label, const Corpus &corpus,
+            const std::function<void()> &fn,
+            const std::function<void()> &setup = NULL, int runs = 10) {
+  double best = 1e300;
+  for (int i = 0; i < runs; i++) {
+    if (setup) {
+      setup();
+    }
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  std::printf("  %-36s %9.3f ms %9.1f MB/s\n", label, best * 1e3,
+              corpus.json.size() / best / 1e6);
+}
+
+void parse_with(ParseBuffer &input, const Corpus &corpus,
+                std::pmr::memory_resource *resource) {
+  input.raw_json = corpus.json;
+  input.pos = 0;
+  input.depth = 0;
+  input.resource = resource;
+  destroy_json(parse_json(input));
+}
+
+// parse + destroy through each kind of memory_resource
+void bench_allocators(const Corpus &corpus) {
+  ParseBuffer input;
+  report("new_delete_resource", corpus, [&] {
+    parse_with(input, corpus, std::pmr::new_delete_resource());
+  });
+  std::pmr::synchronized_pool_resource sync_pool;
+  report("synchronized_pool_resource", corpus,
+         [&] { parse_with(input, corpus, &sync_pool); });
+  std::pmr::unsynchronized_pool_resource pool;
+  report("unsynchronized_pool_resource", corpus,
+         [&] { parse_with(input, corpus, &pool); });
+  // the arena is reused between parses, as it would be per request
+  std::pmr::monotonic_buffer_resource monotonic;
+  report("monotonic_buffer_resource (reused)", corpus, [&] {
+    parse_with(input, corpus, &monotonic);
+    monotonic.release();
+  });
+  // and an arena owned by the Document, dropped without walking the tree
+  report("monotonic arena owned by Document", corpus, [&] {
+    input.raw_json = corpus.json;
+    input.pos = 0;
+    input.depth = 0;
+    Document doc = parse_document(
+        input, std::make_unique<std::pmr::monotonic_buffer_resource>());
+  });
+}
+
+// the recursive teardown destroy_json used before it was made iterative
+void destroy_json_recursive(JSONItem *item) {
+  while (item) {
+    JSONItem *next = item->next;
+    if (item->child) {
+      destroy_json_recursive(item->child);
+    }
+    free_item(item);
+    item = next;
+  }
+}
+
+// teardown alone, the tree being parsed untimed before each run
+void bench_destroy(const Corpus &corpus) {
+  ParseBuffer input;
+  JSONItem *root = NULL;
+  auto setup = [&] {
+    input.raw_json = corpus.json;
+    input.pos = 0;
+    input.depth = 0;
+    root = parse_json(input);
+  };
+  report("destroy_json (recursive)", corpus,
+         [&] { destroy_json_recursive(root); }, setup);
+  report("destroy_json (iterative)", corpus, [&] { destroy_json(root); },
+         setup);
+}
+
+// writing a parsed tree back out, to a string and to a descriptor
+void bench_serialize(const Corpus &corpus) {
+  ParseBuffer input;
+  input.raw_json = corpus.json;
+  Document doc = parse_document(input);
+  std::string out;
+  report("write_json to std::string", corpus, [&] {
+    out.clear();
+    JSONWriter writer(out);
+    write_json(writer, doc.root());
+    writer.flush();
+  });
+  int fd = open("/dev/null", O_WRONLY);
+  report("write_json to /dev/null", corpus, [&] {
+    JSONWriter writer(fd);
+    write_json(writer, doc.root());
+    writer.flush();
+  });
+  report("to_json_parallel", corpus,
+         [&] { out = to_json_parallel(doc.root()); });
+  report("write_json_parallel to /dev/null", corpus,
+         [&] { write_json_parallel(fd, doc.root()); });
+  close(fd);
+}
+
+// MessagePack both ways, and straight from JSON text without a tree
+void bench_msgpack(const Corpus &corpus) {
+  ParseBuffer input;
+  input.raw_json = corpus.json;
+  Document doc = parse_document(input);
+  std::string packed;
+  report("to_msgpack", corpus, [&] { packed = to_msgpack(doc.root()); });
+  report("parse_msgpack + destroy_json", corpus,
+         [&] { destroy_json(parse_msgpack(packed)); });
+  report("json_to_msgpack (no tree)", corpus, [&] {
+    input.pos = 0;
+    input.depth = 0;
+    packed = json_to_msgpack(input);
+  });
+}
+
+// keeping a tree up to date as its text is typed into, rather than parsing
+// it all again after each keystroke
+void bench_edit(const Corpus &corpus) {
+  ParseBuffer input;
+  std::vector<SourceSpan> spans;
+  input.spans = &spans;
+  report("parse_json recording spans", corpus, [&] {
+    spans.clear();
+    parse_with(input, corpus, std::pmr::get_default_resource());
+  });
+  size_t digit =
+      corpus.json.find_first_of("0123456789", corpus.json.size() / 2);
+  if (digit == std::string::npos) {
+    return;
+  }
+  EditableDocument doc(corpus.json);
+  // a digit typed in the middle of the text and deleted again
+  report("EditableDocument::apply (x2)", corpus, [&] {
+    doc.apply({digit, 0, "7"});
+    doc.apply({digit, 1, ""});
+  });
+}
+
+// the structural index on one thread and on all of them
+void bench_structural(const Corpus &corpus) {
+  StructuralOptions options;
+  options.min_chunk_bytes = size_t(64) << 10;
+  std::vector<uint64_t> tokens;
+  report("index_structurals (all threads)", corpus,
+         [&] { tokens = index_structurals(corpus.json, options); });
+  options.threads = 1;
+  report("index_structurals (1 thread)", corpus,
+         [&] { tokens = index_structurals(corpus.json, options); });
+}
+
+// jumping over the whole document, which parse_json + destroy_json is the
+// alternative to
+void bench_skip(const Corpus &corpus) {
+  size_t start = corpus.json.find_first_not_of(" \t\r\n");
+  size_t end = 0;
+  report("skip_value", corpus,
+         [&] { end = skip_value(corpus.json, start); });
+  report("skip_value (validating)", corpus,
+         [&] { end = skip_value(corpus.json, start, true); });
+}
+
+// hands out items from slots of a pool in a random order, so that a tree
+// parsed into it is spread about as one built up by many edits would be
+class ScatteredResource : public std::pmr::memory_resource {
+  static constexpr size_t slot = (sizeof(JSONItem) + 63) & ~size_t(63);
+  std::vector<char> pool;
+  std::vector<size_t> order;
+  size_t used = 0;
+
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    if (bytes > slot || alignment > 16 || used == order.size()) {
+      return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    return pool.data() + order[used++] * slot;
+  }
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+    if (p < pool.data() || p >= pool.data() + pool.size()) {
+      std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+  }
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+public:
+  explicit ScatteredResource(size_t slots) : pool(slots * slot) {
+    for (size_t i = 0; i < slots; i++) {
+      order.push_back(i);
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(5));
+  }
+};
+
+// a light visitor, so the walk is mostly waiting on memory
+struct SumVisitor {
+  size_t items = 0;
+  double sum = 0;
+  bool enter(const JSONItem *item) {
+    items++;
+    if (item->type == j_number) {
+      sum += item->double_val;
+    }
+    return true;
+  }
+  void leave(const JSONItem *) {}
+};
+
+// visit_json with and without prefetching, over a tree too big for the
+// caches laid out in the order it was parsed and scattered about memory.
+// the corpora make trees small enough to stay cached, so this runs once on
+// a bigger generated document.
+void bench_traverse() {
+  Corpus corpus = {"records x400000 (generated)", make_records(400000)};
+  std::printf("%s (%zu bytes)\n", corpus.name.c_str(), corpus.json.size());
+  ParseBuffer input;
+  input.raw_json = corpus.json;
+  Document doc = parse_document(input);
+  SumVisitor counted;
+  visit_json(doc.root(), counted);
+  // as many slots as there are items, and some for long strings
+  ScatteredResource scattered(counted.items + counted.items / 4);
+  input.pos = 0;
+  input.resource = &scattered;
+  Document spread = parse_document(input);
+  for (const Document *tree : {&doc, &spread}) {
+    const JSONItem *root = tree->root();
+    bool in_order = tree == &doc;
+    report(in_order ? "visit_json (in order, no prefetch)"
+                    : "visit_json (scattered, no prefetch)",
+           corpus,
+           [&] {
+             SumVisitor visitor;
+             visit_json<false>(root, visitor);
+           },
+           NULL, 5);
+    report(in_order ? "visit_json (in order, prefetch)"
+                    : "visit_json (scattered, prefetch)",
+           corpus,
+           [&] {
+             SumVisitor visitor;
+             visit_json<true>(root, visitor);
+           },
+           NULL, 5);
+  }
+}
+
+int main(int argc, char **argv) {
+  std::vector<Corpus> corpora = load_corpora(argc, argv);
+  for (const Corpus &corpus : corpora) {
+    std::printf("%s (%zu bytes)\n", corpus.name.c_str(), corpus.json.size());
+    bench_allocators(corpus);
+    bench_destroy(corpus);
+    bench_serialize(corpus);
+    bench_msgpack(corpus);
+    bench_edit(corpus);
+    bench_structural(corpus);
+    bench_skip(corpus);
+  }
+  bench_traverse();
+}
@@ -0,0 +1,841 @@
+#include "binary.h"
+#include "pull.h"
+#include "traverse.h"
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace parsejson {
+
+// big endian, as both formats have it
+void put_be(std::string &out, uint64_t value, int bytes) {
+  char be[8];
+  for (int i = bytes - 1; i >= 0; i--) {
+    be[i] = char(value & 0xff);
+    value >>= 8;
+  }
+  out.append(be, size_t(bytes));
+}
+
+// how a double is best written: as an integer, a float or a double
+enum NumberForm { form_signed, form_unsigned, form_float, form_double };
+
+NumberForm number_form(double number) {
+  if (number == std::floor(number) && !(number == 0 && std::signbit(number))) {
+    if (number >= 0 && number < 18446744073709551616.0) {
+      return form_unsigned;
+    }
+    if (number < 0 && number >= -9223372036854775808.0) {
+      return form_signed;
+    }
+  }
+  if (!std::isfinite(number) ||
+      (std::fabs(number) <= FLT_MAX && double(float(number)) == number)) {
+    return form_float;
+  }
+  return form_double;
+}
+
+uint32_t float_bits(double number) {
+  float single = float(number);
+  uint32_t bits;
+  memcpy(&bits, &single, sizeof(bits));
+  return bits;
+}
+
+uint64_t double_bits(double number) {
+  uint64_t bits;
+  memcpy(&bits, &number, sizeof(bits));
+  return bits;
+}
+
+// MessagePack
+
+// a value in an array counts towards its size. in an object it's the key
+// that counts.
+void MsgpackWriter::counted() {
+  if (!open.empty() && !open.back().object) {
+    open.back().count++;
+  }
+}
+
+void MsgpackWriter::begin(uint8_t fix, uint8_t wide16, uint8_t wide32,
+                          size_t count) {
+  counted();
+  bool object = fix == 0x80;
+  if (count == unknown_size) {
+    open.push_back({out.size(), 0, object, false});
+    out.push_back(char(wide32));
+    put_be(out, 0, 4);
+    return;
+  }
+  open.push_back({0, 0, object, true});
+  if (count < 16) {
+    out.push_back(char(fix | count));
+  } else if (count <= 0xffff) {
+    out.push_back(char(wide16));
+    put_be(out, count, 2);
+  } else {
+    out.push_back(char(wide32));
+    put_be(out, count, 4);
+  }
+}
+
+void MsgpackWriter::end() {
+  Open container = open.back();
+  open.pop_back();
+  if (!container.sized) {
+    for (int i = 0; i < 4; i++) {
+      out[container.header + 1 + i] = char(container.count >> (24 - 8 * i));
+    }
+  }
+}
+
+void MsgpackWriter::begin_object(size_t members) {
+  begin(0x80, 0xde, 0xdf, members);
+}
+
+void MsgpackWriter::begin_array(size_t elements) {
+  begin(0x90, 0xdc, 0xdd, elements);
+}
+
+void MsgpackWriter::key(std::string_view name) {
+  open.back().count++;
+  put_string(name);
+}
+
+void MsgpackWriter::value(std::string_view text) {
+  counted();
+  put_string(text);
+}
+
+void MsgpackWriter::put_string(std::string_view text) {
+  if (text.size() < 32) {
+    out.push_back(char(0xa0 | text.size()));
+  } else if (text.size() <= 0xff) {
+    out.push_back(char(0xd9));
+    put_be(out, text.size(), 1);
+  } else if (text.size() <= 0xffff) {
+    out.push_back(char(0xda));
+    put_be(out, text.size(), 2);
+  } else {
+    out.push_back(char(0xdb));
+    put_be(out, text.size(), 4);
+  }
+  out.append(text.data(), text.size());
+}
+
+void MsgpackWriter::write_unsigned(uint64_t number) {
+  counted();
+  if (number < 0x80) {
+    out.push_back(char(number));
+  } else if (number <= 0xff) {
+    out.push_back(char(0xcc));
+    put_be(out, number, 1);
+  } else if (number <= 0xffff) {
+    out.push_back(char(0xcd));
+    put_be(out, number, 2);
+  } else if (number <= 0xffffffff) {
+    out.push_back(char(0xce));
+    put_be(out, number, 4);
+  } else {
+    out.push_back(char(0xcf));
+    put_be(out, number, 8);
+  }
+}
+
+void MsgpackWriter::write_signed(int64_t number) {
+  if (number >= 0) {
+    write_unsigned(uint64_t(number));
+    return;
+  }
+  counted();
+  if (number >= -32) {
+    out.push_back(char(number));
+  } else if (number >= INT8_MIN) {
+    out.push_back(char(0xd0));
+    put_be(out, uint64_t(number), 1);
+  } else if (number >= INT16_MIN) {
+    out.push_back(char(0xd1));
+    put_be(out, uint64_t(number), 2);
+  } else if (number >= INT32_MIN) {
+    out.push_back(char(0xd2));
+    put_be(out, uint64_t(number), 4);
+  } else {
+    out.push_back(char(0xd3));
+    put_be(out, uint64_t(number), 8);
+  }
+}
+
+void MsgpackWriter::value(double number) {
+  switch (number_form(number)) {
+  case form_unsigned:
+    write_unsigned(uint64_t(number));
+    break;
+  case form_signed:
+    write_signed(int64_t(number));
+    break;
+  case form_float:
+    counted();
+    out.push_back(char(0xca));
+    put_be(out, float_bits(number), 4);
+    break;
+  case form_double:
+    counted();
+    out.push_back(char(0xcb));
+    put_be(out, double_bits(number), 8);
+    break;
+  }
+}
+
+void MsgpackWriter::value(bool flag) {
+  counted();
+  out.push_back(char(flag ? 0xc3 : 0xc2));
+}
+
+void MsgpackWriter::null() {
+  counted();
+  out.push_back(char(0xc0));
+}
+
+// CBOR
+
+void CborWriter::header(uint8_t major, uint64_t argument) {
+  uint8_t initial = uint8_t(major << 5);
+  if (argument < 24) {
+    out.push_back(char(initial | argument));
+  } else if (argument <= 0xff) {
+    out.push_back(char(initial | 24));
+    put_be(out, argument, 1);
+  } else if (argument <= 0xffff) {
+    out.push_back(char(initial | 25));
+    put_be(out, argument, 2);
+  } else if (argument <= 0xffffffff) {
+    out.push_back(char(initial | 26));
+    put_be(out, argument, 4);
+  } else {
+    out.push_back(char(initial | 27));
+    put_be(out, argument, 8);
+  }
+}
+
+void CborWriter::end() {
+  if (indefinite.back()) {
+    out.push_back(char(0xff));
+  }
+  indefinite.pop_back();
+}
+
+void CborWriter::begin_object(size_t members) {
+  indefinite.push_back(members == unknown_size);
+  if (members == unknown_size) {
+    out.push_back(char(0xbf));
+  } else {
+    header(5, members);
+  }
+}
+
+void CborWriter::begin_array(size_t elements) {
+  indefinite.push_back(elements == unknown_size);
+  if (elements == unknown_size) {
+    out.push_back(char(0x9f));
+  } else {
+    header(4, elements);
+  }
+}
+
+void CborWriter::key(std::string_view name) { value(name); }
+
+void CborWriter::value(std::string_view text) {
+  header(3, text.size());
+  out.append(text.data(), text.size());
+}
+
+void CborWriter::write_unsigned(uint64_t number) { header(0, number); }
+
+void CborWriter::write_signed(int64_t number) {
+  if (number >= 0) {
+    header(0, uint64_t(number));
+  } else {
+    header(1, uint64_t(-(number + 1)));
+  }
+}
+
+void CborWriter::value(double number) {
+  switch (number_form(number)) {
+  case form_unsigned:
+    write_unsigned(uint64_t(number));
+    break;
+  case form_signed:
+    write_signed(int64_t(number));
+    break;
+  case form_float:
+    out.push_back(char(0xfa));
+    put_be(out, float_bits(number), 4);
+    break;
+  case form_double:
+    out.push_back(char(0xfb));
+    put_be(out, double_bits(number), 8);
+    break;
+  }
+}
+
+void CborWriter::value(bool flag) { out.push_back(char(flag ? 0xf5 : 0xf4)); }
+
+void CborWriter::null() { out.push_back(char(0xf6)); }
+
+// trees and JSON text into either writer
+
+template <typename Writer> struct EncodeVisitor {
+  Writer &writer;
+  std::vector<bool> in_object;
+
+  bool enter(const JSONItem *item) {
+    if (!in_object.empty() && in_object.back()) {
+      writer.key(item->name.view());
+    }
+    size_t count = 0;
+    switch (item->type) {
+    case j_object:
+    case j_array:
+      for (const JSONItem *child = item->child; child; child = child->next) {
+        count++;
+      }
+      if (item->type == j_object) {
+        writer.begin_object(count);
+      } else {
+        writer.begin_array(count);
+      }
+      in_object.push_back(item->type == j_object);
+      break;
+    case j_string:
+      writer.value(std::string_view(item->string_val));
+      break;
+    case j_number:
+      writer.value(double(item->double_val));
+      break;
+    case j_bool:
+      writer.value(item->bool_val);
+      break;
+    case j_null:
+      writer.null();
+      break;
+    }
+    return true;
+  }
+
+  void leave(const JSONItem *item) {
+    in_object.pop_back();
+    if (item->type == j_object) {
+      writer.end_object();
+    } else {
+      writer.end_array();
+    }
+  }
+};
+
+std::string to_msgpack(const JSONItem *item) {
+  std::string out;
+  MsgpackWriter writer(out);
+  visit_json(item, EncodeVisitor<MsgpackWriter>{writer, {}});
+  return out;
+}
+
+std::string to_cbor(const JSONItem *item) {
+  std::string out;
+  CborWriter writer(out);
+  visit_json(item, EncodeVisitor<CborWriter>{writer, {}});
+  return out;
+}
+
+template <typename Writer> void transcode(ParseBuffer &input, Writer &writer) {
+  EventReader reader(input);
+  JSONEvent event;
+  while (reader.next(event)) {
+    switch (event.type) {
+    case ev_begin_object:
+      writer.begin_object();
+      break;
+    case ev_end_object:
+      writer.end_object();
+      break;
+    case ev_begin_array:
+      writer.begin_array();
+      break;
+    case ev_end_array:
+      writer.end_array();
+      break;
+    case ev_key:
+      writer.key(event.text);
+      break;
+    case ev_string:
+      writer.value(std::string_view(event.text));
+      break;
+    case ev_number:
+      writer.value(event.double_val);
+      break;
+    case ev_bool:
+      writer.value(event.bool_val);
+      break;
+    case ev_null:
+      writer.null();
+      break;
+    }
+  }
+}
+
+std::string json_to_msgpack(ParseBuffer &input) {
+  std::string out;
+  MsgpackWriter writer(out);
+  transcode(input, writer);
+  return out;
+}
+
+std::string json_to_cbor(ParseBuffer &input) {
+  std::string out;
+  CborWriter writer(out);
+  transcode(input, writer);
+  return out;
+}
+
+// reading. both readers drive a handler with the JSONWriter calls, which is
+// either a JSONWriter or a TreeBuilder.
+
+class TreeBuilder {
+  struct Open {
+    JSONItem *container;
+    JSONItem *last;
+  };
+
+  std::pmr::memory_resource *resource;
+  JSONItem *root = NULL;
+  std::vector<Open> open;
+  std::string name;
+
+  JSONItem *add(JSONType type) {
+    JSONItem *item = create_item(type, resource);
+    if (open.empty()) {
+      root = item;
+      return item;
+    }
+    Open &parent = open.back();
+    if (parent.last) {
+      parent.last->next = item;
+#if !PARSER_LEAN_NODES
+      item->prev = parent.last;
+#endif
+    } else {
+      parent.container->child = item;
+    }
+    parent.last = item;
+    if (parent.container->type == j_object) {
+      item->set_name(name);
+    }
+    return item;
+  }
+
+public:
+  explicit TreeBuilder(std::pmr::memory_resource *item_resource)
+      : resource(item_resource) {}
+  ~TreeBuilder() {
+    if (root) {
+      destroy_json(root);
+    }
+  }
+
+  JSONItem *release() { return std::exchange(root, nullptr); }
+
+  void begin_object() { open.push_back({add(j_object), NULL}); }
+  void end_object() { open.pop_back(); }
+  void begin_array() { open.push_back({add(j_array), NULL}); }
+  void end_array() { open.pop_back(); }
+  void key(std::string_view text) { name.assign(text.data(), text.size()); }
+  void value(std::string_view text) {
+    add(j_string)->string_val.assign(text.data(), text.size());
+  }
+  void value(double number) { add(j_number)->double_val = number; }
+  void value(int64_t number) { value(double(number)); }
+  void value(uint64_t number) { value(double(number)); }
+  void value(bool flag) { add(j_bool)->bool_val = flag; }
+  void null() { add(j_null); }
+};
+
+class BinaryReader {
+protected:
+  std::string_view data;
+  size_t pos = 0;
+
+  [[noreturn]] void fail(const char *what) const {
+    char msg[100];
+    std::snprintf(msg, 100, "%s at pos: %zu", what, pos);
+    throw ParseError((const char *)msg);
+  }
+
+  const char *take(size_t bytes) {
+    if (data.size() - pos < bytes) {
+      fail("truncated input");
+    }
+    const char *start = data.data() + pos;
+    pos += bytes;
+    return start;
+  }
+
+  uint64_t read_be(size_t bytes) {
+    const unsigned char *be =
+        reinterpret_cast<const unsigned char *>(take(bytes));
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+      value = value << 8 | be[i];
+    }
+    return value;
+  }
+
+  // JSON has no NaN or infinity, so a tree holding one couldn't be written
+  // out again. start is where the number's bytes began.
+  double finite(double number, size_t start) {
+    if (!std::isfinite(number)) {
+      pos = start;
+      fail("non-finite number");
+    }
+    return number;
+  }
+
+  double read_float() {
+    size_t start = pos;
+    uint32_t bits = uint32_t(read_be(4));
+    float single;
+    memcpy(&single, &bits, sizeof(single));
+    return finite(single, start);
+  }
+
+  double read_double() {
+    size_t start = pos;
+    uint64_t bits = read_be(8);
+    double number;
+    memcpy(&number, &bits, sizeof(number));
+    return finite(number, start);
+  }
+
+  void check_depth(int depth) const {
+    if (depth > PARSER_NESTING_LIMIT) {
+      char msg[100];
+      std::snprintf(msg, 100, "max nesting limit of %d exceeded at pos: %zu",
+                    PARSER_NESTING_LIMIT, pos);
+      throw ParseError((const char *)msg);
+    }
+  }
+
+public:
+  explicit BinaryReader(std::string_view bytes) : data(bytes) {}
+
+  void finish() const {
+    if (pos != data.size()) {
+      fail("unexpected trailing bytes");
+    }
+  }
+};
+
+template <typename Handler> class MsgpackReader : public BinaryReader {
+  Handler &handler;
+
+  // length of the string at pos, if it is one, consuming its header
+  bool string_header(uint8_t type, size_t &length) {
+    if ((type & 0xe0) == 0xa0) {
+      length = type & 0x1f;
+    } else if (type == 0xd9 || type == 0xc4) {
+      length = read_be(1);
+    } else if (type == 0xda || type == 0xc5) {
+      length = read_be(2);
+    } else if (type == 0xdb || type == 0xc6) {
+      length = read_be(4);
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  void container(bool object, size_t count, int depth) {
+    check_depth(depth + 1);
+    if (object) {
+      handler.begin_object();
+    } else {
+      handler.begin_array();
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (object) {
+        size_t length;
+        if (!string_header(uint8_t(*take(1)), length)) {
+          fail("map key isn't a string");
+        }
+        handler.key(std::string_view(take(length), length));
+      }
+      read_value(depth + 1);
+    }
+    if (object) {
+      handler.end_object();
+    } else {
+      handler.end_array();
+    }
+  }
+
+public:
+  MsgpackReader(std::string_view bytes, Handler &sink)
+      : BinaryReader(bytes), handler(sink) {}
+
+  void read_value(int depth = 0) {
+    uint8_t type = uint8_t(*take(1));
+    size_t length;
+    if (type < 0x80) {
+      handler.value(uint64_t(type));
+    } else if (type >= 0xe0) {
+      handler.value(int64_t(int8_t(type)));
+    } else if (type < 0x90) {
+      container(true, type & 0x0f, depth);
+    } else if (type < 0xa0) {
+      container(false, type & 0x0f, depth);
+    } else if (string_header(type, length)) {
+      handler.value(std::string_view(take(length), length));
+    } else {
+      switch (type) {
+      case 0xc0:
+        handler.null();
+        break;
+      case 0xc2:
+      case 0xc3:
+        handler.value(type == 0xc3);
+        break;
+      case 0xca:
+        handler.value(read_float());
+        break;
+      case 0xcb:
+        handler.value(read_double());
+        break;
+      case 0xcc:
+        handler.value(read_be(1));
+        break;
+      case 0xcd:
+        handler.value(read_be(2));
+        break;
+      case 0xce:
+        handler.value(read_be(4));
+        break;
+      case 0xcf:
+        handler.value(read_be(8));
+        break;
+      case 0xd0:
+        handler.value(int64_t(int8_t(read_be(1))));
+        break;
+      case 0xd1:
+        handler.value(int64_t(int16_t(read_be(2))));
+        break;
+      case 0xd2:
+        handler.value(int64_t(int32_t(read_be(4))));
+        break;
+      case 0xd3:
+        handler.value(int64_t(read_be(8)));
+        break;
+      case 0xdc:
+        container(false, read_be(2), depth);
+        break;
+      case 0xdd:
+        container(false, read_be(4), depth);
+        break;
+      case 0xde:
+        container(true, read_be(2), depth);
+        break;
+      case 0xdf:
+        container(true, read_be(4), depth);
+        break;
+      default:
+        fail("unsupported msgpack type");
+      }
+    }
+  }
+};
+
+template <typename Handler> class CborReader : public BinaryReader {
+  Handler &handler;
+  std::string chunks;
+
+  static constexpr uint8_t indefinite = 31;
+
+  // the argument following an initial byte with this info. an indefinite
+  // length has none.
+  uint64_t argument(uint8_t info) {
+    if (info < 24) {
+      return info;
+    }
+    if (info <= 27) {
+      return read_be(size_t(1) << (info - 24));
+    }
+    if (info == indefinite) {
+      return 0;
+    }
+    fail("bad cbor argument");
+  }
+
+  bool at_break() {
+    if (pos < data.size() && uint8_t(data[pos]) == 0xff) {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+
+  // a text or byte string, whose initial byte has been read
+  std::string_view read_string(uint8_t major, uint8_t info) {
+    uint64_t length = argument(info);
+    if (info != indefinite) {
+      if (length > data.size() - pos) {
+        fail("truncated input");
+      }
+      return std::string_view(take(size_t(length)), size_t(length));
+    }
+    // chunks of the same major type, each definite, until a break
+    chunks.clear();
+    while (!at_break()) {
+      uint8_t initial = uint8_t(*take(1));
+      if (initial >> 5 != major || (initial & 0x1f) == indefinite) {
+        fail("bad chunk in indefinite length string");
+      }
+      uint64_t chunk = argument(initial & 0x1f);
+      if (chunk > data.size() - pos) {
+        fail("truncated input");
+      }
+      chunks.append(take(size_t(chunk)), size_t(chunk));
+    }
+    return chunks;
+  }
+
+  double read_half() {
+    size_t start = pos;
+    uint16_t half = uint16_t(read_be(2));
+    int exponent = (half >> 10) & 0x1f;
+    double mantissa = half & 0x3ff;
+    double number;
+    if (exponent == 0) {
+      number = std::ldexp(mantissa, -24);
+    } else if (exponent == 31) {
+      number = mantissa == 0 ? INFINITY : NAN;
+    } else {
+      number = std::ldexp(mantissa + 1024, exponent - 25);
+    }
+    return finite(half & 0x8000 ? -number : number, start);
+  }
+
+public:
+  CborReader(std::string_view bytes, Handler &sink)
+      : BinaryReader(bytes), handler(sink) {}
+
+  void read_value(int depth = 0) {
+    uint8_t initial = uint8_t(*take(1));
+    uint8_t major = initial >> 5;
+    uint8_t info = initial & 0x1f;
+    if (major == 7) {
+      switch (info) {
+      case 20:
+      case 21:
+        handler.value(info == 21);
+        return;
+      case 22:
+      case 23:
+        handler.null();
+        return;
+      case 25:
+        handler.value(read_half());
+        return;
+      case 26:
+        handler.value(read_float());
+        return;
+      case 27:
+        handler.value(read_double());
+        return;
+      default:
+        fail("unsupported cbor simple value");
+      }
+    }
+    if (info == indefinite && (major < 2 || major == 6)) {
+      fail("bad cbor argument");
+    }
+    if (major == 2 || major == 3) {
+      handler.value(read_string(major, info));
+      return;
+    }
+    uint64_t length = argument(info);
+    switch (major) {
+    case 0:
+    case 1:
+      if (major == 0) {
+        handler.value(length);
+      } else if (length <= uint64_t(INT64_MAX)) {
+        handler.value(-1 - int64_t(length));
+      } else {
+        handler.value(-1.0 - double(length));
+      }
+      return;
+    case 4:
+    case 5:
+      check_depth(depth + 1);
+      if (major == 5) {
+        handler.begin_object();
+      } else {
+        handler.begin_array();
+      }
+      for (uint64_t i = 0; info == indefinite ? !at_break() : i < length;
+           i++) {
+        if (major == 5) {
+          uint8_t key = uint8_t(*take(1));
+          if (key >> 5 != 2 && key >> 5 != 3) {
+            fail("map key isn't a string");
+          }
+          handler.key(read_string(key >> 5, key & 0x1f));
+        }
+        read_value(depth + 1);
+      }
+      if (major == 5) {
+        handler.end_object();
+      } else {
+        handler.end_array();
+      }
+      return;
+    case 6:
+      check_depth(depth + 1);
+      read_value(depth + 1);
+      return;
+    }
+  }
+};
+
+JSONItem *parse_msgpack(std::string_view data,
+                        std::pmr::memory_resource *resource) {
+  TreeBuilder builder(resource);
+  MsgpackReader<TreeBuilder> reader(data, builder);
+  reader.read_value();
+  reader.finish();
+  return builder.release();
+}
+
+JSONItem *parse_cbor(std::string_view data,
+                     std::pmr::memory_resource *resource) {
+  TreeBuilder builder(resource);
+  CborReader<TreeBuilder> reader(data, builder);
+  reader.read_value();
+  reader.finish();
+  return builder.release();
+}
+
+void msgpack_to_json(std::string_view data, JSONWriter &out) {
+  MsgpackReader<JSONWriter> reader(data, out);
+  reader.read_value();
+  reader.finish();
+}
+
+void cbor_to_json(std::string_view data, JSONWriter &out) {
+  CborReader<JSONWriter> reader(data, out);
+  reader.read_value();
+  reader.finish();
+}
+
+} // namespace parsejson
@@ -0,0 +1,147 @@
+/*
+ * MessagePack and CBOR. Trees convert to and from either format:
+ *
+ *   std::string packed = to_msgpack(root);
+ *   JSONItem *copy = parse_msgpack(packed);
+ *
+ * and JSON text converts straight to either, and back, without building a
+ * tree at all:
+ *
+ *   std::string packed = json_to_cbor(input);
+ *   JSONWriter out(fd);
+ *   cbor_to_json(packed, out);
+ *
+ * MsgpackWriter and CborWriter take the same calls as JSONWriter, for
+ * producing binary output directly. A container's size may be given to
+ * begin_object()/begin_array() when known, for the most compact header. When
+ * it isn't, CBOR uses an indefinite length container and MessagePack a 32 bit
+ * count that is filled in when the container is closed.
+ *
+ * Numbers with an integral value are written as integers and others as 32 bit
+ * floats when that is exact, 64 bit otherwise. Reading, integers beyond 2^53
+ * lose precision in a tree (which holds doubles) but not on the way to JSON.
+ * Binary strings are read as strings. Map keys must be strings, and
+ * MessagePack extension types and CBOR simple values other than true, false,
+ * null and undefined (read as null) are rejected with a ParseError. CBOR tags
+ * are skipped, leaving the tagged value.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "parsejson.h"
+#include "writer.h"
+
+namespace parsejson {
+
+class MsgpackWriter {
+  struct Open {
+    size_t header; // offset of the header if its count is still to fill in
+    uint32_t count; // members or elements so far
+    bool object;
+    bool sized;
+  };
+
+  std::string &out;
+  std::vector<Open> open;
+
+  void counted();
+  void put_string(std::string_view text);
+  void begin(uint8_t fix, uint8_t wide16, uint8_t wide32, size_t count);
+  void end();
+  void write_signed(int64_t number);
+  void write_unsigned(uint64_t number);
+
+public:
+  static constexpr size_t unknown_size = size_t(-1);
+
+  // appends to output
+  explicit MsgpackWriter(std::string &output) : out(output) {}
+
+  void begin_object(size_t members = unknown_size);
+  void end_object() { end(); }
+  void begin_array(size_t elements = unknown_size);
+  void end_array() { end(); }
+  void key(std::string_view name);
+  void value(std::string_view text);
+  void value(const char *text) { value(std::string_view(text)); }
+  void value(double number);
+  void value(bool flag);
+  template <typename Integer,
+            typename = std::enable_if_t<std::is_integral_v<Integer>>>
+  void value(Integer number) {
+    if constexpr (std::is_signed_v<Integer>) {
+      write_signed(number);
+    } else {
+      write_unsigned(number);
+    }
+  }
+  void null();
+};
+
+class CborWriter {
+  std::string &out;
+  std::vector<bool> indefinite;
+
+  void header(uint8_t major, uint64_t argument);
+  void end();
+  void write_signed(int64_t number);
+  void write_unsigned(uint64_t number);
+
+public:
+  static constexpr size_t unknown_size = size_t(-1);
+
+  // appends to output
+  explicit CborWriter(std::string &output) : out(output) {}
+
+  void begin_object(size_t members = unknown_size);
+  void end_object() { end(); }
+  void begin_array(size_t elements = unknown_size);
+  void end_array() { end(); }
+  void key(std::string_view name);
+  void value(std::string_view text);
+  void value(const char *text) { value(std::string_view(text)); }
+  void value(double number);
+  void value(bool flag);
+  template <typename Integer,
+            typename = std::enable_if_t<std::is_integral_v<Integer>>>
+  void value(Integer number) {
+    if constexpr (std::is_signed_v<Integer>) {
+      write_signed(number);
+    } else {
+      write_unsigned(number);
+    }
+  }
+  void null();
+};
+
+std::string to_msgpack(const JSONItem *item);
+std::string to_cbor(const JSONItem *item);
+
+// trees to be released with destroy_json. throw ParseError on malformed or
+// unsupported input, or anything after the first value. a NaN or infinity
+// is unsupported, as JSON can't hold one.
+JSONItem *parse_msgpack(std::string_view data,
+                        std::pmr::memory_resource *resource =
+                            std::pmr::get_default_resource());
+JSONItem *parse_cbor(std::string_view data,
+                     std::pmr::memory_resource *resource =
+                         std::pmr::get_default_resource());
+
+// JSON text to binary, one event at a time (see pull.h)
+std::string json_to_msgpack(ParseBuffer &input);
+std::string json_to_cbor(ParseBuffer &input);
+
+// binary to JSON text, written to out as it is read. they throw ParseError
+// as the parsers above do, NaN and infinity included.
+void msgpack_to_json(std::string_view data, JSONWriter &out);
+void cbor_to_json(std::string_view data, JSONWriter &out);
+
+} // namespace parsejson
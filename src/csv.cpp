@@ -0,0 +1,109 @@
+#include "csv.h"
+#include "writer.h"
+#include <atomic>
+
+namespace parsejson {
+
+void append_cell(std::string &out, std::string_view text, char delimiter) {
+  const char special[] = {delimiter, '"', '\n', '\r'};
+  if (text.find_first_of(std::string_view(special, sizeof(special))) ==
+      std::string_view::npos) {
+    out.append(text.data(), text.size());
+    return;
+  }
+  out += '"';
+  size_t pos = 0;
+  size_t quote;
+  while ((quote = text.find('"', pos)) != std::string_view::npos) {
+    out.append(text.data() + pos, quote + 1 - pos);
+    out += '"';
+    pos = quote + 1;
+  }
+  out.append(text.data() + pos, text.size() - pos);
+  out += '"';
+}
+
+void append_csv_row(std::string &out, const std::vector<Field> &fields,
+                    char delimiter) {
+  std::string decoded;
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (i) {
+      out += delimiter;
+    }
+    const Field &field = fields[i];
+    if (!field.found || field.type == j_null) {
+      continue;
+    }
+    if (field.type != j_string) {
+      append_cell(out, field.text, delimiter);
+    } else if (field.text.find('\\') == std::string_view::npos) {
+      append_cell(out, field.text.substr(1, field.text.size() - 2),
+                  delimiter);
+    } else {
+      decoded.clear();
+      append_unescaped(decoded, field.text);
+      append_cell(out, decoded, delimiter);
+    }
+  }
+  out += '\n';
+}
+
+ExportStats export_csv(std::string_view jsonl,
+                       const std::vector<std::string> &columns, int fd,
+                       const CsvOptions &options) {
+  Projection projection(columns);
+  ExportStats stats;
+  if (options.header) {
+    std::string header;
+    for (size_t i = 0; i < columns.size(); i++) {
+      if (i) {
+        header += options.delimiter;
+      }
+      append_cell(header, columns[i], options.delimiter);
+    }
+    header += '\n';
+    write_all(fd, header);
+    stats.bytes_out += header.size();
+  }
+  if (options.scan.limited()) {
+    std::vector<Field> fields;
+    std::string out;
+    ScanStats scan =
+        scan_jsonl(jsonl, options.scan, [&](std::string_view record) {
+          projection.extract(record, fields, jsonl);
+          append_csv_row(out, fields, options.delimiter);
+          if (out.size() >= options.chunk_bytes) {
+            write_all(fd, out);
+            stats.bytes_out += out.size();
+            out.clear();
+          }
+          return true;
+        });
+    write_all(fd, out);
+    stats.bytes_out += out.size();
+    stats.records = scan.matches;
+    stats.stopped = scan.stopped;
+    return stats;
+  }
+  std::atomic<size_t> records = 0;
+  process_chunks(
+      jsonl, options.chunk_bytes, options.threads,
+      [&](std::string_view chunk, std::string &out) {
+        std::vector<Field> fields;
+        size_t count = 0;
+        for_each_line(chunk, [&](std::string_view record) {
+          projection.extract(record, fields, jsonl);
+          append_csv_row(out, fields, options.delimiter);
+          count++;
+        });
+        records += count;
+      },
+      [&](std::string &out) {
+        write_all(fd, out);
+        stats.bytes_out += out.size();
+      });
+  stats.records = records;
+  return stats;
+}
+
+} // namespace parsejson
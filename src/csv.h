@@ -0,0 +1,59 @@
+/*
+ * Exporting JSONL as CSV or TSV. Each record becomes a row of the fields
+ * selected by a list of JSON Pointers, pulled out with a Projection (jsonl.h)
+ * rather than by parsing the record:
+ *
+ *   MappedFile input("events.jsonl");
+ *   export_csv(input.bytes(), {"/id", "/user/name", "/amount"}, STDOUT_FILENO);
+ *
+ * Strings are written unescaped, numbers as they appear in the record, and
+ * objects and arrays as their JSON text. null and missing fields are empty.
+ * A cell is quoted, with its quotes doubled, if it contains the delimiter, a
+ * quote or a line break. The input is split into chunks that are converted
+ * on several threads and written out in order, in large writes.
+ *
+ * Given a ScanControl that samples or limits the scan (jsonl.h), rows are
+ * instead produced one at a time on the calling thread, as the records
+ * skipped cost next to nothing and a limit needs the records in order.
+ * Every record sampled counts as a match.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "jsonl.h"
+
+namespace parsejson {
+
+struct CsvOptions {
+  char delimiter = ',';
+  // a first row of the column pointers
+  bool header = true;
+  unsigned threads = std::thread::hardware_concurrency();
+  size_t chunk_bytes = size_t(4) << 20;
+  ScanControl scan;
+};
+
+struct ExportStats {
+  size_t records = 0;
+  size_t bytes_out = 0;
+  // whether scan's limits ended the export early
+  bool stopped = false;
+};
+
+// appends a row for each field, terminated by a newline
+void append_csv_row(std::string &out, const std::vector<Field> &fields,
+                    char delimiter);
+
+// writes all of jsonl as rows to fd. throws ParseError for a bad record
+// (with its byte offset in jsonl) and std::system_error if writing fails.
+ExportStats export_csv(std::string_view jsonl,
+                       const std::vector<std::string> &columns, int fd,
+                       const CsvOptions &options = CsvOptions());
+
+} // namespace parsejson
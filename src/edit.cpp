@@ -0,0 +1,163 @@
+#include "edit.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace parsejson {
+
+EditableDocument::EditableDocument(std::string text,
+                                   std::pmr::memory_resource *items)
+    : source(std::move(text)), resource(items) {
+  EditResult result;
+  if (!parse_all(result)) {
+    throw ParseError(error.c_str());
+  }
+}
+
+EditableDocument::~EditableDocument() { destroy_json(root_item); }
+
+// parses the whole text, replacing the tree, or drops the tree if it fails
+bool EditableDocument::parse_all(EditResult &result) {
+  std::vector<SourceSpan> spans;
+  JSONItem *root = parse_span(0, source.size(), 0, spans, result);
+  destroy_json(root_item);
+  root_item = root;
+  item_spans = std::move(spans);
+  result.full = true;
+  result.reparsed = root;
+  if (!root) {
+    item_spans.clear();
+    return false;
+  }
+  // nor does one that gave up before falling back to the whole text
+  error.clear();
+  return true;
+}
+
+// parses source[begin, end) as an item depth levels down, or returns NULL
+// (with why in error) if it isn't exactly one value. spans are appended
+// relative to the whole text.
+JSONItem *EditableDocument::parse_span(size_t begin, size_t end,
+                                       uint32_t depth,
+                                       std::vector<SourceSpan> &spans,
+                                       EditResult &result) {
+  ParseBuffer input;
+  input.raw_json.assign(source, begin, end - begin);
+  input.depth = depth;
+  input.resource = resource;
+  input.spans = &spans;
+  result.parsed_bytes += end - begin;
+  JSONItem *item;
+  try {
+    item = parse_json(input);
+  } catch (ParseError &e) {
+    error = e.what();
+    return NULL;
+  }
+  // below the root parse_json leaves what follows the value to the caller
+  if (input.pos != input.raw_json.size()) {
+    destroy_json(item);
+    error = "trailing junk";
+    return NULL;
+  }
+  for (SourceSpan &span : spans) {
+    span.begin += begin;
+    span.end += begin;
+  }
+  return item;
+}
+
+EditResult EditableDocument::apply(const TextEdit &edit) {
+  if (edit.offset > source.size() ||
+      edit.removed > source.size() - edit.offset) {
+    throw std::out_of_range("edit runs past the end of the text");
+  }
+  source.replace(edit.offset, edit.removed, edit.inserted);
+  size_t edit_end = edit.offset + edit.removed;
+  // added to every offset from the end of what was removed on
+  size_t shift = edit.inserted.size() - edit.removed;
+  EditResult result;
+  error.clear();
+
+  // the items whose spans hold the whole edit, innermost first. begins only
+  // increase, so the innermost is the last to start at or before the edit
+  // that ends at or after it; the rest are its ancestors, which are the
+  // earlier spans ending at or after it too.
+  std::vector<size_t> enclosing;
+  size_t i = size_t(std::upper_bound(item_spans.begin(), item_spans.end(),
+                                     edit.offset,
+                                     [](size_t offset, const SourceSpan &span) {
+                                       return offset < span.begin;
+                                     }) -
+                    item_spans.begin());
+  while (i-- > 0) {
+    if (item_spans[i].end >= edit_end) {
+      enclosing.push_back(i);
+    }
+  }
+
+  for (size_t level = 0; level < enclosing.size(); level++) {
+    size_t at = enclosing[level];
+    SourceSpan old = item_spans[at];
+    std::vector<SourceSpan> spans;
+    JSONItem *fresh =
+        parse_span(old.begin, old.end + shift, // the span's new end
+                   uint32_t(enclosing.size() - 1 - level), spans, result);
+    if (!fresh) {
+      continue;
+    }
+    // the old item's descendants follow it, up to the first span starting
+    // past its end
+    size_t after = at + 1;
+    while (after < item_spans.size() && item_spans[after].begin < old.end) {
+      after++;
+    }
+
+    // splice fresh in where old.item was
+    JSONItem *stale = old.item;
+    if (level + 1 < enclosing.size()) {
+      JSONItem **link = &item_spans[enclosing[level + 1]].item->child;
+      while (*link != stale) {
+        link = &(*link)->next;
+      }
+      *link = fresh;
+    } else {
+      root_item = fresh;
+    }
+    fresh->next = stale->next;
+#if !PARSER_LEAN_NODES
+    fresh->prev = stale->prev;
+    if (fresh->next) {
+      fresh->next->prev = fresh;
+    }
+#endif
+    if (!stale->name.empty()) {
+      fresh->set_name(stale->name);
+    }
+    stale->next = NULL;
+    destroy_json(stale);
+
+    for (size_t outer = level + 1; outer < enclosing.size(); outer++) {
+      item_spans[enclosing[outer]].end += shift;
+    }
+    for (size_t j = after; j < item_spans.size(); j++) {
+      item_spans[j].begin += shift;
+      item_spans[j].end += shift;
+    }
+    item_spans.erase(item_spans.begin() + at, item_spans.begin() + after);
+    item_spans.insert(item_spans.begin() + at, spans.begin(), spans.end());
+    result.reparsed = fresh;
+    // a try that didn't fit on the way out here leaves no error behind
+    error.clear();
+    return result;
+  }
+
+  // the edit broke the structure around it, or touched the whitespace
+  // around the root
+  if (!parse_all(result)) {
+    throw ParseError(error.c_str());
+  }
+  return result;
+}
+
+} // namespace parsejson
@@ -0,0 +1,94 @@
+/*
+ * A parsed document that is kept up to date as its text is edited, for
+ * editors and language servers that want a tree after every keystroke:
+ *
+ *   EditableDocument document(read_file("settings.json"));
+ *   ...
+ *   // the user typed "5" at byte 1234
+ *   EditResult result = document.apply({1234, 0, "5"});
+ *   use(document.root());
+ *
+ * The document keeps the span of text each item was parsed from. An edit is
+ * re-parsed in the smallest item whose span holds all of it, and the new
+ * subtree spliced into the tree in place of the old one, taking over its
+ * name and siblings. Spans after the edit are moved along by the change in
+ * length. If the item's new text isn't exactly one value (the edit reached
+ * past it, as typing a ',' after an array element does), its parent is
+ * tried, and so on out to the root, and only if the root fails is the whole
+ * text parsed again.
+ *
+ * This is sound because what lies outside the item re-parsed is unchanged
+ * and the item's new text is one complete value, which reads the same in
+ * place as on its own: containers and strings end at their own closing
+ * character, and a number or literal is followed by whitespace or
+ * punctuation in a valid document.
+ *
+ * Pointers to items in the subtree that was replaced are invalid after an
+ * edit; the rest of the tree is untouched.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parsejson.h"
+
+namespace parsejson {
+
+// replace removed bytes at offset with inserted
+struct TextEdit {
+  size_t offset;
+  size_t removed;
+  std::string_view inserted;
+};
+
+struct EditResult {
+  // the item parsed again, now in the tree where the old one was
+  JSONItem *reparsed = NULL;
+  // the whole text was parsed again
+  bool full = false;
+  // bytes parsed, counting tries that didn't fit
+  size_t parsed_bytes = 0;
+};
+
+class EditableDocument {
+  std::string source;
+  JSONItem *root_item = NULL;
+  std::vector<SourceSpan> item_spans;
+  std::pmr::memory_resource *resource;
+  std::string error;
+
+  bool parse_all(EditResult &result);
+  JSONItem *parse_span(size_t begin, size_t end, uint32_t depth,
+                       std::vector<SourceSpan> &spans, EditResult &result);
+
+public:
+  // throws ParseError if text isn't valid JSON
+  explicit EditableDocument(std::string text,
+                            std::pmr::memory_resource *items =
+                                std::pmr::get_default_resource());
+  ~EditableDocument();
+  EditableDocument(const EditableDocument &) = delete;
+  EditableDocument &operator=(const EditableDocument &) = delete;
+
+  // applies edit to the text and brings the tree up to date. throws
+  // std::out_of_range if the edit runs past the end of the text. if the new
+  // text isn't valid JSON, which is usual halfway through typing something,
+  // the edit is still made but the tree is dropped (root() is NULL) and
+  // ParseError thrown; the next edit parses the whole text again.
+  EditResult apply(const TextEdit &edit);
+
+  const std::string &text() const { return source; }
+  JSONItem *root() const { return root_item; }
+  // every item's span in text(), in document order. empty while there is no
+  // tree.
+  const std::vector<SourceSpan> &spans() const { return item_spans; }
+  // why the text last failed to parse, or empty if it didn't
+  const std::string &parse_error() const { return error; }
+};
+
+} // namespace parsejson
@@ -0,0 +1,281 @@
+#include "flat.h"
+#include "pull.h"
+#include "traverse.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace parsejson {
+
+const char flat_magic[8] = {'P', 'J', 'F', 'L', 'A', 'T', '0', '1'};
+
+FlatRef FlatRef::find(std::string_view key) const {
+  for (FlatRef member : children()) {
+    if (member.name() == key) {
+      return member;
+    }
+  }
+  return FlatRef();
+}
+
+FlatView FlatView::from_bytes(const void *data, size_t size) {
+  if (size < sizeof(FlatHeader) ||
+      reinterpret_cast<uintptr_t>(data) % alignof(FlatNode) != 0) {
+    throw ParseError("flat document: truncated or misaligned header");
+  }
+  const FlatHeader *header = static_cast<const FlatHeader *>(data);
+  if (std::memcmp(header->magic, flat_magic, sizeof(flat_magic)) != 0) {
+    throw ParseError("flat document: bad magic");
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  size_t nodes_size = size_t(header->node_count) * sizeof(FlatNode);
+  if (size - sizeof(FlatHeader) < nodes_size ||
+      size - sizeof(FlatHeader) - nodes_size != header->strings_size) {
+    throw ParseError("flat document: size doesn't match header");
+  }
+  const FlatNode *nodes = reinterpret_cast<const FlatNode *>(header + 1);
+  const char *strings = reinterpret_cast<const char *>(nodes) + nodes_size;
+  uint32_t count = header->node_count;
+  uint64_t strings_size = header->strings_size;
+  for (uint32_t i = 0; i < count; i++) {
+    const FlatNode &node = nodes[i];
+    bool links_ok = (node.next == 0 || (node.next > i && node.next < count)) &&
+                    (node.child == 0 || (node.child > i && node.child < count));
+    bool name_ok =
+        uint64_t(node.name_offset) + node.name_length <= strings_size;
+    bool type_ok = node.type <= JSONType::j_null;
+    bool string_ok = node.type != JSONType::j_string ||
+                     (node.string_offset <= strings_size &&
+                      node.string_length <= strings_size - node.string_offset);
+    bool child_ok = node.child == 0 || node.type == JSONType::j_object ||
+                    node.type == JSONType::j_array;
+    if (!links_ok || !name_ok || !type_ok || !string_ok || !child_ok) {
+      char msg[100];
+      std::snprintf(msg, 100, "flat document: bad node %u", i);
+      throw ParseError((const char *)msg);
+    }
+  }
+  return FlatView(nodes, count, strings, strings_size);
+}
+
+void FlatView::serialize_to(void *out) const {
+  FlatHeader header;
+  std::memset(header.magic, 0, sizeof(header.magic));
+  header.node_count = count;
+  header.reserved = 0;
+  header.strings_size = strings_size;
+  char *dest = static_cast<char *>(out);
+  std::memcpy(dest, &header, sizeof(header));
+  std::memcpy(dest + sizeof(header), nodes, size_t(count) * sizeof(FlatNode));
+  std::memcpy(dest + sizeof(header) + size_t(count) * sizeof(FlatNode),
+              strings, strings_size);
+  // magic goes in last, so anyone watching shared memory being filled in
+  // doesn't see a valid header until everything behind it is there
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(dest, flat_magic, sizeof(flat_magic));
+}
+
+std::string FlatView::serialize() const {
+  std::string out(serialized_size(), '\0');
+  serialize_to(out.data());
+  return out;
+}
+
+// appends nodes in document order, linking each to its parent's last child
+class FlatBuilder {
+  struct Open {
+    uint32_t index;
+    uint32_t last; // most recent child, 0 if none yet
+  };
+
+  FlatDocument doc;
+  std::vector<Open> open;
+  uint32_t name_offset = 0;
+  uint32_t name_length = 0;
+
+public:
+  uint32_t add_string(std::string_view str) {
+    if (doc.strings.size() + str.size() > UINT32_MAX) {
+      throw ParseError("flat document: strings exceed 4GiB");
+    }
+    uint32_t offset = uint32_t(doc.strings.size());
+    doc.strings.append(str.data(), str.size());
+    return offset;
+  }
+
+  void name(std::string_view key) {
+    name_offset = add_string(key);
+    name_length = uint32_t(key.size());
+  }
+
+  FlatNode &add(JSONType type) {
+    if (doc.nodes.size() >= UINT32_MAX) {
+      throw ParseError("flat document: too many nodes");
+    }
+    uint32_t index = uint32_t(doc.nodes.size());
+    doc.nodes.emplace_back();
+    FlatNode &node = doc.nodes.back();
+    std::memset(&node, 0, sizeof(node));
+    node.type = type;
+    node.name_offset = name_offset;
+    node.name_length = name_length;
+    name_offset = name_length = 0;
+    if (!open.empty()) {
+      Open &parent = open.back();
+      if (parent.last) {
+        doc.nodes[parent.last].next = index;
+      } else {
+        doc.nodes[parent.index].child = index;
+      }
+      parent.last = index;
+    }
+    return node;
+  }
+
+  void begin(JSONType type) {
+    add(type);
+    open.push_back({uint32_t(doc.nodes.size() - 1), 0});
+  }
+  void end() { open.pop_back(); }
+
+  void string(std::string_view value) {
+    uint32_t offset = add_string(value);
+    FlatNode &node = add(JSONType::j_string);
+    node.string_offset = offset;
+    node.string_length = uint32_t(value.size());
+  }
+  void number(double value) { add(JSONType::j_number).double_val = value; }
+  void boolean(bool value) { add(JSONType::j_bool).bool_val = value; }
+  void null() { add(JSONType::j_null); }
+
+  FlatDocument finish() { return std::move(doc); }
+};
+
+FlatDocument parse_flat(ParseBuffer &input_buffer) {
+  FlatBuilder builder;
+  EventReader reader(input_buffer);
+  JSONEvent event;
+  while (reader.next(event)) {
+    switch (event.type) {
+    case ev_begin_object:
+      builder.begin(JSONType::j_object);
+      break;
+    case ev_begin_array:
+      builder.begin(JSONType::j_array);
+      break;
+    case ev_end_object:
+    case ev_end_array:
+      builder.end();
+      break;
+    case ev_key:
+      builder.name(event.text);
+      break;
+    case ev_string:
+      builder.string(event.text);
+      break;
+    case ev_number:
+      builder.number(event.double_val);
+      break;
+    case ev_bool:
+      builder.boolean(event.bool_val);
+      break;
+    case ev_null:
+      builder.null();
+      break;
+    }
+  }
+  return builder.finish();
+}
+
+FlatDocument flatten_json(const JSONItem *root) {
+  struct Flattener {
+    FlatBuilder &builder;
+    bool enter(const JSONItem *item) {
+      if (!item->name.empty()) {
+        builder.name(item->name.view());
+      }
+      switch (item->type) {
+      case JSONType::j_object:
+      case JSONType::j_array:
+        builder.begin(item->type);
+        break;
+      case JSONType::j_string:
+        builder.string(
+            std::string_view(item->string_val.data(), item->string_val.size()));
+        break;
+      case JSONType::j_number:
+        builder.number(item->double_val);
+        break;
+      case JSONType::j_bool:
+        builder.boolean(item->bool_val);
+        break;
+      case JSONType::j_null:
+        builder.null();
+        break;
+      }
+      return true;
+    }
+    void leave(const JSONItem *) { builder.end(); }
+  };
+  FlatBuilder builder;
+  if (root) {
+    Flattener flattener{builder};
+    visit_json(root, flattener);
+  }
+  return builder.finish();
+}
+
+FlatDocument copy_flat(FlatRef root) {
+  FlatBuilder builder;
+  std::vector<FlatRef> parents;
+  FlatRef ref = root;
+  while (ref) {
+    if (ref != root && !ref.name().empty()) {
+      builder.name(ref.name());
+    }
+    JSONType type = ref.type();
+    switch (type) {
+    case JSONType::j_object:
+    case JSONType::j_array:
+      builder.begin(type);
+      break;
+    case JSONType::j_string:
+      builder.string(ref.string_val());
+      break;
+    case JSONType::j_number:
+      builder.number(ref.double_val());
+      break;
+    case JSONType::j_bool:
+      builder.boolean(ref.bool_val());
+      break;
+    case JSONType::j_null:
+      builder.null();
+      break;
+    }
+    if (type == JSONType::j_object || type == JSONType::j_array) {
+      if (ref.child()) {
+        parents.push_back(ref);
+        ref = ref.child();
+        continue;
+      }
+      builder.end();
+    }
+    while (true) {
+      if (ref == root) {
+        ref = FlatRef();
+        break;
+      }
+      if (ref.next()) {
+        ref = ref.next();
+        break;
+      }
+      ref = parents.back();
+      parents.pop_back();
+      builder.end();
+    }
+  }
+  return builder.finish();
+}
+
+} // namespace parsejson
@@ -0,0 +1,203 @@
+/*
+ * A compact, relocatable form of a parsed document. Instead of separately
+ * allocated JSONItems joined by pointers, a flat document is one array of
+ * fixed size nodes linked by 32-bit indices, plus one blob holding every
+ * member name and string value. A node is 32 bytes, several times smaller
+ * than a JSONItem, siblings end up next to each other in memory, and since
+ * nothing in it is a pointer the whole document can be written out, mapped
+ * back in or moved without fixing anything up.
+ *
+ * The index arithmetic stays behind FlatRef, which reads much like a JSONItem:
+ *
+ *   FlatDocument doc = parse_flat(input);
+ *   for (FlatRef member : doc.root().children()) {
+ *     if (member.name() == "id") { ... member.double_val() ... }
+ *   }
+ *
+ * Limits: fewer than 2^32 nodes and 2^32 bytes of strings per document.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parsejson.h"
+
+namespace parsejson {
+
+// index 0 is always the root, which is never anyone's next or child, so 0
+// doubles as "no node". links only ever point forwards (children and later
+// siblings come after an item), which is also what keeps a loaded document
+// from containing cycles.
+struct FlatNode {
+  uint32_t next;
+  uint32_t child;
+  uint32_t name_offset;
+  uint32_t name_length;
+  uint32_t type; // JSONType
+  uint32_t string_length;
+  union {
+    double double_val;
+    uint64_t string_offset;
+    uint64_t bool_val;
+  };
+};
+static_assert(sizeof(FlatNode) == 32, "FlatNode layout is part of the format");
+
+// serialized layout: header, node_count FlatNodes, strings_size bytes
+struct FlatHeader {
+  char magic[8];
+  uint32_t node_count;
+  uint32_t reserved;
+  uint64_t strings_size;
+};
+static_assert(sizeof(FlatHeader) % alignof(FlatNode) == 0,
+              "nodes must stay aligned after the header");
+
+extern const char flat_magic[8];
+
+struct FlatChildren;
+
+class FlatRef {
+  const FlatNode *nodes = NULL;
+  const char *strings = NULL;
+  uint32_t index = 0;
+
+  const FlatNode &node() const { return nodes[index]; }
+  FlatRef at(uint32_t i) const {
+    return i ? FlatRef(nodes, strings, i) : FlatRef();
+  }
+
+public:
+  FlatRef() = default;
+  FlatRef(const FlatNode *node_array, const char *string_blob, uint32_t i)
+      : nodes(node_array), strings(string_blob), index(i) {}
+
+  explicit operator bool() const { return nodes != NULL; }
+  bool operator==(const FlatRef &other) const {
+    return nodes == other.nodes && index == other.index;
+  }
+  bool operator!=(const FlatRef &other) const { return !(*this == other); }
+
+  JSONType type() const { return JSONType(node().type); }
+  std::string_view name() const {
+    return std::string_view(strings + node().name_offset, node().name_length);
+  }
+  std::string_view string_val() const {
+    return std::string_view(strings + node().string_offset,
+                            node().string_length);
+  }
+  double double_val() const { return node().double_val; }
+  bool bool_val() const { return node().bool_val != 0; }
+
+  FlatRef child() const { return at(node().child); }
+  FlatRef next() const { return at(node().next); }
+  // first member called key, or a null FlatRef
+  FlatRef find(std::string_view key) const;
+
+  // members of an object or elements of an array
+  FlatChildren children() const;
+};
+
+class FlatIterator {
+  FlatRef ref;
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = FlatRef;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const FlatRef *;
+  using reference = const FlatRef &;
+
+  FlatIterator(FlatRef start = FlatRef()) : ref(start) {}
+  reference operator*() const { return ref; }
+  pointer operator->() const { return &ref; }
+  FlatIterator &operator++() {
+    ref = ref.next();
+    return *this;
+  }
+  FlatIterator operator++(int) {
+    FlatIterator prior = *this;
+    ref = ref.next();
+    return prior;
+  }
+  bool operator==(const FlatIterator &other) const { return ref == other.ref; }
+  bool operator!=(const FlatIterator &other) const { return ref != other.ref; }
+};
+
+struct FlatChildren {
+  FlatRef first;
+  FlatIterator begin() const { return FlatIterator(first); }
+  FlatIterator end() const { return FlatIterator(); }
+  bool empty() const { return !first; }
+};
+
+inline FlatChildren FlatRef::children() const { return FlatChildren{child()}; }
+
+// a flat document that lives in someone else's memory: a FlatDocument, a file
+// or a mapped region. it is only as valid as that memory.
+class FlatView {
+  const FlatNode *nodes = NULL;
+  uint32_t count = 0;
+  const char *strings = NULL;
+  uint64_t strings_size = 0;
+
+public:
+  FlatView() = default;
+  FlatView(const FlatNode *node_array, uint32_t node_count,
+           const char *string_blob, uint64_t string_bytes)
+      : nodes(node_array), count(node_count), strings(string_blob),
+        strings_size(string_bytes) {}
+
+  // checks that data holds a well formed serialized document (header, sizes,
+  // links and string ranges) and returns a view of it. throws ParseError if
+  // not. data must be 8 byte aligned.
+  static FlatView from_bytes(const void *data, size_t size);
+
+  FlatRef root() const {
+    return count ? FlatRef(nodes, strings, 0) : FlatRef();
+  }
+  uint32_t node_count() const { return count; }
+  uint64_t string_bytes() const { return strings_size; }
+  // bytes the serialized form takes
+  size_t serialized_size() const {
+    return sizeof(FlatHeader) + size_t(count) * sizeof(FlatNode) +
+           strings_size;
+  }
+  // writes the serialized form to out, which must have serialized_size()
+  // bytes available. the header's magic is written last.
+  void serialize_to(void *out) const;
+  std::string serialize() const;
+};
+
+class FlatBuilder;
+
+// owns the node array and string blob
+class FlatDocument {
+  std::vector<FlatNode> nodes;
+  std::string strings;
+
+  friend class FlatBuilder;
+
+public:
+  FlatView view() const {
+    return FlatView(nodes.data(), uint32_t(nodes.size()), strings.data(),
+                    strings.size());
+  }
+  FlatRef root() const { return view().root(); }
+  uint32_t node_count() const { return uint32_t(nodes.size()); }
+};
+
+// parses straight into flat form, without building JSONItems on the way
+FlatDocument parse_flat(ParseBuffer &input_buffer);
+// converts an existing tree
+FlatDocument flatten_json(const JSONItem *root);
+// a standalone copy of the subtree at root (without root's own name)
+FlatDocument copy_flat(FlatRef root);
+
+} // namespace parsejson
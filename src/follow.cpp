@@ -0,0 +1,222 @@
+#include "follow.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace parsejson {
+
+JSONLFollower::JSONLFollower(const std::string &file_path,
+                             const FollowOptions &follow)
+    : path(file_path), options(follow) {
+  size_t slash = path.rfind('/');
+  std::string directory = slash == std::string::npos ? "."
+                          : slash == 0              ? "/"
+                                                    : path.substr(0, slash);
+  name = slash == std::string::npos ? path : path.substr(slash + 1);
+  notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (notify_fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "inotify_init1");
+  }
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  directory_watch = inotify_add_watch(notify_fd, directory.c_str(),
+                                      IN_CREATE | IN_MOVED_TO);
+  if (wake_fd < 0 || directory_watch < 0) {
+    int error = errno;
+    close(notify_fd);
+    if (wake_fd >= 0) {
+      close(wake_fd);
+    }
+    throw std::system_error(error, std::generic_category(),
+                            "can't watch " + directory);
+  }
+  open_file(options.from_end, options.start_offset);
+}
+
+JSONLFollower::~JSONLFollower() {
+  close_file();
+  close(wake_fd);
+  close(notify_fd);
+}
+
+// opens whatever is at path now, if anything, and starts watching it
+bool JSONLFollower::open_file(bool at_end, uint64_t start) {
+  fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return false;
+    }
+    throw std::system_error(errno, std::generic_category(),
+                            "can't open " + path);
+  }
+  // watched before anything is read, so no write can slip by unnoticed
+  file_watch = inotify_add_watch(notify_fd, path.c_str(), IN_MODIFY);
+  struct stat info;
+  if (file_watch < 0 || fstat(fd, &info) != 0) {
+    int error = errno;
+    close_file();
+    throw std::system_error(error, std::generic_category(),
+                            "can't watch " + path);
+  }
+  offset = at_end ? uint64_t(info.st_size)
+                  : std::min<uint64_t>(start, uint64_t(info.st_size));
+  if (lseek(fd, off_t(offset), SEEK_SET) < 0) {
+    int error = errno;
+    close_file();
+    throw std::system_error(error, std::generic_category(), path);
+  }
+  pending.clear();
+  return true;
+}
+
+void JSONLFollower::close_file() {
+  if (file_watch >= 0) {
+    // fails harmlessly if the file was deleted and the watch went with it
+    inotify_rm_watch(notify_fd, file_watch);
+    file_watch = -1;
+  }
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+// whether path now names a different file from the one being read
+bool JSONLFollower::replaced() const {
+  struct stat now;
+  if (stat(path.c_str(), &now) != 0) {
+    return false;
+  }
+  struct stat current;
+  return fd < 0 || fstat(fd, &current) != 0 || now.st_ino != current.st_ino ||
+         now.st_dev != current.st_dev;
+}
+
+// hands on every complete line in pending, and the rest too if the file is
+// finished
+void JSONLFollower::hand_on(const Handler &handle, bool finished) {
+  size_t end = pending.rfind('\n');
+  end = finished ? pending.size()
+                 : end == std::string::npos ? 0 : end + 1;
+  if (end == 0) {
+    return;
+  }
+  counts.batches++;
+  handle(std::string_view(pending.data(), end));
+  pending.erase(0, end);
+  offset += end;
+}
+
+// reads everything there is to read, handing it on in batches
+void JSONLFollower::catch_up(const Handler &handle, bool finished) {
+  struct stat info;
+  if (fstat(fd, &info) == 0 &&
+      uint64_t(info.st_size) < offset + pending.size()) {
+    // truncated in place
+    counts.truncations++;
+    counts.dropped += pending.size();
+    pending.clear();
+    offset = 0;
+    if (lseek(fd, 0, SEEK_SET) < 0) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+  }
+  while (true) {
+    size_t had = pending.size();
+    pending.resize(had + options.read_bytes);
+    ssize_t got = read(fd, pending.data() + had, options.read_bytes);
+    pending.resize(had + size_t(std::max<ssize_t>(got, 0)));
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(),
+                              "can't read " + path);
+    }
+    if (got == 0) {
+      break;
+    }
+    counts.bytes += uint64_t(got);
+    counts.reads++;
+    if (pending.size() >= options.batch_bytes) {
+      hand_on(handle, false);
+    }
+  }
+  hand_on(handle, finished);
+}
+
+void JSONLFollower::run(const Handler &handle) {
+  if (fd >= 0) {
+    catch_up(handle, false);
+  }
+  alignas(inotify_event) char events[sizeof(inotify_event) + NAME_MAX + 1];
+  while (true) {
+    if (fd < 0 && open_file(false, 0)) {
+      catch_up(handle, false);
+    }
+    pollfd waiting[2] = {{notify_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+    if (poll(waiting, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "poll");
+    }
+    if (waiting[1].revents) {
+      uint64_t count;
+      ssize_t ignored = read(wake_fd, &count, sizeof(count));
+      (void)ignored;
+      return;
+    }
+    bool modified = false;
+    bool created = false;
+    ssize_t got;
+    while ((got = read(notify_fd, events, sizeof(events))) > 0) {
+      for (char *at = events; at < events + got;) {
+        inotify_event *event = reinterpret_cast<inotify_event *>(at);
+        if (event->wd == file_watch) {
+          modified = true;
+        } else if (event->wd == directory_watch && event->len &&
+                   name == event->name) {
+          created = true;
+        }
+        at += sizeof(inotify_event) + event->len;
+      }
+    }
+    if (got < 0 && errno != EAGAIN && errno != EINTR) {
+      throw std::system_error(errno, std::generic_category(), "inotify");
+    }
+    if (fd >= 0 && (modified || created)) {
+      catch_up(handle, false);
+    }
+    if (created && fd >= 0 && replaced()) {
+      // whatever the old file still had was just read. its last line won't
+      // be finished now.
+      hand_on(handle, true);
+      close_file();
+      counts.rotations++;
+    }
+  }
+}
+
+void JSONLFollower::run(
+    const std::function<void(std::string_view chunk, std::string &out)> &work,
+    const std::function<void(std::string &out)> &emit) {
+  run([&](std::string_view records) {
+    process_chunks(records, options.chunk_bytes, options.threads, work, emit);
+  });
+}
+
+void JSONLFollower::stop() {
+  uint64_t one = 1;
+  ssize_t ignored = write(wake_fd, &one, sizeof(one));
+  (void)ignored;
+}
+
+} // namespace parsejson
@@ -0,0 +1,122 @@
+/*
+ * Following a JSONL file as it is appended to, as tail -F does, for log
+ * shippers and the like:
+ *
+ *   JSONLFollower follower("/var/log/app/events.jsonl");
+ *   std::thread shipper([&] {
+ *     follower.run([&](std::string_view records) {
+ *       for_each_line(records, ship);
+ *     });
+ *   });
+ *   ...
+ *   follower.stop();
+ *   shipper.join();
+ *
+ * The follower sleeps in poll() on an inotify descriptor until the file is
+ * written to, then reads whatever is new, in reads of up to read_bytes and
+ * without going back over anything already read, and hands on every
+ * complete line. A line still being written is held back until the rest of
+ * it arrives.
+ *
+ * The file's directory is watched too. When a different file appears under
+ * the name (the old one was renamed or deleted, and a new one created),
+ * whatever is left of the old file is read, its last line handed on even if
+ * unterminated, and the new file is followed from its start. A file that
+ * shrinks was truncated in place: it is read again from the start and a
+ * partial line held from before is dropped. As with tail, a file truncated
+ * and written past the point reading had got to before the follower wakes
+ * looks like one appended to. The file needn't exist when following starts.
+ *
+ * The second form of run() passes records through process_chunks()
+ * (jsonl.h), so a burst of appended data is worked on by several threads.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "jsonl.h"
+
+namespace parsejson {
+
+struct FollowOptions {
+  // start at the end of the file, not at start_offset
+  bool from_end = false;
+  uint64_t start_offset = 0;
+  size_t read_bytes = size_t(1) << 20;
+  // how much is read before it is handed on, if more keeps coming
+  size_t batch_bytes = size_t(16) << 20;
+  // for run() with process_chunks()
+  unsigned threads = std::thread::hardware_concurrency();
+  size_t chunk_bytes = size_t(1) << 20;
+};
+
+struct FollowStats {
+  uint64_t bytes = 0;
+  size_t reads = 0;
+  size_t batches = 0;
+  size_t rotations = 0;
+  size_t truncations = 0;
+  // bytes of partial lines dropped when the file was truncated
+  uint64_t dropped = 0;
+};
+
+class JSONLFollower {
+public:
+  using Handler = std::function<void(std::string_view records)>;
+
+private:
+  std::string path;
+  std::string name; // the last part of path
+  FollowOptions options;
+  int notify_fd = -1;
+  int wake_fd = -1;
+  int fd = -1;
+  int file_watch = -1;
+  int directory_watch = -1;
+  // offset in the current file of pending's first byte
+  uint64_t offset = 0;
+  // read but not yet handed on: the start of a line still being written
+  std::string pending;
+  FollowStats counts;
+
+  bool open_file(bool at_end, uint64_t start);
+  void close_file();
+  bool replaced() const;
+  void hand_on(const Handler &handle, bool finished);
+  void catch_up(const Handler &handle, bool finished);
+
+public:
+  // throws std::system_error if inotify can't be set up or the directory
+  // can't be watched
+  explicit JSONLFollower(const std::string &file_path,
+                         const FollowOptions &follow = FollowOptions());
+  ~JSONLFollower();
+  JSONLFollower(const JSONLFollower &) = delete;
+  JSONLFollower &operator=(const JSONLFollower &) = delete;
+
+  // hands on complete records, as a run of whole lines, until stop(). an
+  // exception from handle ends it and is rethrown. throws std::system_error
+  // if reading fails.
+  void run(const Handler &handle);
+  // the same, with each run of lines passed to process_chunks()
+  void run(
+      const std::function<void(std::string_view chunk, std::string &out)> &work,
+      const std::function<void(std::string &out)> &emit);
+
+  // makes run() return, from any thread (or a signal handler)
+  void stop();
+
+  // offset in the current file up to which records have been handed on,
+  // for resuming later with start_offset
+  uint64_t position() const { return offset; }
+  // only to be read while run() isn't running
+  const FollowStats &stats() const { return counts; }
+};
+
+} // namespace parsejson
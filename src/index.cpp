@@ -0,0 +1,363 @@
+#include "index.h"
+#include "sort.h"
+#include "writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace parsejson {
+
+// an index file is an IndexHeader, the key pointer (padded to 8 bytes), the
+// entries, the hash table slots if it's hashed, and then the keys. numbers
+// are in host order; an index isn't meant to move between machines.
+struct IndexHeader {
+  char magic[8];
+  IndexKind kind;
+  uint32_t pointer_bytes;
+  uint64_t count;
+  uint64_t slot_count;
+  uint64_t key_bytes;
+  uint64_t source_size;
+  int64_t source_mtime_ns;
+};
+
+struct IndexEntry {
+  uint64_t record;
+  uint64_t key; // offset in the keys
+  uint32_t record_length;
+  uint32_t key_length;
+};
+
+struct IndexSlot {
+  uint64_t entry; // index of the entry plus one, or 0 if the slot is free
+  uint32_t hash;
+  uint32_t unused;
+};
+
+const char index_magic[8] = {'P', 'J', 'I', 'N', 'D', 'E', 'X', '1'};
+
+size_t padded(size_t bytes) { return (bytes + 7) & ~size_t(7); }
+
+int64_t mtime_ns(const struct stat &info) {
+  return int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+// a key given as JSON text as a Field, as if pulled out of a record
+Field key_field(std::string_view key) {
+  size_t first = key.find_first_not_of(" \t\r\n");
+  size_t last = key.find_last_not_of(" \t\r\n");
+  Field field;
+  if (first == std::string_view::npos) {
+    throw std::invalid_argument("empty key");
+  }
+  field.text = key.substr(first, last + 1 - first);
+  field.found = true;
+  try {
+    if (skip_value(field.text, 0) != field.text.size()) {
+      throw std::invalid_argument("key isn't a single value: " +
+                                  std::string(key));
+    }
+  } catch (ParseError &e) {
+    throw std::invalid_argument(std::string("bad key: ") + e.what());
+  }
+  switch (field.text[0]) {
+  case '"':
+    field.type = j_string;
+    break;
+  case '{':
+    field.type = j_object;
+    break;
+  case '[':
+    field.type = j_array;
+    break;
+  default:
+    if (field.text == "true" || field.text == "false") {
+      field.type = j_bool;
+    } else if (field.text == "null") {
+      field.type = j_null;
+    } else {
+      field.type = j_number;
+    }
+  }
+  return field;
+}
+
+IndexStats build_index(const std::string &jsonl_path,
+                       const std::string &key_pointer,
+                       const std::string &index_path,
+                       const IndexOptions &options) {
+  auto start = std::chrono::steady_clock::now();
+  Projection projection({key_pointer});
+  struct stat info;
+  if (stat(jsonl_path.c_str(), &info) != 0) {
+    throw std::system_error(errno, std::generic_category(), jsonl_path);
+  }
+  MappedFile input(jsonl_path);
+  std::string_view jsonl = input.bytes();
+
+  // each worker collects entries, with key offsets into its own keys
+  struct Part {
+    std::vector<IndexEntry> entries;
+    std::string keys;
+    size_t records = 0;
+  };
+  unsigned threads = std::max(options.threads, 1u);
+  std::vector<Part> parts(threads);
+  for_each_chunk(
+      jsonl, options.chunk_bytes, threads,
+      [&](unsigned worker, std::string_view chunk) {
+        Part &part = parts[worker];
+        std::vector<Field> fields;
+        for_each_line(chunk, [&](std::string_view record) {
+          part.records++;
+          size_t key = part.keys.size();
+          if (record.size() > UINT32_MAX) {
+            input_record_error(jsonl, record, "record too long");
+          }
+          projection.extract(record, fields, jsonl);
+          if (!fields[0].found) {
+            return;
+          }
+          try {
+            append_sort_key(part.keys, fields[0]);
+          } catch (ParseError &e) {
+            input_record_error(jsonl, record, e.what());
+          }
+          part.entries.push_back({uint64_t(record.data() - jsonl.data()), key,
+                                  uint32_t(record.size()),
+                                  uint32_t(part.keys.size() - key)});
+        });
+      });
+
+  IndexStats stats;
+  std::vector<IndexEntry> entries;
+  std::string keys;
+  for (Part &part : parts) {
+    stats.records += part.records;
+    for (IndexEntry &entry : part.entries) {
+      entry.key += keys.size();
+      entries.push_back(entry);
+    }
+    keys += part.keys;
+    part = Part();
+  }
+  stats.indexed = entries.size();
+  auto key_of = [&](const IndexEntry &entry) {
+    return std::string_view(keys.data() + entry.key, entry.key_length);
+  };
+  std::vector<IndexSlot> slots;
+  if (options.kind == index_sorted) {
+    std::sort(entries.begin(), entries.end(),
+              [&](const IndexEntry &a, const IndexEntry &b) {
+                int order = key_of(a).compare(key_of(b));
+                return order != 0 ? order < 0 : a.record < b.record;
+              });
+  } else {
+    // in input order, so that linear probing finds a shared key's records
+    // in input order too
+    std::sort(entries.begin(), entries.end(),
+              [](const IndexEntry &a, const IndexEntry &b) {
+                return a.record < b.record;
+              });
+    size_t slot_count = 1;
+    while (slot_count < entries.size() * 2) {
+      slot_count *= 2;
+    }
+    slots.assign(slot_count, IndexSlot{0, 0, 0});
+    for (size_t i = 0; i < entries.size(); i++) {
+      uint32_t hash = JSONKey::hash_of(key_of(entries[i]));
+      size_t slot = hash & (slot_count - 1);
+      while (slots[slot].entry) {
+        slot = (slot + 1) & (slot_count - 1);
+      }
+      slots[slot] = {i + 1, hash, 0};
+    }
+  }
+
+  IndexHeader header;
+  memcpy(header.magic, index_magic, sizeof(header.magic));
+  header.kind = options.kind;
+  header.pointer_bytes = uint32_t(key_pointer.size());
+  header.count = entries.size();
+  header.slot_count = slots.size();
+  header.key_bytes = keys.size();
+  header.source_size = uint64_t(info.st_size);
+  header.source_mtime_ns = mtime_ns(info);
+  std::string pointer = key_pointer;
+  pointer.resize(padded(pointer.size()));
+  iovec pieces[] = {
+      {&header, sizeof(header)},
+      {pointer.data(), pointer.size()},
+      {entries.data(), entries.size() * sizeof(IndexEntry)},
+      {slots.data(), slots.size() * sizeof(IndexSlot)},
+      {keys.data(), keys.size()},
+  };
+  for (iovec &piece : pieces) {
+    stats.index_bytes += piece.iov_len;
+  }
+
+  std::string temporary = index_path + ".XXXXXX";
+  int fd = mkstemp(temporary.data());
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "can't create " + temporary);
+  }
+  try {
+    write_vectors(fd, pieces, sizeof(pieces) / sizeof(pieces[0]));
+    if (fchmod(fd, 0644) != 0 || fsync(fd) != 0) {
+      throw std::system_error(errno, std::generic_category(), temporary);
+    }
+    if (rename(temporary.c_str(), index_path.c_str()) != 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "can't rename to " + index_path);
+    }
+  } catch (...) {
+    close(fd);
+    unlink(temporary.c_str());
+    throw;
+  }
+  close(fd);
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  return stats;
+}
+
+JSONLIndex::JSONLIndex(const std::string &index_path,
+                       const std::string &jsonl_path)
+    : file(index_path, false) {
+  std::string_view bytes = file.bytes();
+  header = reinterpret_cast<const IndexHeader *>(bytes.data());
+  if (bytes.size() < sizeof(IndexHeader) ||
+      memcmp(header->magic, index_magic, sizeof(index_magic)) != 0 ||
+      header->kind > index_hashed) {
+    throw ParseError("not an index file");
+  }
+  size_t pointer_at = sizeof(IndexHeader);
+  size_t entries_at = pointer_at + padded(header->pointer_bytes);
+  size_t slots_at = entries_at + header->count * sizeof(IndexEntry);
+  size_t keys_at = slots_at + header->slot_count * sizeof(IndexSlot);
+  if (header->count > bytes.size() / sizeof(IndexEntry) ||
+      header->slot_count > bytes.size() / sizeof(IndexSlot) ||
+      keys_at + header->key_bytes != bytes.size() ||
+      (header->kind == index_hashed &&
+       (header->slot_count == 0 ||
+        (header->slot_count & (header->slot_count - 1))))) {
+    throw ParseError("truncated or corrupt index file");
+  }
+  entries = reinterpret_cast<const IndexEntry *>(bytes.data() + entries_at);
+  slots = reinterpret_cast<const IndexSlot *>(bytes.data() + slots_at);
+  keys = bytes.data() + keys_at;
+  // every key and slot is checked once here, so find() can trust them
+  for (uint64_t i = 0; i < header->count; i++) {
+    if (entries[i].key > header->key_bytes ||
+        entries[i].key_length > header->key_bytes - entries[i].key) {
+      throw ParseError("truncated or corrupt index file");
+    }
+  }
+  for (uint64_t i = 0; i < header->slot_count; i++) {
+    if (slots[i].entry > header->count) {
+      throw ParseError("truncated or corrupt index file");
+    }
+  }
+
+  fd = open(jsonl_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "can't open " + jsonl_path);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || uint64_t(info.st_size) != header->source_size ||
+      mtime_ns(info) != header->source_mtime_ns) {
+    close(fd);
+    throw std::runtime_error("index is out of date for " + jsonl_path);
+  }
+}
+
+JSONLIndex::~JSONLIndex() { close(fd); }
+
+IndexKind JSONLIndex::kind() const { return header->kind; }
+
+std::string JSONLIndex::key_pointer() const {
+  return std::string(file.bytes().data() + sizeof(IndexHeader),
+                     header->pointer_bytes);
+}
+
+size_t JSONLIndex::size() const { return size_t(header->count); }
+
+std::vector<IndexHit> JSONLIndex::find(std::string_view key) const {
+  std::string wanted;
+  try {
+    append_sort_key(wanted, key_field(key));
+  } catch (ParseError &e) {
+    throw std::invalid_argument(std::string("bad key: ") + e.what());
+  }
+  auto key_of = [&](const IndexEntry &entry) {
+    return std::string_view(keys + entry.key, entry.key_length);
+  };
+  std::vector<IndexHit> hits;
+  if (header->kind == index_sorted) {
+    const IndexEntry *end = entries + header->count;
+    const IndexEntry *entry =
+        std::lower_bound(entries, end, wanted,
+                         [&](const IndexEntry &a, const std::string &b) {
+                           return key_of(a) < b;
+                         });
+    for (; entry != end && key_of(*entry) == wanted; entry++) {
+      hits.push_back({entry->record, entry->record_length});
+    }
+    return hits;
+  }
+  uint32_t hash = JSONKey::hash_of(wanted);
+  uint64_t mask = header->slot_count - 1;
+  uint64_t slot = hash & mask;
+  for (uint64_t probe = 0; probe <= mask && slots[slot].entry; probe++) {
+    const IndexSlot &found = slots[slot];
+    slot = (slot + 1) & mask;
+    if (found.hash != hash) {
+      continue;
+    }
+    const IndexEntry &entry = entries[found.entry - 1];
+    if (key_of(entry) == wanted) {
+      hits.push_back({entry.record, entry.record_length});
+    }
+  }
+  return hits;
+}
+
+std::string JSONLIndex::read(const IndexHit &hit) const {
+  std::string record(hit.length, '\0');
+  size_t done = 0;
+  while (done < record.size()) {
+    ssize_t got = pread(fd, record.data() + done, record.size() - done,
+                        off_t(hit.offset + done));
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      throw std::system_error(got < 0 ? errno : EIO, std::generic_category(),
+                              "can't read record");
+    }
+    done += size_t(got);
+  }
+  return record;
+}
+
+Document JSONLIndex::lookup(std::string_view key) const {
+  std::vector<IndexHit> hits = find(key);
+  if (hits.empty()) {
+    return Document();
+  }
+  ParseBuffer buffer;
+  buffer.raw_json = read(hits[0]);
+  return parse_document(buffer);
+}
+
+} // namespace parsejson
@@ -0,0 +1,105 @@
+/*
+ * A key to offset index over a JSONL file, for looking records up by a field
+ * without scanning the file:
+ *
+ *   build_index("users.jsonl", "/id", "users.idx");
+ *   ...
+ *   JSONLIndex index("users.idx", "users.jsonl");
+ *   Document user = index.lookup("\"u-1234\"");
+ *
+ * Building reads every record once, pulling out just the key with a
+ * Projection (jsonl.h), on several threads. The index file is then mapped
+ * for lookups, which touch a few of its pages and read and parse only the
+ * record wanted.
+ *
+ * An index is either sorted, looked up by binary search, or hashed, an open
+ * addressing table that usually finds a key in one probe. Keys are given as
+ * JSON text and match by value as sort_jsonl() orders them (sort.h), so 42
+ * and 42.0 are the same key, as are "\u0041" and "A". Records without the
+ * field aren't indexed. A key may be shared by several records, which are
+ * found in input order.
+ *
+ * The index remembers the size and modification time of the file it was
+ * built from, and refuses to be used with a file that has changed since.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "jsonl.h"
+
+namespace parsejson {
+
+enum IndexKind : uint32_t { index_sorted, index_hashed };
+
+struct IndexOptions {
+  IndexKind kind = index_hashed;
+  unsigned threads = std::thread::hardware_concurrency();
+  size_t chunk_bytes = size_t(4) << 20;
+};
+
+struct IndexStats {
+  size_t records = 0;
+  size_t indexed = 0;
+  size_t index_bytes = 0;
+  double seconds = 0;
+};
+
+// where a record is in the JSONL file, not counting its line ending
+struct IndexHit {
+  uint64_t offset;
+  uint32_t length;
+};
+
+// indexes jsonl_path by the value key_pointer selects, writing the index to
+// index_path (by way of a temporary file alongside it, so a reader never
+// sees half of one). throws ParseError for a bad record or pointer and
+// std::system_error if a file can't be read or written.
+IndexStats build_index(const std::string &jsonl_path,
+                       const std::string &key_pointer,
+                       const std::string &index_path,
+                       const IndexOptions &options = IndexOptions());
+
+struct IndexHeader;
+struct IndexEntry;
+struct IndexSlot;
+
+class JSONLIndex {
+  MappedFile file;
+  int fd = -1;
+  const IndexHeader *header;
+  const IndexEntry *entries;
+  const IndexSlot *slots;
+  const char *keys;
+
+public:
+  // throws ParseError if index_path isn't an index, std::runtime_error if
+  // jsonl_path has changed since it was built, and std::system_error if
+  // either can't be opened
+  JSONLIndex(const std::string &index_path, const std::string &jsonl_path);
+  ~JSONLIndex();
+  JSONLIndex(const JSONLIndex &) = delete;
+  JSONLIndex &operator=(const JSONLIndex &) = delete;
+
+  IndexKind kind() const;
+  std::string key_pointer() const;
+  // records indexed
+  size_t size() const;
+
+  // every record whose key is the JSON value key, e.g. "\"u-1234\"" or
+  // "42". throws std::invalid_argument if key isn't a single JSON value.
+  std::vector<IndexHit> find(std::string_view key) const;
+  // the record's text, read from the JSONL file
+  std::string read(const IndexHit &hit) const;
+  // the first record with key, parsed, or an empty Document if there isn't
+  // one
+  Document lookup(std::string_view key) const;
+};
+
+} // namespace parsejson
@@ -0,0 +1,731 @@
+#include "jsonl.h"
+#include "pointer.h"
+#include "structural.h"
+#include "threads.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <mutex>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace parsejson {
+
+MappedFile::MappedFile(const std::string &path, bool sequential) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "can't open " + path);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+  size = size_t(info.st_size);
+  if (size) {
+    // the file goes over a zeroed mapping a byte longer, so that the byte
+    // past its end is there to read, as '\0', even when the file fills its
+    // last page. that lets the parser work on the mapping in place.
+    base = mmap(NULL, size + 1, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                0);
+    if (base == MAP_FAILED ||
+        mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+            MAP_FAILED) {
+      int error = errno;
+      if (base != MAP_FAILED) {
+        munmap(base, size + 1);
+      }
+      base = NULL;
+      close(fd);
+      throw std::system_error(error, std::generic_category(),
+                              "can't map " + path);
+    }
+    // read once, front to back, or a page here and there
+    madvise(base, size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (base) {
+    munmap(base, size + 1);
+  }
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : base(std::exchange(other.base, nullptr)),
+      size(std::exchange(other.size, 0)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    if (base) {
+      munmap(base, size + 1);
+    }
+    base = std::exchange(other.base, nullptr);
+    size = std::exchange(other.size, 0);
+  }
+  return *this;
+}
+
+[[noreturn]] void record_error(const char *what, size_t pos) {
+  char msg[100];
+  std::snprintf(msg, 100, "%s at pos: %zu", what, pos);
+  throw ParseError((const char *)msg);
+}
+
+void append_unescaped(std::string &out, std::string_view quoted) {
+  std::string_view body = quoted.substr(1, quoted.size() - 2);
+  size_t pos = 0;
+  while (true) {
+    size_t escape = body.find('\\', pos);
+    out.append(body.data() + pos,
+               (escape == std::string_view::npos ? body.size() : escape) -
+                   pos);
+    if (escape == std::string_view::npos) {
+      return;
+    }
+    DecodedEscape decoded = decode_escape(body, escape);
+    out.append(decoded.utf8, decoded.size);
+    pos = escape + decoded.length;
+  }
+}
+
+// the 64 bytes of text from pos on, padded with spaces past its end
+const char *block_at(std::string_view text, size_t pos, char *padded) {
+  if (text.size() - pos >= 64) {
+    return text.data() + pos;
+  }
+  std::memset(padded, ' ', 64);
+  std::memcpy(padded, text.data() + pos, text.size() - pos);
+  return padded;
+}
+
+// the first quote after pos that no backslash escapes
+size_t skip_string(std::string_view text, size_t pos) {
+  uint64_t escape_carry = 0;
+  char padded[64];
+  for (size_t at = pos + 1; at < text.size(); at += 64) {
+    BlockMasks masks = classify_block(block_at(text, at, padded));
+    uint64_t quotes =
+        masks.quote & ~escaped_bytes(masks.backslash, escape_carry);
+    if (quotes) {
+      return at + size_t(__builtin_ctzll(quotes)) + 1;
+    }
+  }
+  record_error("unterminated string", pos);
+}
+
+// counts brackets outside strings until the one at pos is closed. brackets
+// aren't matched up, so [} passes.
+size_t skip_container(std::string_view text, size_t pos) {
+  uint64_t escape_carry = 0;
+  uint64_t in_string = 0;
+  size_t depth = 0;
+  char padded[64];
+  for (size_t at = pos; at < text.size(); at += 64) {
+    BlockMasks masks = classify_block(block_at(text, at, padded));
+    uint64_t quotes =
+        masks.quote & ~escaped_bytes(masks.backslash, escape_carry);
+    uint64_t strings = prefix_xor(quotes) ^ in_string;
+    in_string = uint64_t(int64_t(strings) >> 63);
+    uint64_t open = masks.open & ~strings;
+    uint64_t close = masks.close & ~strings;
+    size_t closes = size_t(__builtin_popcountll(close));
+    if (depth > closes) {
+      // still open at the end of the block even if every close came first
+      depth += size_t(__builtin_popcountll(open)) - closes;
+      continue;
+    }
+    for (uint64_t brackets = open | close; brackets;
+         brackets &= brackets - 1) {
+      uint64_t bit = brackets & -brackets;
+      if (open & bit) {
+        depth++;
+      } else if (--depth == 0) {
+        return at + size_t(__builtin_ctzll(bit)) + 1;
+      }
+    }
+  }
+  record_error("unterminated container", pos);
+}
+
+char byte_at(std::string_view text, size_t pos) {
+  return pos < text.size() ? text[pos] : '\0';
+}
+
+size_t skip_space(std::string_view text, size_t pos) {
+  while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' ||
+                               text[pos] == '\t' || text[pos] == '\r')) {
+    pos++;
+  }
+  return pos;
+}
+
+// checks the string at pos against the JSON grammar, returning its end
+size_t validate_string(std::string_view text, size_t pos) {
+  size_t at = pos + 1;
+  while (true) {
+    if (at >= text.size()) {
+      record_error("unterminated string", pos);
+    }
+    unsigned char c = text[at];
+    if (c == '"') {
+      return at + 1;
+    }
+    if (c < 0x20) {
+      record_error("control character in string", at);
+    }
+    if (c != '\\') {
+      at++;
+      continue;
+    }
+    at += decode_escape(text, at).length;
+  }
+}
+
+// checks the number or literal at pos, returning its end
+size_t validate_scalar(std::string_view text, size_t pos) {
+  size_t at = pos;
+  auto digits = [&] {
+    size_t first = at;
+    while (byte_at(text, at) >= '0' && byte_at(text, at) <= '9') {
+      at++;
+    }
+    return at > first;
+  };
+  char c = byte_at(text, at);
+  if (c == '-' || (c >= '0' && c <= '9')) {
+    at += c == '-';
+    if (byte_at(text, at) == '0') {
+      at++;
+    } else if (!digits()) {
+      record_error("bad number", pos);
+    }
+    if (byte_at(text, at) == '.') {
+      at++;
+      if (!digits()) {
+        record_error("bad number", pos);
+      }
+    }
+    if (byte_at(text, at) == 'e' || byte_at(text, at) == 'E') {
+      at++;
+      if (byte_at(text, at) == '+' || byte_at(text, at) == '-') {
+        at++;
+      }
+      if (!digits()) {
+        record_error("bad number", pos);
+      }
+    }
+  } else if (text.compare(pos, 4, "true") == 0 ||
+             text.compare(pos, 4, "null") == 0) {
+    at += 4;
+  } else if (text.compare(pos, 5, "false") == 0) {
+    at += 5;
+  } else {
+    record_error("unexpected character", pos);
+  }
+  c = byte_at(text, at);
+  if (c && !std::strchr(" \t\r\n,]}", c)) {
+    record_error("unexpected character", at);
+  }
+  return at;
+}
+
+// skip_value with validate: walks the value token by token, keeping a bit
+// per open container to say whether it's an object, and checks every token
+// against the grammar. nothing is allocated.
+size_t validate_value(std::string_view text, size_t pos) {
+  uint64_t objects[(PARSER_NESTING_LIMIT + 63) / 64] = {};
+  size_t depth = 0;
+  size_t at = pos;
+  // a member name and its ':', leaving at on the value
+  auto member_name = [&] {
+    if (byte_at(text, at) != '"') {
+      record_error("expected a member name", at);
+    }
+    at = skip_space(text, validate_string(text, at));
+    if (byte_at(text, at) != ':') {
+      record_error("expected ':'", at);
+    }
+    at = skip_space(text, at + 1);
+  };
+  while (true) {
+    char c = byte_at(text, at);
+    if (c == '{' || c == '[') {
+      if (depth == PARSER_NESTING_LIMIT) {
+        record_error("max nesting limit exceeded", at);
+      }
+      uint64_t bit = uint64_t(1) << (depth % 64);
+      objects[depth / 64] =
+          c == '{' ? objects[depth / 64] | bit : objects[depth / 64] & ~bit;
+      depth++;
+      at = skip_space(text, at + 1);
+      if (byte_at(text, at) != (c == '{' ? '}' : ']')) {
+        if (c == '{') {
+          member_name();
+        }
+        continue;
+      }
+      at++;
+      depth--;
+    } else if (c == '"') {
+      at = validate_string(text, at);
+    } else {
+      at = validate_scalar(text, at);
+    }
+    // after a value, close whatever containers it ends
+    while (depth > 0) {
+      bool object = objects[(depth - 1) / 64] >> ((depth - 1) % 64) & 1;
+      at = skip_space(text, at);
+      c = byte_at(text, at);
+      if (c == ',') {
+        at = skip_space(text, at + 1);
+        if (object) {
+          member_name();
+        }
+        break;
+      }
+      if (c != (object ? '}' : ']')) {
+        record_error(object ? "expected ',' or '}'" : "expected ',' or ']'",
+                     at);
+      }
+      at++;
+      depth--;
+    }
+    if (depth == 0) {
+      return at;
+    }
+  }
+}
+
+size_t skip_value(std::string_view text, size_t pos, bool validate) {
+  if (validate) {
+    return validate_value(text, pos);
+  }
+  char c = byte_at(text, pos);
+  if (c == '"') {
+    return skip_string(text, pos);
+  }
+  if (c == '{' || c == '[') {
+    return skip_container(text, pos);
+  }
+  size_t end = pos;
+  while (end < text.size() && text[end] != ',' && text[end] != '}' &&
+         text[end] != ']' && text[end] != ' ' && text[end] != '\t' &&
+         text[end] != '\r' && text[end] != '\n') {
+    end++;
+  }
+  if (end == pos) {
+    record_error("unexpected character", pos);
+  }
+  return end;
+}
+
+Projection::Projection(const std::vector<std::string> &pointers)
+    : column_count(pointers.size()) {
+  nodes.push_back({std::string(), -1, {}, {}});
+  for (size_t column = 0; column < pointers.size(); column++) {
+    size_t node = 0;
+    for (std::string &token : parse_pointer(pointers[column])) {
+      size_t found = 0;
+      for (size_t child : nodes[node].children) {
+        if (nodes[child].token == token) {
+          found = child;
+          break;
+        }
+      }
+      if (!found) {
+        found = nodes.size();
+        long index = pointer_index(token);
+        nodes.push_back({std::move(token), index, {}, {}});
+        nodes[node].children.push_back(found);
+      }
+      node = found;
+    }
+    nodes[node].columns.push_back(column);
+  }
+}
+
+class ProjectionScan {
+  using Node = Projection::Node;
+
+  const std::vector<Node> &nodes;
+  std::string_view text;
+  std::vector<Field> &fields;
+  size_t remaining;
+  std::string key;
+
+  size_t skip_whitespace(size_t pos) const {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' ||
+                                 text[pos] == '\r' || text[pos] == '\n')) {
+      pos++;
+    }
+    if (pos == text.size()) {
+      record_error("unexpected end of record", pos);
+    }
+    return pos;
+  }
+
+  JSONType type_at(size_t pos) const {
+    switch (text[pos]) {
+    case '"':
+      return j_string;
+    case '{':
+      return j_object;
+    case '[':
+      return j_array;
+    case 't':
+    case 'f':
+      return j_bool;
+    case 'n':
+      return j_null;
+    default:
+      if (text[pos] == '-' || (text[pos] >= '0' && text[pos] <= '9')) {
+        return j_number;
+      }
+      record_error("unexpected character", pos);
+    }
+  }
+
+  const Node *member(const Node &node, std::string_view name) const {
+    for (size_t child : node.children) {
+      if (nodes[child].token == name) {
+        return &nodes[child];
+      }
+    }
+    return NULL;
+  }
+
+  const Node *element(const Node &node, long index) const {
+    for (size_t child : node.children) {
+      if (nodes[child].index == index) {
+        return &nodes[child];
+      }
+    }
+    return NULL;
+  }
+
+  // the value at pos, which node (if any) wants something from. returns
+  // where the value ends, or npos once every field has been found.
+  size_t value(size_t pos, const Node *node, int depth) {
+    if (!node) {
+      type_at(pos);
+      return skip_value(text, pos);
+    }
+    JSONType type = type_at(pos);
+    size_t end = std::string_view::npos;
+    if (!node->columns.empty()) {
+      end = skip_value(text, pos);
+      for (size_t column : node->columns) {
+        if (!fields[column].found) {
+          fields[column] = {type, text.substr(pos, end - pos), true};
+          remaining--;
+        }
+      }
+      if (remaining == 0) {
+        return std::string_view::npos;
+      }
+    }
+    if (node->children.empty() || (type != j_object && type != j_array)) {
+      return end != std::string_view::npos ? end : skip_value(text, pos);
+    }
+    if (depth >= PARSER_NESTING_LIMIT) {
+      record_error("max nesting limit exceeded", pos);
+    }
+    char close = type == j_object ? '}' : ']';
+    pos = skip_whitespace(pos + 1);
+    if (text[pos] == close) {
+      return pos + 1;
+    }
+    for (long index = 0;; index++) {
+      const Node *child;
+      if (type == j_object) {
+        if (text[pos] != '"') {
+          record_error("expected a member name", pos);
+        }
+        size_t name_end = skip_value(text, pos);
+        std::string_view name = text.substr(pos, name_end - pos);
+        if (name.find('\\') != std::string_view::npos) {
+          key.clear();
+          append_unescaped(key, name);
+          child = member(*node, key);
+        } else {
+          child = member(*node, name.substr(1, name.size() - 2));
+        }
+        pos = skip_whitespace(name_end);
+        if (text[pos] != ':') {
+          record_error("expected ':'", pos);
+        }
+        pos = skip_whitespace(pos + 1);
+      } else {
+        child = element(*node, index);
+      }
+      pos = value(pos, child, depth + 1);
+      if (pos == std::string_view::npos) {
+        return pos;
+      }
+      pos = skip_whitespace(pos);
+      if (text[pos] == close) {
+        return pos + 1;
+      }
+      if (text[pos] != ',') {
+        record_error("expected ',' or the end of the container", pos);
+      }
+      pos = skip_whitespace(pos + 1);
+    }
+  }
+
+public:
+  ProjectionScan(const Projection &projection, std::string_view record,
+                 std::vector<Field> &out)
+      : nodes(projection.nodes), text(record), fields(out),
+        remaining(projection.column_count) {}
+
+  void run() {
+    if (remaining) {
+      value(skip_whitespace(0), &nodes[0], 0);
+    }
+  }
+};
+
+void Projection::extract(std::string_view record,
+                         std::vector<Field> &fields) const {
+  fields.assign(column_count, Field());
+  ProjectionScan(*this, record, fields).run();
+}
+
+void Projection::extract(std::string_view record, std::vector<Field> &fields,
+                         std::string_view input) const {
+  try {
+    extract(record, fields);
+  } catch (ParseError &e) {
+    input_record_error(input, record, e.what());
+  }
+}
+
+[[noreturn]] void input_record_error(std::string_view input,
+                                     std::string_view record,
+                                     const char *what) {
+  char msg[200];
+  std::snprintf(msg, 200, "record at byte %zu: %s",
+                size_t(record.data() - input.data()), what);
+  throw ParseError((const char *)msg);
+}
+
+std::vector<std::string_view> split_chunks(std::string_view data,
+                                           size_t chunk_bytes) {
+  std::vector<std::string_view> chunks;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    size_t end = data.size() - pos > chunk_bytes
+                     ? data.find('\n', pos + chunk_bytes)
+                     : std::string_view::npos;
+    end = end == std::string_view::npos ? data.size() : end + 1;
+    chunks.push_back(data.substr(pos, end - pos));
+    pos = end;
+  }
+  return chunks;
+}
+
+void for_each_chunk(
+    std::string_view data, size_t chunk_bytes, unsigned threads,
+    const std::function<void(unsigned worker, std::string_view chunk)> &work) {
+  std::vector<std::string_view> chunks = split_chunks(data, chunk_bytes);
+  if (threads <= 1 || chunks.size() <= 1) {
+    for (std::string_view chunk : chunks) {
+      work(0, chunk);
+    }
+    return;
+  }
+  std::atomic<size_t> next = 0;
+  std::exception_ptr failure;
+  std::mutex lock;
+  auto worker = [&](unsigned index) {
+    size_t chunk;
+    while ((chunk = next++) < chunks.size()) {
+      try {
+        work(index, chunks[chunk]);
+      } catch (...) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!failure) {
+          failure = std::current_exception();
+        }
+        next = chunks.size();
+      }
+    }
+  };
+  run_on_threads(threads, worker);
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
+
+// the next non-blank line of data from pos on, without its line ending,
+// leaving pos past it. empty at the end of data.
+std::string_view next_record(std::string_view data, size_t &pos) {
+  while (pos < data.size()) {
+    size_t end = data.find('\n', pos);
+    if (end == std::string_view::npos) {
+      end = data.size();
+    }
+    std::string_view line = data.substr(pos, end - pos);
+    pos = end + 1;
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (line.find_first_not_of(" \t") != std::string_view::npos) {
+      return line;
+    }
+  }
+  return std::string_view();
+}
+
+ScanStats
+scan_jsonl(std::string_view data, const ScanControl &control,
+           const std::function<bool(std::string_view record)> &match) {
+  auto start = std::chrono::steady_clock::now();
+  auto out_of_time = [&] {
+    return control.max_seconds > 0 &&
+           std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+                   .count() >= control.max_seconds;
+  };
+  size_t every = std::max<size_t>(control.every, 1);
+  // rather than tossing a coin for every record, the number of records
+  // until the next one sampled is drawn directly
+  std::mt19937_64 random(control.seed);
+  std::geometric_distribution<size_t> misses(
+      std::min(std::max(control.fraction, 1e-12), 1.0));
+  auto gap = [&] { return control.fraction < 1 ? every * misses(random) : 0; };
+  size_t skip = control.fraction > 0 ? gap() : SIZE_MAX;
+
+  ScanStats stats;
+  size_t pos = 0;
+  while (true) {
+    std::string_view record = next_record(data, pos);
+    if (record.empty()) {
+      break;
+    }
+    size_t at = size_t(record.data() - data.data());
+    // the clock is read before each record sampled, but only now and then
+    // while stepping over records, which is much quicker
+    bool check_clock = skip == 0 || stats.records % 4096 == 0;
+    if (stats.matches >= control.max_matches || at >= control.max_bytes ||
+        (check_clock && out_of_time())) {
+      stats.stopped = true;
+      pos = at;
+      break;
+    }
+    stats.records++;
+    if (skip) {
+      skip--;
+      continue;
+    }
+    stats.sampled++;
+    stats.matches += match(record);
+    skip = every - 1 + gap();
+  }
+  stats.bytes = std::min(pos, data.size());
+  return stats;
+}
+
+void process_chunks(
+    std::string_view data, size_t chunk_bytes, unsigned threads,
+    const std::function<void(std::string_view chunk, std::string &out)> &work,
+    const std::function<void(std::string &out)> &emit) {
+  std::vector<std::string_view> chunks = split_chunks(data, chunk_bytes);
+  if (threads <= 1 || chunks.size() <= 1) {
+    std::string out;
+    for (std::string_view chunk : chunks) {
+      out.clear();
+      work(chunk, out);
+      emit(out);
+    }
+    return;
+  }
+
+  // chunk i is written into slot i % window, so workers can only get a
+  // window's worth ahead of emit
+  size_t window = size_t(threads) * 2;
+  std::vector<std::string> slots(window);
+  std::vector<bool> ready(window);
+  size_t claimed = 0;
+  size_t emitted = 0;
+  std::exception_ptr failure;
+  std::mutex lock;
+  std::condition_variable changed;
+
+  auto worker = [&] {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+      changed.wait(guard, [&] {
+        return failure || claimed == chunks.size() ||
+               claimed < emitted + window;
+      });
+      if (failure || claimed == chunks.size()) {
+        return;
+      }
+      size_t index = claimed++;
+      guard.unlock();
+      std::string &out = slots[index % window];
+      out.clear();
+      try {
+        work(chunks[index], out);
+      } catch (...) {
+        guard.lock();
+        failure = std::current_exception();
+        changed.notify_all();
+        return;
+      }
+      guard.lock();
+      ready[index % window] = true;
+      changed.notify_all();
+    }
+  };
+  // the calling thread emits, in order, while the others work
+  auto emitter = [&] {
+    std::unique_lock<std::mutex> guard(lock);
+    while (emitted < chunks.size()) {
+      changed.wait(guard, [&] { return failure || ready[emitted % window]; });
+      if (failure) {
+        return;
+      }
+      guard.unlock();
+      try {
+        emit(slots[emitted % window]);
+      } catch (...) {
+        guard.lock();
+        failure = std::current_exception();
+        changed.notify_all();
+        return;
+      }
+      guard.lock();
+      ready[emitted % window] = false;
+      emitted++;
+      changed.notify_all();
+    }
+  };
+  run_on_threads(threads + 1, [&](unsigned index) {
+    if (index == 0) {
+      emitter();
+    } else {
+      worker();
+    }
+  });
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
+
+} // namespace parsejson
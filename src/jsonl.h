@@ -0,0 +1,206 @@
+/*
+ * Building blocks for working through JSONL (one JSON document per line) at
+ * disk speed, without parsing each record into a tree.
+ *
+ * A Projection is compiled from a list of JSON Pointers and pulls just those
+ * fields out of a record's text. It scans the record once, skips over every
+ * value that no pointer reaches into, and stops as soon as it has seen every
+ * field it was asked for. Fields are returned as spans of the record:
+ *
+ *   Projection columns({"/user/id", "/amount"});
+ *   std::vector<Field> fields;
+ *   for_each_line(data, [&](std::string_view record) {
+ *     columns.extract(record, fields);
+ *     if (fields[1].type == j_number) { ... fields[1].text ... }
+ *   });
+ *
+ * Only the parts of a record that are scanned are checked, so a malformed
+ * record may go unnoticed if the damage is past the last field wanted.
+ *
+ * process_chunks() splits input on line boundaries into chunks which are
+ * handled on several threads, and hands each chunk's output on in input
+ * order. for_each_chunk() does the same where order doesn't matter, telling
+ * the work which worker it's running on so that each can keep its own state.
+ * MappedFile maps a whole file to work on.
+ *
+ * scan_jsonl() goes through records one at a time under a ScanControl, for
+ * exploratory queries that don't need every record: it can look at every
+ * Nth record or a random fraction of them, and stop after enough matches,
+ * bytes or time. Records that aren't sampled are stepped over by looking
+ * for the next newline and nothing more.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "parsejson.h"
+
+namespace parsejson {
+
+// a read-only mapping of a whole file, read front to back unless sequential
+// is false. the byte after the file reads as '\0', so a ParseBuffer can
+// borrow() the bytes. throws std::system_error if it can't be opened or
+// mapped.
+class MappedFile {
+  void *base = NULL;
+  size_t size = 0;
+
+public:
+  explicit MappedFile(const std::string &path, bool sequential = true);
+  ~MappedFile();
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  std::string_view bytes() const {
+    return std::string_view(static_cast<const char *>(base), size);
+  }
+};
+
+// calls fn with each non-blank line of data, without its line ending
+template <typename Fn> void for_each_line(std::string_view data, Fn &&fn) {
+  size_t pos = 0;
+  while (pos < data.size()) {
+    size_t end = data.find('\n', pos);
+    if (end == std::string_view::npos) {
+      end = data.size();
+    }
+    std::string_view line = data.substr(pos, end - pos);
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (line.find_first_not_of(" \t") != std::string_view::npos) {
+      fn(line);
+    }
+    pos = end + 1;
+  }
+}
+
+// a field pulled out of a record. text is the value's JSON text, quotes
+// included for a string; a field that isn't there is left empty with
+// found false.
+struct Field {
+  JSONType type = j_null;
+  std::string_view text;
+  bool found = false;
+};
+
+// appends the contents of a JSON string (quotes included) to out, decoding
+// any escapes. throws ParseError on a bad escape.
+void append_unescaped(std::string &out, std::string_view quoted);
+
+class Projection {
+  struct Node {
+    std::string token;
+    long index; // token as an array index, or -1
+    std::vector<size_t> children;
+    std::vector<size_t> columns; // columns this node's value fills
+  };
+
+  std::vector<Node> nodes; // nodes[0] is the document
+  size_t column_count;
+
+  friend class ProjectionScan;
+
+public:
+  // throws ParseError for a malformed pointer
+  explicit Projection(const std::vector<std::string> &pointers);
+
+  size_t columns() const { return column_count; }
+
+  // fields[i] is set to the value pointers[i] selects in record. throws
+  // ParseError if the scanned part of record isn't valid JSON.
+  void extract(std::string_view record, std::vector<Field> &fields) const;
+  // the same for a record lying within input, with the ParseError saying at
+  // which byte of input the record starts
+  void extract(std::string_view record, std::vector<Field> &fields,
+               std::string_view input) const;
+};
+
+// throws ParseError for what is wrong with record, which lies within input,
+// saying at which byte of input it starts
+[[noreturn]] void input_record_error(std::string_view input,
+                                     std::string_view record,
+                                     const char *what);
+
+// how far past the last byte of the value starting at pos in text (which
+// starts with its first character, not whitespace) the value runs. strings
+// and containers are jumped over 64 bytes at a time with the masks of
+// structural.h, finding the closing quote or counting brackets outside
+// strings, and nothing else inside them is looked at. with validate, the
+// value is instead checked against the JSON grammar token by token. nothing
+// is allocated either way. throws ParseError if the value is cut off, or
+// with validate, malformed.
+size_t skip_value(std::string_view text, size_t pos, bool validate = false);
+
+// data split into pieces of about chunk_bytes that end at line ends
+std::vector<std::string_view> split_chunks(std::string_view data,
+                                           size_t chunk_bytes);
+
+// calls work(worker, chunk) for each chunk of data, on up to threads
+// threads. worker is below threads and no two calls with the same worker run
+// at once. the first exception thrown stops everything and is rethrown.
+void for_each_chunk(
+    std::string_view data, size_t chunk_bytes, unsigned threads,
+    const std::function<void(unsigned worker, std::string_view chunk)> &work);
+
+// which records a scan looks at and when it gives up. the defaults look at
+// every record of the input.
+struct ScanControl {
+  // only every Nth record: the first, the N+1th and so on
+  size_t every = 1;
+  // and each of those with this probability
+  double fraction = 1;
+  uint64_t seed = 1;
+  // stop once this many records have matched
+  size_t max_matches = SIZE_MAX;
+  // stop at the first record starting this many bytes into the input
+  size_t max_bytes = SIZE_MAX;
+  // stop once this long has passed. 0 is no limit.
+  double max_seconds = 0;
+
+  // whether anything other than the defaults was asked for
+  bool limited() const {
+    return every > 1 || fraction < 1 || max_matches != SIZE_MAX ||
+           max_bytes != SIZE_MAX || max_seconds > 0;
+  }
+};
+
+struct ScanStats {
+  // records sampled or stepped over
+  size_t records = 0;
+  size_t sampled = 0;
+  size_t matches = 0;
+  // input gone through
+  size_t bytes = 0;
+  // whether a limit ended the scan before the end of the input
+  bool stopped = false;
+};
+
+// calls match with each record of data that control samples, until the
+// input or a limit runs out. match returns whether the record matched, which
+// counts towards max_matches.
+ScanStats
+scan_jsonl(std::string_view data, const ScanControl &control,
+           const std::function<bool(std::string_view record)> &match);
+
+// splits data into chunks of about chunk_bytes that end at line ends. work
+// is called for each chunk, on up to threads threads at once, with a string
+// to put its output in. emit is called on the calling thread with each
+// chunk's output in input order. an exception from work or emit stops
+// everything and is rethrown. at most a couple of chunks per thread are
+// held at once, whatever the size of data.
+void process_chunks(
+    std::string_view data, size_t chunk_bytes, unsigned threads,
+    const std::function<void(std::string_view chunk, std::string &out)> &work,
+    const std::function<void(std::string &out)> &emit);
+
+} // namespace parsejson
@@ -0,0 +1,91 @@
+/*
+ * Group-by aggregation over a JSONL file, one JSON object per group on
+ * stdout and statistics on stderr:
+ *
+ *   jsonl_aggregate [--threads N] [--group /pointer]... [--every N]
+ *       [--sample fraction] [--limit records] [--max-bytes N]
+ *       [--max-seconds S] file aggregate...
+ *
+ * where each aggregate is count, or count, sum, min, max or avg of a pointer,
+ * e.g. jsonl_aggregate --group /country orders.jsonl count "sum(/amount)"
+ *
+ * --every and --sample aggregate only some records, and --limit, --max-bytes
+ * and --max-seconds stop early, for a quick estimate of a big file.
+ */
+
+#include "aggregate.cpp"
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "writer.cpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace parsejson;
+
+int main(int argc, char **argv) {
+  AggregateOptions options;
+  std::vector<std::string> group_by;
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+      options.threads = unsigned(strtoul(argv[++arg], NULL, 10));
+    } else if (strcmp(argv[arg], "--group") == 0 && arg + 1 < argc) {
+      group_by.push_back(argv[++arg]);
+    } else if (strcmp(argv[arg], "--every") == 0 && arg + 1 < argc) {
+      options.scan.every = size_t(strtoull(argv[++arg], NULL, 10));
+    } else if (strcmp(argv[arg], "--sample") == 0 && arg + 1 < argc) {
+      options.scan.fraction = strtod(argv[++arg], NULL);
+      options.scan.seed = uint64_t(getpid());
+    } else if (strcmp(argv[arg], "--limit") == 0 && arg + 1 < argc) {
+      options.scan.max_matches = size_t(strtoull(argv[++arg], NULL, 10));
+    } else if (strcmp(argv[arg], "--max-bytes") == 0 && arg + 1 < argc) {
+      options.scan.max_bytes = size_t(strtoull(argv[++arg], NULL, 10));
+    } else if (strcmp(argv[arg], "--max-seconds") == 0 && arg + 1 < argc) {
+      options.scan.max_seconds = strtod(argv[++arg], NULL);
+    } else {
+      break;
+    }
+  }
+  if (argc - arg < 2) {
+    fprintf(stderr,
+            "usage: %s [--threads N] [--group /pointer]... [--every N] "
+            "[--sample fraction]\n"
+            "       [--limit records] [--max-bytes N] [--max-seconds S] "
+            "file aggregate...\n",
+            argv[0]);
+    return 2;
+  }
+  try {
+    std::vector<Aggregate> aggregates;
+    for (int i = arg + 1; i < argc; i++) {
+      aggregates.push_back(parse_aggregate(argv[i]));
+    }
+    MappedFile input(argv[arg]);
+    AggregateResult result =
+        aggregate_jsonl(input.bytes(), group_by, aggregates, options);
+    std::string rows = format_aggregate(result);
+    fwrite(rows.data(), 1, rows.size(), stdout);
+    fflush(stdout);
+    const AggregateStats &stats = result.stats;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr,
+            "%zu records, %zu groups in %.3fs (%.1f MB/s), hash tables "
+            "%.1f MB, peak resident %.1f MB%s\n",
+            stats.records, stats.groups, stats.seconds,
+            stats.seconds > 0 ? stats.bytes / stats.seconds / 1e6 : 0.0,
+            stats.table_bytes / 1e6, usage.ru_maxrss / 1e3,
+            stats.stopped ? ", stopped early" : "");
+  } catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Builds a key index over a JSONL file, or looks records up in one:
+ *
+ *   jsonl_index build [--sorted] [--threads N] file /pointer index
+ *   jsonl_index find index file key...
+ *
+ * where each key is JSON text, e.g. jsonl_index find users.idx users.jsonl
+ * '"u-1234"' 42. Records found are written to stdout, one per line.
+ */
+
+#include "flat.cpp"
+#include "index.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "sort.cpp"
+#include "writer.cpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+
+using namespace parsejson;
+
+int usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s build [--sorted] [--threads N] file /pointer index\n"
+          "       %s find index file key...\n",
+          name, name);
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    return usage(argv[0]);
+  }
+  try {
+    if (strcmp(argv[1], "build") == 0) {
+      IndexOptions options;
+      int arg = 2;
+      for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--sorted") == 0) {
+          options.kind = index_sorted;
+        } else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+          options.threads = unsigned(strtoul(argv[++arg], NULL, 10));
+        } else {
+          break;
+        }
+      }
+      if (argc - arg != 3) {
+        return usage(argv[0]);
+      }
+      IndexStats stats =
+          build_index(argv[arg], argv[arg + 1], argv[arg + 2], options);
+      fprintf(stderr, "%zu of %zu records indexed in %.3fs, %zu bytes\n",
+              stats.indexed, stats.records, stats.seconds,
+              stats.index_bytes);
+    } else if (strcmp(argv[1], "find") == 0 && argc >= 5) {
+      JSONLIndex index(argv[2], argv[3]);
+      for (int arg = 4; arg < argc; arg++) {
+        for (const IndexHit &hit : index.find(argv[arg])) {
+          std::string record = index.read(hit);
+          record += '\n';
+          fwrite(record.data(), 1, record.size(), stdout);
+        }
+      }
+    } else {
+      return usage(argv[0]);
+    }
+  } catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
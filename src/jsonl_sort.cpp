@@ -0,0 +1,60 @@
+/*
+ * Sorts a JSONL file by a field, writing the records to stdout:
+ *
+ *   jsonl_sort [--reverse] [--memory MB] [--threads N] [--temp dir] file
+ *       /pointer
+ */
+
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "sort.cpp"
+#include "writer.cpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <unistd.h>
+
+using namespace parsejson;
+
+int main(int argc, char **argv) {
+  SortOptions options;
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--reverse") == 0) {
+      options.descending = true;
+    } else if (strcmp(argv[arg], "--memory") == 0 && arg + 1 < argc) {
+      options.memory_bytes = size_t(strtoul(argv[++arg], NULL, 10)) << 20;
+    } else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+      options.threads = unsigned(strtoul(argv[++arg], NULL, 10));
+    } else if (strcmp(argv[arg], "--temp") == 0 && arg + 1 < argc) {
+      options.temp_directory = argv[++arg];
+    } else {
+      break;
+    }
+  }
+  if (argc - arg != 2) {
+    fprintf(stderr,
+            "usage: %s [--reverse] [--memory MB] [--threads N] [--temp dir] "
+            "file /pointer\n",
+            argv[0]);
+    return 2;
+  }
+  try {
+    MappedFile input(argv[arg]);
+    SortStats stats =
+        sort_jsonl(input.bytes(), argv[arg + 1], STDOUT_FILENO, options);
+    fprintf(stderr,
+            "%zu records in %.3fs, %zu runs, %zu merge passes, %.1f MB "
+            "spilled\n",
+            stats.records, stats.seconds, stats.runs, stats.merge_passes,
+            stats.spilled_bytes / 1e6);
+  } catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
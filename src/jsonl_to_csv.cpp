@@ -0,0 +1,73 @@
+/*
+ * Converts a JSONL file to CSV (or TSV) on stdout:
+ *
+ *   jsonl_to_csv [--tsv] [--no-header] [--threads N] [--every N]
+ *       [--sample fraction] [--limit rows] [--max-bytes N]
+ *       [--max-seconds S] file /pointer...
+ *
+ * --every and --sample export only some records, and --limit, --max-bytes
+ * and --max-seconds stop early.
+ */
+
+#include "csv.cpp"
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "writer.cpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <unistd.h>
+
+using namespace parsejson;
+
+int main(int argc, char **argv) {
+  CsvOptions options;
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--tsv") == 0) {
+      options.delimiter = '\t';
+    } else if (strcmp(argv[arg], "--no-header") == 0) {
+      options.header = false;
+    } else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+      options.threads = unsigned(strtoul(argv[++arg], NULL, 10));
+    } else if (strcmp(argv[arg], "--every") == 0 && arg + 1 < argc) {
+      options.scan.every = size_t(strtoull(argv[++arg], NULL, 10));
+    } else if (strcmp(argv[arg], "--sample") == 0 && arg + 1 < argc) {
+      options.scan.fraction = strtod(argv[++arg], NULL);
+      options.scan.seed = uint64_t(getpid());
+    } else if (strcmp(argv[arg], "--limit") == 0 && arg + 1 < argc) {
+      options.scan.max_matches = size_t(strtoull(argv[++arg], NULL, 10));
+    } else if (strcmp(argv[arg], "--max-bytes") == 0 && arg + 1 < argc) {
+      options.scan.max_bytes = size_t(strtoull(argv[++arg], NULL, 10));
+    } else if (strcmp(argv[arg], "--max-seconds") == 0 && arg + 1 < argc) {
+      options.scan.max_seconds = strtod(argv[++arg], NULL);
+    } else {
+      break;
+    }
+  }
+  if (argc - arg < 2) {
+    fprintf(stderr,
+            "usage: %s [--tsv] [--no-header] [--threads N] [--every N] "
+            "[--sample fraction]\n"
+            "       [--limit rows] [--max-bytes N] [--max-seconds S] file "
+            "/pointer...\n",
+            argv[0]);
+    return 2;
+  }
+  try {
+    MappedFile input(argv[arg]);
+    std::vector<std::string> columns(argv + arg + 1, argv + argc);
+    ExportStats stats = export_csv(input.bytes(), columns, STDOUT_FILENO,
+                                   options);
+    fprintf(stderr, "%zu records, %zu bytes written%s\n", stats.records,
+            stats.bytes_out, stats.stopped ? ", stopped early" : "");
+  } catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
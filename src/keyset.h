@@ -0,0 +1,143 @@
+/*
+ * Compile-time key dispatch for consumers that expect a known set of object
+ * member names. Rather than comparing each JSONItem::name against a list of
+ * strings, a KeySet is built at compile time from the expected keys and maps a
+ * key to its index with one hash, one table load and one final compare.
+ *
+ *   constexpr KeySet fields("id", "name", "tags");
+ *   switch (fields.find(item)) {
+ *   case fields.find("id"): ...
+ *   case fields.find("name"): ...
+ *   default: // unknown member
+ *   }
+ *
+ * The hash normally only looks at the key length and its first and last
+ * bytes. If no seed separates the keys that way ("a1b" and "a2b" can't be) the
+ * builder falls back to hashing the whole key. Either way the table is
+ * collision free, so a lookup never probes.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+#include "parsejson.h"
+
+namespace parsejson {
+
+template <size_t N> class KeySet {
+  static_assert(N > 0, "a KeySet needs at least one key");
+  static_assert(N < 0x7fff, "too many keys for a KeySet");
+
+  static constexpr uint32_t ceil_log2(size_t n) {
+    uint32_t bits = 0;
+    while ((size_t(1) << bits) < n) {
+      bits++;
+    }
+    return bits;
+  }
+
+  // aim for a load factor of at most a half, and allow the table to grow
+  // up to eight times that while searching for a seed.
+  static constexpr uint32_t min_bits = ceil_log2(N) + 1;
+  static constexpr uint32_t max_bits = min_bits + 3;
+  static constexpr uint32_t max_seed = 1 << 12;
+
+  std::string_view keys_[N]{};
+  int16_t slots_[size_t(1) << max_bits]{};
+  uint32_t seed_ = 0;
+  uint32_t shift_ = 0;
+  bool full_hash_ = false;
+
+  static constexpr uint32_t mix(uint32_t h, uint32_t v) {
+    return (h ^ v) * 0x01000193u;
+  }
+
+  static constexpr uint32_t hash(std::string_view key, uint32_t seed,
+                                 bool full) {
+    uint32_t h = mix(seed, uint32_t(key.size()));
+    if (key.empty()) {
+      return h;
+    }
+    if (!full) {
+      return mix(mix(h, uint8_t(key.front())), uint8_t(key.back()));
+    }
+    for (char c : key) {
+      h = mix(h, uint8_t(c));
+    }
+    return h;
+  }
+
+  constexpr bool try_seed(uint32_t seed, uint32_t bits, bool full) {
+    for (size_t i = 0; i < (size_t(1) << bits); i++) {
+      slots_[i] = -1;
+    }
+    for (size_t i = 0; i < N; i++) {
+      // the multiply pushes entropy upwards, so index with the high bits
+      uint32_t slot = hash(keys_[i], seed, full) >> (32 - bits);
+      if (slots_[slot] != -1) {
+        return false;
+      }
+      slots_[slot] = int16_t(i);
+    }
+    seed_ = seed;
+    shift_ = 32 - bits;
+    full_hash_ = full;
+    return true;
+  }
+
+  constexpr void build() {
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = i + 1; j < N; j++) {
+        if (keys_[i] == keys_[j]) {
+          throw std::invalid_argument("duplicate key in KeySet");
+        }
+      }
+    }
+    for (bool full : {false, true}) {
+      for (uint32_t bits = min_bits; bits <= max_bits; bits++) {
+        for (uint32_t seed = 1; seed < max_seed; seed++) {
+          if (try_seed(seed, bits, full)) {
+            return;
+          }
+        }
+      }
+    }
+    throw std::invalid_argument("no collision free seed for KeySet");
+  }
+
+public:
+  template <typename... Keys>
+  constexpr KeySet(const Keys &...keys) : keys_{std::string_view(keys)...} {
+    static_assert(sizeof...(Keys) == N, "key count mismatch");
+    build();
+  }
+
+  static constexpr size_t size() { return N; }
+
+  constexpr std::string_view key(size_t index) const { return keys_[index]; }
+
+  // index of key in the list the set was built from, or -1 if it isn't one
+  // of them.
+  constexpr int find(std::string_view key) const {
+    int index = slots_[hash(key, seed_, full_hash_) >> shift_];
+    if (index < 0 || keys_[index] != key) {
+      return -1;
+    }
+    return index;
+  }
+
+  // for use on raw key bytes, e.g. straight out of the input buffer
+  constexpr int find(const char *data, size_t len) const {
+    return find(std::string_view(data, len));
+  }
+
+  int find(const JSONItem *item) const { return find(item->name.view()); }
+};
+
+template <typename... Keys> KeySet(const Keys &...) -> KeySet<sizeof...(Keys)>;
+
+} // namespace parsejson
@@ -18,7 +18,10 @@
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <new>
 #include <string>
+#include <utility>
 
 namespace parsejson {
 
@@ -49,8 +52,108 @@ double parse_number(ParseBuffer &input_buffer) {
   return double_val;
 }
 
-std::string parse_string(ParseBuffer &input_buffer) {
-  std::string out_str;
+// reads four hex digits at pos, or returns -1 if they aren't there
+long read_hex4(std::string_view text, size_t pos) {
+  if (text.size() < pos + 4) {
+    return -1;
+  }
+  long value = 0;
+  for (size_t i = pos; i < pos + 4; i++) {
+    char c = text[i];
+    int digit = std::isdigit(static_cast<unsigned char>(c)) ? c - '0'
+                : (c >= 'a' && c <= 'f')                    ? c - 'a' + 10
+                : (c >= 'A' && c <= 'F')                    ? c - 'A' + 10
+                                                            : -1;
+    if (digit < 0) {
+      return -1;
+    }
+    value = value * 16 + digit;
+  }
+  return value;
+}
+
+[[noreturn]] void escape_error(const char *what, size_t pos) {
+  char msg[100];
+  std::snprintf(msg, 100, "%s at pos: %zu", what, pos);
+  throw ParseError((const char *)msg);
+}
+
+// the \uXXXX escape at pos, and the low half of a surrogate pair after it
+DecodedEscape decode_unicode_escape(std::string_view text, size_t pos) {
+  DecodedEscape decoded;
+  long code = read_hex4(text, pos + 2);
+  decoded.length = 6;
+  if (code >= 0xd800 && code < 0xdc00 &&
+      text.compare(pos + 6, 2, "\\u") == 0) {
+    long low = read_hex4(text, pos + 8);
+    if (low >= 0xdc00 && low < 0xe000) {
+      code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+      decoded.length = 12;
+    }
+  }
+  if (code < 0 || (code >= 0xd800 && code < 0xe000)) {
+    escape_error("bad unicode escape", pos);
+  }
+  char *out = decoded.utf8;
+  if (code < 0x80) {
+    *out++ = char(code);
+  } else if (code < 0x800) {
+    *out++ = char(0xc0 | (code >> 6));
+    *out++ = char(0x80 | (code & 0x3f));
+  } else if (code < 0x10000) {
+    *out++ = char(0xe0 | (code >> 12));
+    *out++ = char(0x80 | ((code >> 6) & 0x3f));
+    *out++ = char(0x80 | (code & 0x3f));
+  } else {
+    *out++ = char(0xf0 | (code >> 18));
+    *out++ = char(0x80 | ((code >> 12) & 0x3f));
+    *out++ = char(0x80 | ((code >> 6) & 0x3f));
+    *out++ = char(0x80 | (code & 0x3f));
+  }
+  decoded.size = size_t(out - decoded.utf8);
+  return decoded;
+}
+
+DecodedEscape decode_escape(std::string_view text, size_t pos) {
+  if (text.size() - pos < 2) {
+    escape_error("prematurely terminated escape sequence", pos);
+  }
+  DecodedEscape decoded;
+  decoded.length = 2;
+  decoded.size = 1;
+  switch (text[pos + 1]) {
+  case 'b':
+    decoded.utf8[0] = '\b';
+    break;
+  case 'f':
+    decoded.utf8[0] = '\f';
+    break;
+  case 'n':
+    decoded.utf8[0] = '\n';
+    break;
+  case 'r':
+    decoded.utf8[0] = '\r';
+    break;
+  case 't':
+    decoded.utf8[0] = '\t';
+    break;
+  case '\"':
+  case '\\':
+  case '/':
+    decoded.utf8[0] = text[pos + 1];
+    break;
+  case 'u':
+    return decode_unicode_escape(text, pos);
+  default:
+    escape_error("unknown escape sequence", pos);
+  }
+  return decoded;
+}
+
+// appends to out_str, so DOM strings can be parsed straight into the item's
+// own (possibly pmr) string
+template <typename String>
+void parse_string_into(ParseBuffer &input_buffer, String &out_str) {
   while (input_buffer.raw_json[input_buffer.pos] != '\"' &&
          input_buffer.pos < input_buffer.raw_json.size()) {
     if (input_buffer.raw_json[input_buffer.pos] != '\\') {
@@ -58,49 +161,89 @@ std::string parse_string(ParseBuffer &input_buffer) {
       input_buffer.pos++;
       continue;
     }
-    if (input_buffer.raw_json.size() - input_buffer.pos < 2) {
-      char msg[100];
-      std::snprintf(msg, 100,
-                    "prematurely terminated escape sequence at pos: %zu",
-                    input_buffer.pos);
-      throw ParseError((const char *)msg);
-    }
-    switch (input_buffer.raw_json[input_buffer.pos + 1]) {
-    case 'b':
-      out_str.append(1, '\b');
-      break;
-    case 'f':
-      out_str.append(1, '\f');
-      break;
-    case 'n':
-      out_str.append(1, '\n');
-      break;
-    case 'r':
-      out_str.append(1, '\r');
-      break;
-    case 't':
-      out_str.append(1, '\t');
-      break;
-    case '\"':
-    case '\\':
-    case '/':
-      out_str.append(1, input_buffer.raw_json[input_buffer.pos + 1]);
-    default:
-      char msg[100];
-      std::snprintf(msg, 100, "unknown escape sequence at pos: %zu",
-                    input_buffer.pos);
-      throw ParseError((const char *)msg);
-    }
-    input_buffer.pos += 2;
+    DecodedEscape decoded =
+        decode_escape(input_buffer.raw_json, input_buffer.pos);
+    out_str.append(decoded.utf8, decoded.size);
+    input_buffer.pos += decoded.length;
+  }
+  if (input_buffer.pos >= input_buffer.raw_json.size()) {
+    const char *msg = "unterminated string";
+    throw ParseError(msg);
   }
   input_buffer.pos++; // consume closing '"'
+}
+
+std::string parse_string(ParseBuffer &input_buffer) {
+  std::string out_str;
+  parse_string_into(input_buffer, out_str);
   return out_str;
 }
 
+void JSONKey::assign(std::string_view key,
+                     std::pmr::memory_resource *resource) {
+  if (key.size() > UINT32_MAX) {
+    char msg[100];
+    std::snprintf(msg, 100, "member name too long: %zu bytes", key.size());
+    throw ParseError((const char *)msg);
+  }
+  // key may be this key's own bytes, so they're copied before they're freed
+  char short_copy[inline_capacity];
+  char *copy = short_copy;
+  if (key.size() > inline_capacity) {
+    copy = static_cast<char *>(resource->allocate(key.size(), 1));
+  }
+  std::memcpy(copy, key.data(), key.size());
+  uint32_t hash = hash_of(key);
+  clear(resource);
+  if (copy == short_copy) {
+    std::memcpy(local, short_copy, key.size());
+  } else {
+    remote = copy;
+  }
+  len = uint32_t(key.size());
+  key_hash = hash;
+}
+
+void JSONKey::clear(std::pmr::memory_resource *resource) {
+  if (len > inline_capacity) {
+    resource->deallocate(remote, len, 1);
+  }
+  len = 0;
+  key_hash = 0;
+}
+
+// strings past the small string buffer have their own allocation
+template <typename String>
+void count_string(ParseBuffer &input_buffer, const String &str) {
+  if (str.capacity() > 15) {
+    input_buffer.allocated += str.capacity() + 1;
+  }
+}
+
+JSONItem *create_item(JSONType type, std::pmr::memory_resource *resource) {
+  void *mem = resource->allocate(sizeof(JSONItem), alignof(JSONItem));
+  JSONItem *item = new (mem) JSONItem(resource);
+  item->type = type;
+  return item;
+}
+
+JSONItem *new_item(ParseBuffer &input_buffer) {
+  input_buffer.allocated += sizeof(JSONItem);
+  return create_item(JSONType::j_null, input_buffer.resource);
+}
+
+void free_item(JSONItem *item) {
+  std::pmr::memory_resource *resource = item->resource();
+  item->~JSONItem();
+  resource->deallocate(item, sizeof(JSONItem), alignof(JSONItem));
+}
+
 JSONItem *parse_json(ParseBuffer &input_buffer);
 
 // TODO: handle premature termination of the buffer
-JSONItem *parse_array(ParseBuffer &input_buffer) {
+// elements are linked into parent as they are parsed, so that if a later one
+// fails the caller's cleanup of parent frees everything built so far.
+void parse_array(ParseBuffer &input_buffer, JSONItem *parent) {
   input_buffer.depth++;
   if (input_buffer.depth > PARSER_NESTING_LIMIT) {
     char msg[100];
@@ -110,9 +253,12 @@ JSONItem *parse_array(ParseBuffer &input_buffer) {
     throw ParseError((const char *)msg);
   }
   skip_whitespace(input_buffer);
-  if (input_buffer.raw_json[input_buffer.pos] == ']') {
+  if (can_read(input_buffer, 1) &&
+      input_buffer.raw_json[input_buffer.pos] == ']') {
     // empty array. parent will be array but have no children.
-    return NULL;
+    input_buffer.pos++;
+    input_buffer.depth--;
+    return;
   }
   JSONItem *head = NULL;
   JSONItem *current = NULL;
@@ -120,11 +266,13 @@ JSONItem *parse_array(ParseBuffer &input_buffer) {
          input_buffer.pos < input_buffer.raw_json.size()) {
     skip_whitespace(input_buffer);
     if (!head) {
-      current = head = parse_json(input_buffer);
+      current = head = parent->child = parse_json(input_buffer);
     } else {
       JSONItem *new_item = parse_json(input_buffer);
       current->next = new_item;
+#if !PARSER_LEAN_NODES
       new_item->prev = current;
+#endif
       current = new_item;
     }
     skip_whitespace(input_buffer);
@@ -145,10 +293,9 @@ JSONItem *parse_array(ParseBuffer &input_buffer) {
   }
   input_buffer.pos++;
   input_buffer.depth--;
-  return head;
 }
 
-JSONItem *parse_object(ParseBuffer &input_buffer) {
+void parse_object(ParseBuffer &input_buffer, JSONItem *parent) {
   input_buffer.depth++;
   if (input_buffer.depth > PARSER_NESTING_LIMIT) {
     char msg[100];
@@ -158,12 +305,16 @@ JSONItem *parse_object(ParseBuffer &input_buffer) {
     throw ParseError((const char *)msg);
   }
   skip_whitespace(input_buffer);
-  if (input_buffer.raw_json[input_buffer.pos] == '}') {
+  if (can_read(input_buffer, 1) &&
+      input_buffer.raw_json[input_buffer.pos] == '}') {
     // empty object. parent will be object but have no children.
-    return NULL;
+    input_buffer.pos++;
+    input_buffer.depth--;
+    return;
   }
   JSONItem *head = NULL;
   JSONItem *current = NULL;
+  std::string name; // reused for each member's name
   while ((input_buffer.raw_json[input_buffer.pos] != '}') &&
          input_buffer.pos < input_buffer.raw_json.size()) {
     // consume name
@@ -176,7 +327,8 @@ JSONItem *parse_object(ParseBuffer &input_buffer) {
       throw ParseError((const char *)msg);
     }
     input_buffer.pos++; // consume opening '"'
-    std::string name = parse_string(input_buffer);
+    name.clear();
+    parse_string_into(input_buffer, name);
     skip_whitespace(input_buffer);
     if (!can_read(input_buffer, 1) ||
         input_buffer.raw_json[input_buffer.pos] != ':') {
@@ -189,14 +341,19 @@ JSONItem *parse_object(ParseBuffer &input_buffer) {
     skip_whitespace(input_buffer);
 
     if (!head) {
-      current = head = parse_json(input_buffer);
+      current = head = parent->child = parse_json(input_buffer);
     } else {
       JSONItem *new_item = parse_json(input_buffer);
       current->next = new_item;
+#if !PARSER_LEAN_NODES
       new_item->prev = current;
+#endif
       current = new_item;
     }
-    current->name.swap(name);
+    current->set_name(name);
+    if (name.size() > JSONKey::inline_capacity) {
+      input_buffer.allocated += name.size();
+    }
     skip_whitespace(input_buffer);
     if (input_buffer.raw_json[input_buffer.pos] == '}') {
       break;
@@ -216,33 +373,44 @@ JSONItem *parse_object(ParseBuffer &input_buffer) {
   }
   input_buffer.pos++;
   input_buffer.depth--;
-  return head;
 }
 
 void destroy_json(JSONItem *item) {
-  // recurse into children, but iterate to the end of the JSON to avoid stack
-  // overflow. depth is limited, length is not
-  JSONItem *next = NULL;
+  // no recursion and no stack. viewing child as a left link and next as a
+  // right link, an item with a child is rotated below it (the child takes its
+  // place and the item becomes the child's next), until the item in hand has
+  // no child and can be freed. each item is rotated at most once per child,
+  // so this is linear, and items are freed close to document order.
   while (item) {
-    next = item->next;
-    if (item->child) {
-      destroy_json(item->child);
+    JSONItem *child = item->child;
+    if (child) {
+      item->child = child->next;
+      child->next = item;
+      item = child;
+      continue;
     }
-    delete item;
+    JSONItem *next = item->next;
+    free_item(item);
     item = next;
   }
 }
 
 JSONItem *parse_json(ParseBuffer &input_buffer) {
-  JSONItem *item = new JSONItem();
+  JSONItem *item = new_item(input_buffer);
   skip_whitespace(input_buffer);
+  size_t span = 0;
+  if (input_buffer.spans) {
+    span = input_buffer.spans->size();
+    input_buffer.spans->push_back({item, input_buffer.pos, input_buffer.pos});
+  }
 
   try {
     if (can_read(input_buffer, 1) &&
         input_buffer.raw_json[input_buffer.pos] == '\"') {
       item->type = JSONType::j_string;
       input_buffer.pos++;
-      item->string_val = parse_string(input_buffer);
+      parse_string_into(input_buffer, item->string_val);
+      count_string(input_buffer, item->string_val);
     } else if (can_read(input_buffer, 1) &&
                ((input_buffer.raw_json[input_buffer.pos] == '-') ||
                 (input_buffer.raw_json[input_buffer.pos] == '+') ||
@@ -253,12 +421,12 @@ JSONItem *parse_json(ParseBuffer &input_buffer) {
                input_buffer.raw_json[input_buffer.pos] == '[') {
       item->type = JSONType::j_array;
       input_buffer.pos++;
-      item->child = parse_array(input_buffer);
+      parse_array(input_buffer, item);
     } else if (can_read(input_buffer, 1) &&
                input_buffer.raw_json[input_buffer.pos] == '{') {
       item->type = JSONType::j_object;
       input_buffer.pos++;
-      item->child = parse_object(input_buffer);
+      parse_object(input_buffer, item);
     } else if (can_read(input_buffer, 4) &&
                input_buffer.raw_json.compare(input_buffer.pos, 4, "null") ==
                    0) {
@@ -284,16 +452,42 @@ JSONItem *parse_json(ParseBuffer &input_buffer) {
     const char *msg = pe.what();
     throw ParseError(msg);
   }
+  if (input_buffer.spans) {
+    (*input_buffer.spans)[span].end = input_buffer.pos;
+  }
   // the potentially recursive process above should process all available
   // valid JSON. this may be followed by an arbitrary amount of whitespace,
   // at which point we should be at the end of the buffer.
   skip_whitespace(input_buffer);
   if ((input_buffer.depth == 0) &&
       (input_buffer.pos != input_buffer.raw_json.size())) {
+    destroy_json(item);
     const char *msg = "trailing junk";
     throw ParseError(msg);
   }
   return item;
 }
 
+Document parse_document(ParseBuffer &input_buffer) {
+  size_t before = input_buffer.allocated;
+  JSONItem *root = parse_json(input_buffer);
+  return Document(root, NULL, input_buffer.allocated - before);
+}
+
+Document parse_document(ParseBuffer &input_buffer,
+                        std::unique_ptr<std::pmr::memory_resource> arena) {
+  std::pmr::memory_resource *previous = input_buffer.resource;
+  size_t before = input_buffer.allocated;
+  input_buffer.resource = arena.get();
+  JSONItem *root;
+  try {
+    root = parse_json(input_buffer);
+  } catch (ParseError &) {
+    input_buffer.resource = previous;
+    throw;
+  }
+  input_buffer.resource = previous;
+  return Document(root, std::move(arena), input_buffer.allocated - before);
+}
+
 } // namespace parsejson
@@ -16,20 +16,122 @@
 #include <cmath>
 #include <cstddef>
 #include <exception>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #ifndef PARSER_NESTING_LIMIT
 #define PARSER_NESTING_LIMIT 1000
 #endif
 
+// define as 1 to drop JSONItem::prev. saves a pointer per item and a store
+// per array element/object member while parsing. traverse.h has
+// prev_sibling() and children_reversed() for the rare backwards walk, which
+// work either way.
+#ifndef PARSER_LEAN_NODES
+#define PARSER_LEAN_NODES 0
+#endif
+
 namespace parsejson {
 
-// I'll start simple by storing the whole json in a std::string. This will
-// probably want to be revisited.
+struct JSONItem;
+
+// where an item's value lies in the text it was parsed from, as
+// [begin, end), not counting whitespace around it or an object member's name
+struct SourceSpan {
+  JSONItem *item;
+  size_t begin;
+  size_t end;
+};
+
+// the text a ParseBuffer parses: a copy of its own, assigned like a
+// std::string, or borrowed in place with borrow(), for input too big to copy
+// (a MappedFile from jsonl.h, whose pages the kernel can then drop again
+// once they've been parsed). the scanners read the byte just past the end
+// and expect a '\0', as a std::string has, so borrowed text must be followed
+// by one too; MappedFile's is. borrowed text must outlive parsing, though
+// not the parsed tree.
+class JSONText {
+  std::string owned;
+  const char *start;
+  size_t length = 0;
+  bool borrowed = false;
+
+  void own() {
+    start = owned.c_str();
+    length = owned.size();
+    borrowed = false;
+  }
+
+public:
+  JSONText() { own(); }
+  JSONText(const JSONText &other) { *this = other; }
+  JSONText(JSONText &&other) noexcept { *this = std::move(other); }
+  JSONText &operator=(const JSONText &other) {
+    if (other.borrowed) {
+      borrow(other.view());
+    } else if (this != &other) {
+      *this = other.owned;
+    }
+    return *this;
+  }
+  JSONText &operator=(JSONText &&other) noexcept {
+    if (other.borrowed) {
+      borrow(other.view());
+    } else if (this != &other) {
+      owned = std::move(other.owned);
+      own();
+      other.own();
+    }
+    return *this;
+  }
+  JSONText &operator=(std::string json) {
+    owned = std::move(json);
+    own();
+    return *this;
+  }
+  void assign(const std::string &json, size_t pos, size_t count) {
+    owned.assign(json, pos, count);
+    own();
+  }
+  void borrow(std::string_view json) {
+    std::string().swap(owned);
+    own();
+    if (!json.empty()) {
+      start = json.data();
+      length = json.size();
+      borrowed = true;
+    }
+  }
+
+  size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+  const char *data() const { return start; }
+  const char &operator[](size_t pos) const { return start[pos]; }
+  std::string_view view() const { return std::string_view(start, length); }
+  operator std::string_view() const { return view(); }
+  int compare(size_t pos, size_t count, const char *text) const {
+    return view().compare(pos, count, text);
+  }
+};
+
 struct ParseBuffer {
-  std::string raw_json;
+  JSONText raw_json;
   uint32_t depth = 0;
   size_t pos = 0;
+  // where the JSONItems and their strings are allocated from. the resource
+  // must outlive the parsed tree.
+  std::pmr::memory_resource *resource = std::pmr::get_default_resource();
+  // running estimate of the bytes allocated for parsed items and strings
+  size_t allocated = 0;
+  // when set, parse_json appends the span of every item it parses, parents
+  // before their children and siblings in order, so begins only increase.
+  // if parsing fails what has been appended is of no use.
+  std::vector<SourceSpan> *spans = NULL;
 };
 
 enum JSONType {
@@ -41,31 +143,202 @@ enum JSONType {
   j_null,
 };
 
+// an object member name. every item carries one, a fixed 32 bytes whether
+// it is named or not (array elements aren't). names up to inline_capacity
+// bytes are kept in those bytes; only longer ones are allocated, from the
+// owning item's memory_resource, which the owner passes in since a key
+// doesn't remember it. the length and a hash are stored so
+// comparisons between keys usually end without touching the bytes. a name
+// of 4 GiB or more doesn't fit the length and is a ParseError.
+class JSONKey {
+public:
+  static constexpr size_t inline_capacity = 24;
+
+private:
+  uint32_t len = 0;
+  uint32_t key_hash = 0;
+  union {
+    char local[inline_capacity];
+    char *remote;
+  };
+
+public:
+  JSONKey() {}
+  JSONKey(const JSONKey &) = delete;
+  JSONKey &operator=(const JSONKey &) = delete;
+
+  static uint32_t hash_of(std::string_view key) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (char c : key) {
+      h = (h ^ uint8_t(c)) * 16777619u;
+    }
+    return h;
+  }
+
+  void assign(std::string_view key, std::pmr::memory_resource *resource);
+  void clear(std::pmr::memory_resource *resource);
+
+  bool empty() const { return len == 0; }
+  size_t size() const { return len; }
+  const char *data() const { return len > inline_capacity ? remote : local; }
+  uint32_t hash() const { return key_hash; }
+  std::string_view view() const { return std::string_view(data(), len); }
+  operator std::string_view() const { return view(); }
+
+  friend bool operator==(const JSONKey &a, const JSONKey &b) {
+    return a.len == b.len && a.key_hash == b.key_hash && a.view() == b.view();
+  }
+  friend bool operator==(const JSONKey &a, std::string_view b) {
+    return a.view() == b;
+  }
+  friend bool operator!=(const JSONKey &a, const JSONKey &b) {
+    return !(a == b);
+  }
+  friend bool operator!=(const JSONKey &a, std::string_view b) {
+    return !(a == b);
+  }
+};
+static_assert(sizeof(JSONKey) == 32, "the comment above says 32 bytes");
+
+// string_val carries the memory_resource the item was allocated from, which is
+// how destroy_json knows where to give the item (and a long name) back to.
 struct JSONItem {
   JSONItem *next = NULL;
+#if !PARSER_LEAN_NODES
   JSONItem *prev = NULL;
+#endif
   JSONItem *child = NULL;
-  std::string name;
+  JSONKey name;
   JSONType type;
   // potential values, only one of which will be used. should probably
   // be declared as a proper `union`
   double_t double_val;
   uint64_t uint_val;
   int64_t int_val;
-  std::string string_val;
+  std::pmr::string string_val;
   bool bool_val;
+
+  JSONItem(std::pmr::memory_resource *resource =
+               std::pmr::get_default_resource())
+      : string_val(resource) {}
+  ~JSONItem() { name.clear(resource()); }
+
+  std::pmr::memory_resource *resource() const {
+    return string_val.get_allocator().resource();
+  }
+  void set_name(std::string_view key) { name.assign(key, resource()); }
 };
 
 class ParseError : public std::exception {
 private:
-  const char *message;
+  // a copy, since messages are usually formatted into a local buffer
+  std::string message;
 
 public:
   ParseError(const char *msg) : message(msg) {}
-  const char *what() { return message; }
+  const char *what() const noexcept override { return message.c_str(); }
 };
 
 JSONItem *parse_json(ParseBuffer &input_buffer);
 void destroy_json(JSONItem *item);
+// for building trees by hand. destroy_json frees items allocated here or by
+// parse_json, so don't mix in items from plain `new`.
+JSONItem *create_item(JSONType type, std::pmr::memory_resource *resource =
+                                         std::pmr::get_default_resource());
+
+// owns a parsed tree and the storage behind it, so callers don't have to pair
+// parse_json with destroy_json themselves. move-only and a couple of pointers
+// wide, so it's cheap to hand between threads or through queues. everything is
+// released in one step when the Document is destroyed or reset.
+//
+// a Document may also own the memory_resource its tree was allocated from
+// (an arena). the arena must release everything it handed out when it is
+// destroyed, as monotonic_buffer_resource and the pool resources do; the tree
+// is then dropped without visiting each item.
+class Document {
+  JSONItem *root_item = NULL;
+  std::unique_ptr<std::pmr::memory_resource> arena;
+  size_t bytes = 0;
+
+public:
+  Document() = default;
+  explicit Document(JSONItem *root,
+                    std::unique_ptr<std::pmr::memory_resource> storage = NULL,
+                    size_t footprint = 0)
+      : root_item(root), arena(std::move(storage)), bytes(footprint) {}
+  Document(Document &&other) noexcept
+      : root_item(other.root_item), arena(std::move(other.arena)),
+        bytes(other.bytes) {
+    other.root_item = NULL;
+    other.bytes = 0;
+  }
+  Document &operator=(Document &&other) noexcept {
+    if (this != &other) {
+      reset();
+      root_item = other.root_item;
+      arena = std::move(other.arena);
+      bytes = other.bytes;
+      other.root_item = NULL;
+      other.bytes = 0;
+    }
+    return *this;
+  }
+  Document(const Document &) = delete;
+  Document &operator=(const Document &) = delete;
+  ~Document() { reset(); }
+
+  JSONItem *root() const { return root_item; }
+  JSONItem *operator->() const { return root_item; }
+  explicit operator bool() const { return root_item != NULL; }
+  // estimated bytes held by the tree, as counted while parsing it
+  size_t footprint() const { return bytes; }
+
+  void reset() {
+    if (!arena) {
+      destroy_json(root_item);
+    }
+    root_item = NULL;
+    arena.reset();
+    bytes = 0;
+  }
+  // hands ownership of the tree back to the caller. a document that owns
+  // its arena throws std::logic_error and keeps the tree, which can't
+  // outlive the arena; NULL is only ever an empty document.
+  JSONItem *release() {
+    if (arena) {
+      throw std::logic_error("can't release a tree from its document's arena");
+    }
+    JSONItem *root = root_item;
+    root_item = NULL;
+    bytes = 0;
+    return root;
+  }
+};
+
+// parses into input_buffer.resource, which the caller keeps alive
+Document parse_document(ParseBuffer &input_buffer);
+// parses into arena, which the returned Document takes ownership of
+Document parse_document(ParseBuffer &input_buffer,
+                        std::unique_ptr<std::pmr::memory_resource> arena);
+
+// scanners shared with the other readers in this directory. each starts at
+// input_buffer.pos (just past the opening '"' for strings) and leaves pos just
+// past what it consumed.
+void skip_whitespace(ParseBuffer &input_buffer);
+double parse_number(ParseBuffer &input_buffer);
+std::string parse_string(ParseBuffer &input_buffer);
+
+// one escape sequence decoded: length bytes of the text, standing for the
+// first size bytes of utf8
+struct DecodedEscape {
+  size_t length;
+  size_t size;
+  char utf8[4];
+};
+// decodes the escape sequence whose backslash is at text[pos], with \u ones
+// (and surrogate pairs) decoded to UTF-8. throws ParseError, at pos, for an
+// unknown, malformed or unfinished one. every reader of JSON strings in this
+// directory goes through here.
+DecodedEscape decode_escape(std::string_view text, size_t pos);
 
 } // namespace parsejson
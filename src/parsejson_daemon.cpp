@@ -0,0 +1,65 @@
+/*
+ * Runs a parse service (service.h) until interrupted:
+ *
+ *   parsejson_daemon /run/parsejson.sock [threads] [cache_mb]
+ *       [max_request_mb] [timeout_seconds]
+ */
+
+#include "flat.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "service.cpp"
+#include "writer.cpp"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+using namespace parsejson;
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr,
+            "usage: %s socket_path [threads] [cache_mb] [max_request_mb] "
+            "[timeout_seconds]\n",
+            argv[0]);
+    return 2;
+  }
+  ServerOptions options;
+  size_t cache_mb = 1024;
+  if (argc > 2) {
+    options.threads = unsigned(strtoul(argv[2], NULL, 10));
+  }
+  if (argc > 3) {
+    cache_mb = strtoull(argv[3], NULL, 10);
+  }
+  if (argc > 4) {
+    options.max_request_bytes = size_t(strtoull(argv[4], NULL, 10)) << 20;
+  }
+  if (argc > 5) {
+    options.timeout_seconds = strtod(argv[5], NULL);
+  }
+
+  // block the signals before any worker starts, so they all inherit the mask
+  // and the signals are only ever picked up by sigwait below
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  try {
+    ParseService service(cache_mb << 20);
+    ServiceServer server(service, argv[1], options);
+    fprintf(stderr, "listening on %s with %u threads\n", argv[1],
+            options.threads ? options.threads : 1);
+    int signal;
+    sigwait(&signals, &signal);
+    server.stop();
+  } catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "pointer.h"
+
+namespace parsejson {
+
+std::vector<std::string> parse_pointer(std::string_view pointer) {
+  std::vector<std::string> tokens;
+  if (pointer.empty()) {
+    return tokens;
+  }
+  if (pointer[0] != '/') {
+    throw ParseError("json pointer must be empty or start with '/'");
+  }
+  for (size_t i = 1; i <= pointer.size(); i++) {
+    if (i == 1 || pointer[i - 1] == '/') {
+      tokens.emplace_back();
+    }
+    if (i == pointer.size() || pointer[i] == '/') {
+      continue;
+    }
+    if (pointer[i] != '~') {
+      tokens.back() += pointer[i];
+      continue;
+    }
+    if (i + 1 == pointer.size() ||
+        (pointer[i + 1] != '0' && pointer[i + 1] != '1')) {
+      throw ParseError("bad '~' escape in json pointer");
+    }
+    tokens.back() += pointer[i + 1] == '0' ? '~' : '/';
+    i++;
+  }
+  return tokens;
+}
+
+long pointer_index(std::string_view token) {
+  if (token.empty() || token.size() > 18 ||
+      (token.size() > 1 && token[0] == '0')) {
+    return -1;
+  }
+  long index = 0;
+  for (char c : token) {
+    if (c < '0' || c > '9') {
+      return -1;
+    }
+    index = index * 10 + (c - '0');
+  }
+  return index;
+}
+
+JSONItem *resolve_pointer(JSONItem *root,
+                          const std::vector<std::string> &tokens) {
+  JSONItem *item = root;
+  for (const std::string &token : tokens) {
+    if (!item) {
+      return NULL;
+    }
+    if (item->type == JSONType::j_object) {
+      JSONItem *member = item->child;
+      while (member && member->name != token) {
+        member = member->next;
+      }
+      item = member;
+    } else if (item->type == JSONType::j_array) {
+      long index = pointer_index(token);
+      if (index < 0) {
+        return NULL;
+      }
+      JSONItem *element = item->child;
+      while (element && index--) {
+        element = element->next;
+      }
+      item = element;
+    } else {
+      return NULL;
+    }
+  }
+  return item;
+}
+
+FlatRef resolve_pointer(FlatRef root, const std::vector<std::string> &tokens) {
+  FlatRef ref = root;
+  for (const std::string &token : tokens) {
+    if (!ref) {
+      return FlatRef();
+    }
+    if (ref.type() == JSONType::j_object) {
+      ref = ref.find(token);
+    } else if (ref.type() == JSONType::j_array) {
+      long index = pointer_index(token);
+      if (index < 0) {
+        return FlatRef();
+      }
+      FlatRef element = ref.child();
+      while (element && index--) {
+        element = element.next();
+      }
+      ref = element;
+    } else {
+      return FlatRef();
+    }
+  }
+  return ref;
+}
+
+} // namespace parsejson
@@ -0,0 +1,31 @@
+/*
+ * JSON Pointers (RFC 6901): "/a/0/b" names member "b" of element 0 of member
+ * "a". "" is the whole document. Within a token "~1" stands for '/' and "~0"
+ * for '~'.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flat.h"
+#include "parsejson.h"
+
+namespace parsejson {
+
+// the unescaped reference tokens of pointer. throws ParseError if pointer is
+// neither empty nor starts with '/', or contains a bad '~' escape.
+std::vector<std::string> parse_pointer(std::string_view pointer);
+
+// the array index a token names, or -1 if it isn't a valid one ("0", "12"
+// but not "012", "-" or "1x")
+long pointer_index(std::string_view token);
+
+// the item a pointer refers to, or NULL / a null FlatRef if there isn't one
+JSONItem *resolve_pointer(JSONItem *root,
+                          const std::vector<std::string> &tokens);
+FlatRef resolve_pointer(FlatRef root, const std::vector<std::string> &tokens);
+
+} // namespace parsejson
@@ -0,0 +1,225 @@
+/*
+ * Event (pull) reader and the coroutine wrappers around it. The grammar is the
+ * same as parsejson.cpp's, but the recursion is replaced by a stack of open
+ * containers and a state saying what may come next.
+ */
+
+#include "pull.h"
+#include <cctype>
+#include <cstdio>
+#include <string>
+
+namespace parsejson {
+
+void EventReader::begin_container(char bracket, JSONEvent &event) {
+  input.pos++;
+  input.depth++;
+  if (input.depth > PARSER_NESTING_LIMIT) {
+    char msg[100];
+    std::snprintf(msg, 100, "max nesting limit of %d exceeded at pos: %zu",
+                  PARSER_NESTING_LIMIT, input.pos);
+    throw ParseError((const char *)msg);
+  }
+  open.push_back(bracket);
+  if (bracket == '{') {
+    event.type = ev_begin_object;
+    state = expect_first_key;
+  } else {
+    event.type = ev_begin_array;
+    state = expect_first_value;
+  }
+}
+
+void EventReader::end_container(JSONEvent &event) {
+  input.pos++;
+  input.depth--;
+  event.type = open.back() == '{' ? ev_end_object : ev_end_array;
+  open.pop_back();
+  state = after_value;
+}
+
+void EventReader::read_key(JSONEvent &event) {
+  if (input.pos >= input.raw_json.size() ||
+      input.raw_json[input.pos] != '\"') {
+    char msg[100];
+    std::snprintf(msg, 100, "bad object member name at pos: %zu", input.pos);
+    throw ParseError((const char *)msg);
+  }
+  input.pos++; // consume opening '"'
+  event.type = ev_key;
+  event.text = parse_string(input);
+  skip_whitespace(input);
+  if (input.pos >= input.raw_json.size() ||
+      input.raw_json[input.pos] != ':') {
+    char msg[100];
+    std::snprintf(msg, 100, "bad object name-value separation at pos: %zu",
+                  input.pos);
+    throw ParseError((const char *)msg);
+  }
+  input.pos++;
+  state = expect_value;
+}
+
+void EventReader::read_value(JSONEvent &event) {
+  std::string_view raw = input.raw_json;
+  size_t remaining = raw.size() - input.pos;
+  char c = remaining ? raw[input.pos] : '\0';
+  state = after_value;
+  if (c == '\"') {
+    input.pos++;
+    event.type = ev_string;
+    event.text = parse_string(input);
+  } else if (c == '-' || c == '+' || std::isdigit(c)) {
+    event.type = ev_number;
+    event.double_val = parse_number(input);
+  } else if (c == '[' || c == '{') {
+    begin_container(c, event);
+  } else if (remaining >= 4 && raw.compare(input.pos, 4, "null") == 0) {
+    event.type = ev_null;
+    input.pos += 4;
+  } else if (remaining >= 4 && raw.compare(input.pos, 4, "true") == 0) {
+    event.type = ev_bool;
+    event.bool_val = true;
+    input.pos += 4;
+  } else if (remaining >= 5 && raw.compare(input.pos, 5, "false") == 0) {
+    event.type = ev_bool;
+    event.bool_val = false;
+    input.pos += 5;
+  } else {
+    char msg[100];
+    std::snprintf(msg, 100, "invalid json at pos: %zu", input.pos);
+    throw ParseError((const char *)msg);
+  }
+}
+
+bool EventReader::next(JSONEvent &event) {
+  while (true) {
+    skip_whitespace(input);
+    char c =
+        input.pos < input.raw_json.size() ? input.raw_json[input.pos] : '\0';
+    switch (state) {
+    case expect_first_value:
+      if (c == ']') {
+        end_container(event);
+        return true;
+      }
+      // fall through
+    case expect_value:
+      read_value(event);
+      return true;
+    case expect_first_key:
+      if (c == '}') {
+        end_container(event);
+        return true;
+      }
+      // fall through
+    case expect_key:
+      read_key(event);
+      return true;
+    case after_value:
+      if (open.empty()) {
+        state = done;
+        continue;
+      }
+      if ((c == '}' && open.back() == '{') ||
+          (c == ']' && open.back() == '[')) {
+        end_container(event);
+        return true;
+      }
+      if (c != ',') {
+        char msg[100];
+        std::snprintf(msg, 100, "invalid %s continuation at pos: %zu",
+                      open.back() == '{' ? "object" : "array", input.pos);
+        throw ParseError((const char *)msg);
+      }
+      input.pos++;
+      state = open.back() == '{' ? expect_key : expect_value;
+      continue;
+    case done:
+      if (input.pos != input.raw_json.size()) {
+        const char *msg = "trailing junk";
+        throw ParseError(msg);
+      }
+      return false;
+    }
+  }
+}
+
+#ifdef PARSEJSON_HAS_COROUTINES
+
+Generator<JSONEvent> pull_events(ParseBuffer &input_buffer) {
+  EventReader reader(input_buffer);
+  JSONEvent event;
+  while (reader.next(event)) {
+    co_yield event;
+  }
+}
+
+// puts the caller's depth back when the frame holding it goes, which for a
+// generator may be early, or on the way out of a throw
+struct DepthRestore {
+  ParseBuffer &input_buffer;
+  uint32_t depth;
+  ~DepthRestore() { input_buffer.depth = depth; }
+};
+
+Generator<JSONItem *> pull_elements(ParseBuffer &input_buffer) {
+  skip_whitespace(input_buffer);
+  if (input_buffer.pos >= input_buffer.raw_json.size() ||
+      input_buffer.raw_json[input_buffer.pos] != '[') {
+    JSONItem *whole = parse_json(input_buffer);
+    co_yield whole;
+    co_return;
+  }
+  input_buffer.pos++;
+  // elements are parsed one level down so parse_json doesn't insist on
+  // reaching the end of the buffer after each of them
+  DepthRestore restore{input_buffer, input_buffer.depth};
+  input_buffer.depth++;
+  skip_whitespace(input_buffer);
+  bool first = true;
+  while (true) {
+    if (input_buffer.pos >= input_buffer.raw_json.size()) {
+      const char *msg = "unexpected EOF";
+      throw ParseError(msg);
+    }
+    char c = input_buffer.raw_json[input_buffer.pos];
+    if (c == ']') {
+      if (!first) {
+        char msg[100];
+        std::snprintf(msg, 100, "invalid array continuation at pos: %zu",
+                      input_buffer.pos);
+        throw ParseError((const char *)msg);
+      }
+      break;
+    }
+    JSONItem *element = parse_json(input_buffer);
+    co_yield element;
+    skip_whitespace(input_buffer);
+    if (input_buffer.pos < input_buffer.raw_json.size() &&
+        input_buffer.raw_json[input_buffer.pos] == ']') {
+      break;
+    }
+    if (input_buffer.pos >= input_buffer.raw_json.size() ||
+        input_buffer.raw_json[input_buffer.pos] != ',') {
+      char msg[100];
+      std::snprintf(msg, 100, "invalid array continuation at pos: %zu",
+                    input_buffer.pos);
+      throw ParseError((const char *)msg);
+    }
+    input_buffer.pos++;
+    skip_whitespace(input_buffer);
+    first = false;
+  }
+  input_buffer.pos++;
+  input_buffer.depth--;
+  skip_whitespace(input_buffer);
+  if (input_buffer.pos != input_buffer.raw_json.size()) {
+    const char *msg = "trailing junk";
+    throw ParseError(msg);
+  }
+}
+
+#endif // PARSEJSON_HAS_COROUTINES
+
+} // namespace parsejson
@@ -0,0 +1,162 @@
+/*
+ * Pull style reading of JSON. Instead of building the whole tree with
+ * parse_json, an EventReader hands out one event at a time (begin/end of a
+ * container, a member name, a scalar value) as the caller asks for them, so a
+ * large document can be consumed incrementally in straight-line code.
+ *
+ * With C++20 the same thing is available as coroutine generators:
+ *
+ *   for (const JSONEvent &event : pull_events(input)) { ... }
+ *   for (JSONItem *element : pull_elements(input)) {
+ *     ...
+ *     destroy_json(element);
+ *   }
+ *
+ * pull_elements yields the elements of a top-level array one at a time as
+ * parsed trees (or the whole document, if it isn't an array). Each element is
+ * owned by the caller.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "parsejson.h"
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#include <exception>
+#include <utility>
+#define PARSEJSON_HAS_COROUTINES 1
+#endif
+
+namespace parsejson {
+
+enum JSONEventType {
+  ev_begin_object,
+  ev_end_object,
+  ev_begin_array,
+  ev_end_array,
+  ev_key,
+  ev_string,
+  ev_number,
+  ev_bool,
+  ev_null,
+};
+
+struct JSONEvent {
+  JSONEventType type;
+  // member name for ev_key, value for ev_string
+  std::string text;
+  double double_val = 0;
+  bool bool_val = false;
+};
+
+class EventReader {
+  enum State {
+    expect_value,
+    expect_first_value, // just after '[', so ']' is allowed
+    expect_key,
+    expect_first_key, // just after '{', so '}' is allowed
+    after_value,
+    done,
+  };
+
+  ParseBuffer &input;
+  std::vector<char> open; // '{' or '[' for each container we're inside
+  State state = expect_value;
+
+  void begin_container(char bracket, JSONEvent &event);
+  void end_container(JSONEvent &event);
+  void read_value(JSONEvent &event);
+  void read_key(JSONEvent &event);
+
+public:
+  EventReader(ParseBuffer &input_buffer) : input(input_buffer) {}
+
+  // fills in the next event and returns true, or returns false once the
+  // document is complete. throws ParseError on malformed input.
+  bool next(JSONEvent &event);
+
+  // number of containers currently open
+  size_t depth() const { return open.size(); }
+};
+
+#ifdef PARSEJSON_HAS_COROUTINES
+
+// minimal single-pass generator, enough for range-for over the pull API.
+// exceptions thrown in the coroutine body surface from begin()/operator++.
+template <typename T> class Generator {
+public:
+  struct promise_type {
+    const T *current = nullptr;
+    std::exception_ptr error;
+
+    Generator get_return_object() {
+      return Generator(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(const T &value) noexcept {
+      current = &value;
+      return {};
+    }
+    void return_void() {}
+    void unhandled_exception() { error = std::current_exception(); }
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  class iterator {
+    handle_type coro;
+
+    void advance() {
+      coro.resume();
+      if (coro.promise().error) {
+        std::rethrow_exception(std::exchange(coro.promise().error, nullptr));
+      }
+    }
+
+  public:
+    iterator(handle_type h = nullptr) : coro(h) {
+      if (coro) {
+        advance();
+      }
+    }
+    const T &operator*() const { return *coro.promise().current; }
+    const T *operator->() const { return coro.promise().current; }
+    iterator &operator++() {
+      advance();
+      return *this;
+    }
+    bool operator==(std::default_sentinel_t) const {
+      return !coro || coro.done();
+    }
+  };
+
+  Generator(Generator &&other) noexcept
+      : coro(std::exchange(other.coro, nullptr)) {}
+  Generator(const Generator &) = delete;
+  Generator &operator=(const Generator &) = delete;
+  ~Generator() {
+    if (coro) {
+      coro.destroy();
+    }
+  }
+
+  iterator begin() { return iterator(coro); }
+  std::default_sentinel_t end() { return {}; }
+
+private:
+  explicit Generator(handle_type h) : coro(h) {}
+  handle_type coro;
+};
+
+Generator<JSONEvent> pull_events(ParseBuffer &input_buffer);
+Generator<JSONItem *> pull_elements(ParseBuffer &input_buffer);
+
+#endif // PARSEJSON_HAS_COROUTINES
+
+} // namespace parsejson
@@ -0,0 +1,73 @@
+#include "reclaim.h"
+#include <utility>
+
+namespace parsejson {
+
+Reclaimer::Reclaimer(size_t max_queued_documents)
+    : max_queued(max_queued_documents ? max_queued_documents : 1) {
+  worker = std::thread(&Reclaimer::run, this);
+}
+
+Reclaimer::~Reclaimer() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  work_ready.notify_one();
+  worker.join();
+}
+
+bool Reclaimer::reclaim(Document &&doc) {
+  size_t bytes = doc.footprint();
+  std::unique_lock<std::mutex> guard(lock);
+  if (queue.size() >= max_queued) {
+    guard.unlock();
+    doc.reset();
+    reclaimed += bytes;
+    reclaimed_inline++;
+    return false;
+  }
+  pending += bytes;
+  queue.push_back(std::move(doc));
+  guard.unlock();
+  work_ready.notify_one();
+  return true;
+}
+
+void Reclaimer::drain() {
+  std::unique_lock<std::mutex> guard(lock);
+  work_done.wait(guard, [this] { return queue.empty() && !busy; });
+}
+
+size_t Reclaimer::queued_documents() {
+  std::lock_guard<std::mutex> guard(lock);
+  return queue.size();
+}
+
+void Reclaimer::run() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    work_ready.wait(guard, [this] { return stopping || !queue.empty(); });
+    if (queue.empty()) {
+      // only reachable when stopping, and everything has been released
+      return;
+    }
+    Document doc = std::move(queue.front());
+    queue.pop_front();
+    busy = true;
+    guard.unlock();
+
+    size_t bytes = doc.footprint();
+    doc.reset();
+    pending -= bytes;
+    reclaimed += bytes;
+
+    guard.lock();
+    busy = false;
+    if (queue.empty()) {
+      work_done.notify_all();
+    }
+  }
+}
+
+} // namespace parsejson
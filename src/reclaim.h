@@ -0,0 +1,66 @@
+/*
+ * Deferred destruction of documents. Tearing down a very large tree can take
+ * longer than parsing it, and there's no reason for it to happen on a thread
+ * that has somewhere more important to be. A Reclaimer owns a background
+ * thread and a bounded queue of Documents waiting to be released:
+ *
+ *   Reclaimer reclaimer;
+ *   ...
+ *   reclaimer.reclaim(std::move(doc)); // returns straight away
+ *
+ * If the queue is already full the document is released on the calling
+ * thread instead, so memory held by pending documents stays bounded.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "parsejson.h"
+
+namespace parsejson {
+
+class Reclaimer {
+  std::deque<Document> queue;
+  size_t max_queued;
+  bool stopping = false;
+  bool busy = false; // background thread is releasing a document
+  std::mutex lock;
+  std::condition_variable work_ready;
+  std::condition_variable work_done;
+  std::atomic<size_t> pending = 0;
+  std::atomic<size_t> reclaimed = 0;
+  std::atomic<size_t> reclaimed_inline = 0;
+  std::thread worker;
+
+  void run();
+
+public:
+  explicit Reclaimer(size_t max_queued_documents = 64);
+  // releases anything still queued before returning
+  ~Reclaimer();
+  Reclaimer(const Reclaimer &) = delete;
+  Reclaimer &operator=(const Reclaimer &) = delete;
+
+  // takes doc off the caller's hands. returns false if the queue was full and
+  // the document was released on the calling thread instead.
+  bool reclaim(Document &&doc);
+
+  // blocks until everything handed over so far has been released
+  void drain();
+
+  // estimated bytes held by documents queued or being released
+  size_t pending_bytes() const { return pending; }
+  // bytes released so far, in the background or inline
+  size_t reclaimed_bytes() const { return reclaimed; }
+  // documents released on the caller's thread because the queue was full
+  size_t inline_reclaims() const { return reclaimed_inline; }
+  size_t queued_documents();
+};
+
+} // namespace parsejson
@@ -0,0 +1,482 @@
+#include "service.h"
+#include "pointer.h"
+#include "writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <random>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace parsejson {
+
+uint64_t rotate_left(uint64_t x, int bits) {
+  return (x << bits) | (x >> (64 - bits));
+}
+
+// SipHash's state and its compression rounds
+struct SipState {
+  uint64_t v0, v1, v2, v3;
+
+  void rounds(int count) {
+    for (int i = 0; i < count; i++) {
+      v0 += v1;
+      v1 = rotate_left(v1, 13) ^ v0;
+      v0 = rotate_left(v0, 32);
+      v2 += v3;
+      v3 = rotate_left(v3, 16) ^ v2;
+      v0 += v3;
+      v3 = rotate_left(v3, 21) ^ v0;
+      v2 += v1;
+      v1 = rotate_left(v1, 17) ^ v2;
+      v2 = rotate_left(v2, 32);
+    }
+  }
+  void add(uint64_t word) {
+    v3 ^= word;
+    rounds(2);
+    v0 ^= word;
+  }
+};
+
+// words are read little-endian, as the reference does
+uint64_t load_le(const char *bytes, size_t count) {
+  uint64_t word = 0;
+  for (size_t i = 0; i < count; i++) {
+    word |= uint64_t(uint8_t(bytes[i])) << (8 * i);
+  }
+  return word;
+}
+
+uint64_t siphash(uint64_t k0, uint64_t k1, std::string_view bytes) {
+  SipState state = {k0 ^ 0x736f6d6570736575ull, k1 ^ 0x646f72616e646f6dull,
+                    k0 ^ 0x6c7967656e657261ull, k1 ^ 0x7465646279746573ull};
+  size_t i = 0;
+  for (; i + 8 <= bytes.size(); i += 8) {
+    state.add(load_le(bytes.data() + i, 8));
+  }
+  state.add(load_le(bytes.data() + i, bytes.size() - i) |
+            uint64_t(bytes.size()) << 56);
+  state.v2 ^= 0xff;
+  state.rounds(4);
+  return state.v0 ^ state.v1 ^ state.v2 ^ state.v3;
+}
+
+DocumentId content_hash(std::string_view bytes) {
+  static const uint64_t key[2] = {
+      uint64_t(std::random_device()()) << 32 | std::random_device()(),
+      uint64_t(std::random_device()()) << 32 | std::random_device()()};
+  return siphash(key[0], key[1], bytes);
+}
+
+std::shared_ptr<const FlatDocument> DocumentCache::find(DocumentId id) {
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = index.find(id);
+  if (found == index.end()) {
+    return NULL;
+  }
+  lru.splice(lru.begin(), lru, found->second);
+  return found->second->doc;
+}
+
+std::shared_ptr<const FlatDocument> DocumentCache::insert(DocumentId id,
+                                                          FlatDocument doc) {
+  auto shared = std::make_shared<const FlatDocument>(std::move(doc));
+  size_t bytes = shared->view().serialized_size();
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = index.find(id);
+  if (found != index.end()) {
+    // someone else parsed the same document meanwhile
+    lru.splice(lru.begin(), lru, found->second);
+    return found->second->doc;
+  }
+  lru.push_front({id, shared, bytes});
+  index[id] = lru.begin();
+  total += bytes;
+  // always keep the newest entry, even if it alone is over budget
+  while (total > max_bytes && lru.size() > 1) {
+    total -= lru.back().bytes;
+    index.erase(lru.back().id);
+    lru.pop_back();
+  }
+  return shared;
+}
+
+bool DocumentCache::contains(DocumentId id) {
+  std::lock_guard<std::mutex> guard(lock);
+  return index.count(id) != 0;
+}
+
+size_t DocumentCache::bytes() {
+  std::lock_guard<std::mutex> guard(lock);
+  return total;
+}
+
+size_t DocumentCache::documents() {
+  std::lock_guard<std::mutex> guard(lock);
+  return lru.size();
+}
+
+DocumentId ParseService::parse_text(std::string json) {
+  DocumentId id = content_hash(json);
+  if (cache.find(id)) {
+    return id;
+  }
+  ParseBuffer input;
+  input.raw_json = std::move(json);
+  cache.insert(id, parse_flat(input));
+  return id;
+}
+
+bool read_all(int fd, void *out, size_t size);
+
+// closes a descriptor however the scope ends
+struct FileCloser {
+  int fd;
+  ~FileCloser() { close(fd); }
+};
+
+DocumentId ParseService::parse_file(const std::string &path,
+                                    const RequestLimits &limits) {
+  // non-blocking, so naming a FIFO can't hold the open up. it's turned
+  // away below along with everything else that isn't a regular file.
+  int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    throw ServiceError("can't open " + path + ": " + std::strerror(errno));
+  }
+  FileCloser closer{fd};
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    throw ServiceError("can't stat " + path + ": " + std::strerror(errno));
+  }
+  if (!S_ISREG(info.st_mode)) {
+    throw ServiceError(path + " is not a regular file");
+  }
+  if (limits.check_owner && info.st_uid != limits.owner) {
+    throw ServiceError(path + " is not the client's own file");
+  }
+  if (uint64_t(info.st_size) > limits.max_file_bytes) {
+    char msg[200];
+    std::snprintf(msg, 200, "file of %llu bytes is over the limit of %llu",
+                  (unsigned long long)info.st_size,
+                  (unsigned long long)limits.max_file_bytes);
+    throw ServiceError(msg);
+  }
+  int64_t mtime_ns = int64_t(info.st_mtim.tv_sec) * 1000000000 +
+                     info.st_mtim.tv_nsec;
+  {
+    std::lock_guard<std::mutex> guard(files_lock);
+    auto found = files.find(path);
+    if (found != files.end() && found->second.mtime_ns == mtime_ns &&
+        found->second.size == uint64_t(info.st_size) &&
+        cache.find(found->second.id)) {
+      return found->second.id;
+    }
+  }
+  // just the bytes fstat counted, however the file changes meanwhile
+  std::string json(size_t(info.st_size), '\0');
+  if (!read_all(fd, json.data(), json.size())) {
+    throw ServiceError("can't read " + path);
+  }
+  DocumentId id = parse_text(std::move(json));
+  std::lock_guard<std::mutex> guard(files_lock);
+  if (files.size() >= max_files && !files.count(path)) {
+    // stamps of documents no longer cached save nothing, so they go first
+    for (auto stamp = files.begin(); stamp != files.end();) {
+      stamp = cache.contains(stamp->second.id) ? std::next(stamp)
+                                               : files.erase(stamp);
+    }
+    if (files.size() >= max_files) {
+      files.erase(files.begin());
+    }
+  }
+  files[path] = {mtime_ns, uint64_t(info.st_size), id};
+  return id;
+}
+
+size_t ParseService::file_stamps() {
+  std::lock_guard<std::mutex> guard(files_lock);
+  return files.size();
+}
+
+std::string ParseService::query(DocumentId id, std::string_view pointer) {
+  std::shared_ptr<const FlatDocument> doc = cache.find(id);
+  if (!doc) {
+    throw ServiceError("unknown document");
+  }
+  FlatRef ref = resolve_pointer(doc->root(), parse_pointer(pointer));
+  if (!ref) {
+    throw ServiceError("nothing at " + std::string(pointer));
+  }
+  if (ref == doc->root()) {
+    return doc->view().serialize();
+  }
+  return copy_flat(ref).view().serialize();
+}
+
+std::string ParseService::handle(uint8_t op, std::string payload,
+                                 const RequestLimits &limits) {
+  DocumentId id;
+  switch (op) {
+  case op_parse_text:
+    id = parse_text(std::move(payload));
+    return std::string(reinterpret_cast<const char *>(&id), sizeof(id));
+  case op_parse_file:
+    id = parse_file(payload, limits);
+    return std::string(reinterpret_cast<const char *>(&id), sizeof(id));
+  case op_query:
+    if (payload.size() < sizeof(id)) {
+      throw ServiceError("query needs a document id");
+    }
+    std::memcpy(&id, payload.data(), sizeof(id));
+    return query(id, std::string_view(payload).substr(sizeof(id)));
+  default:
+    throw ServiceError("unknown request");
+  }
+}
+
+// frames over a stream socket
+
+bool read_all(int fd, void *out, size_t size) {
+  char *dest = static_cast<char *>(out);
+  while (size) {
+    ssize_t got = read(fd, dest, size);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    dest += got;
+    size -= size_t(got);
+  }
+  return true;
+}
+
+// false if the connection closed first. throws ServiceError, having read
+// just the header, if the payload is longer than max_length.
+bool read_frame(int fd, uint8_t &op, std::string &payload,
+                uint64_t max_length = UINT64_MAX) {
+  uint64_t length;
+  if (!read_all(fd, &op, 1) || !read_all(fd, &length, sizeof(length))) {
+    return false;
+  }
+  if (length > max_length) {
+    char msg[200];
+    std::snprintf(msg, 200, "request of %llu bytes is over the limit of %llu",
+                  (unsigned long long)length, (unsigned long long)max_length);
+    throw ServiceError(msg);
+  }
+  payload.resize(length);
+  return read_all(fd, payload.data(), length);
+}
+
+// throws std::system_error if the connection fails
+void write_frame(int fd, uint8_t op, std::string_view payload) {
+  uint64_t length = payload.size();
+  iovec pieces[] = {{&op, 1},
+                    {&length, sizeof(length)},
+                    {const_cast<char *>(payload.data()), payload.size()}};
+  write_vectors(fd, pieces, 3);
+}
+
+sockaddr_un socket_address(const std::string &path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+ServiceServer::ServiceServer(ParseService &parse_service,
+                             const std::string &socket_path,
+                             const ServerOptions &server_options)
+    : service(parse_service), path(socket_path), options(server_options) {
+  sockaddr_un address = socket_address(path);
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+  unlink(path.c_str());
+  // nobody can connect before listen(), so there's no window in which the
+  // socket is open to others
+  if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+      listen(listen_fd, 64) != 0) {
+    int error = errno;
+    close(listen_fd);
+    throw std::system_error(error, std::generic_category(),
+                            "can't listen on " + path);
+  }
+  for (unsigned i = 0; i < std::max(options.threads, 1u); i++) {
+    workers.emplace_back(&ServiceServer::run, this);
+  }
+}
+
+ServiceServer::~ServiceServer() { stop(); }
+
+void ServiceServer::stop() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (stopping) {
+      return;
+    }
+    stopping = true;
+    // wakes the workers out of accept() and read()
+    shutdown(listen_fd, SHUT_RDWR);
+    for (int fd : connections) {
+      shutdown(fd, SHUT_RDWR);
+    }
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  close(listen_fd);
+  unlink(path.c_str());
+}
+
+void ServiceServer::run() {
+  while (true) {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (stopping) {
+        close(fd);
+        return;
+      }
+      connections.insert(fd);
+    }
+    if (options.timeout_seconds > 0) {
+      double whole;
+      double part = std::modf(options.timeout_seconds, &whole);
+      timeval timeout = {time_t(whole), suseconds_t(part * 1e6)};
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+    // a client of another user only gets to name its own files
+    RequestLimits limits;
+    limits.max_file_bytes = options.max_request_bytes;
+    ucred peer;
+    socklen_t peer_size = sizeof(peer);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_size) != 0) {
+      peer.uid = uid_t(-1); // nobody's
+    }
+    if (peer.uid != 0 && peer.uid != geteuid()) {
+      limits.check_owner = true;
+      limits.owner = peer.uid;
+    }
+    // whatever goes wrong with one connection (running out of memory for a
+    // request, say) is the end of that connection and no other
+    try {
+      serve(fd, limits);
+    } catch (std::exception &) {
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      connections.erase(fd);
+    }
+    close(fd);
+  }
+}
+
+void ServiceServer::serve(int fd, const RequestLimits &limits) {
+  uint8_t op;
+  std::string payload;
+  while (true) {
+    try {
+      if (!read_frame(fd, op, payload, options.max_request_bytes)) {
+        return;
+      }
+    } catch (ServiceError &e) {
+      // the rest of the frame is still to come, so the connection is done
+      write_frame(fd, op_error, e.what());
+      return;
+    }
+    std::string response;
+    uint8_t status = op_ok;
+    try {
+      response = service.handle(op, std::move(payload), limits);
+    } catch (std::exception &e) {
+      status = op_error;
+      response = e.what();
+    }
+    // a client gone meanwhile throws, which ends the connection in run()
+    write_frame(fd, status, response);
+  }
+}
+
+Snapshot::Snapshot(std::string_view bytes) : words(bytes.size() / 8 + 1) {
+  std::memcpy(words.data(), bytes.data(), bytes.size());
+  flat = FlatView::from_bytes(words.data(), bytes.size());
+}
+
+ServiceClient::ServiceClient(const std::string &socket_path) {
+  sockaddr_un address = socket_address(socket_path);
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address),
+                        sizeof(address)) != 0) {
+    int error = errno;
+    if (fd >= 0) {
+      close(fd);
+    }
+    throw std::system_error(error, std::generic_category(),
+                            "can't connect to " + socket_path);
+  }
+}
+
+ServiceClient::~ServiceClient() { close(fd); }
+
+std::string ServiceClient::call(ServiceOp op, std::string_view payload) {
+  uint8_t status;
+  std::string response;
+  write_frame(fd, op, payload);
+  if (!read_frame(fd, status, response)) {
+    throw std::system_error(errno ? errno : ECONNRESET,
+                            std::generic_category(), "parse service");
+  }
+  if (status != op_ok) {
+    throw ServiceError(response);
+  }
+  return response;
+}
+
+DocumentId ServiceClient::parse_text(std::string_view json) {
+  std::string response = call(op_parse_text, json);
+  DocumentId id = 0;
+  std::memcpy(&id, response.data(), std::min(response.size(), sizeof(id)));
+  return id;
+}
+
+DocumentId ServiceClient::parse_file(const std::string &path) {
+  std::string response = call(op_parse_file, path);
+  DocumentId id = 0;
+  std::memcpy(&id, response.data(), std::min(response.size(), sizeof(id)));
+  return id;
+}
+
+Snapshot ServiceClient::query(DocumentId id, std::string_view pointer) {
+  std::string request(reinterpret_cast<const char *>(&id), sizeof(id));
+  request.append(pointer.data(), pointer.size());
+  return Snapshot(call(op_query, request));
+}
+
+} // namespace parsejson
@@ -0,0 +1,227 @@
+/*
+ * A local parse service, so that many short-lived tools on a host can share
+ * one warm parser and one cache of parsed documents instead of each parsing
+ * the same large files again. Clients talk to it over a Unix domain socket:
+ *
+ *   ServiceClient client("/run/parsejson.sock");
+ *   DocumentId id = client.parse_file("/data/reference.json");
+ *   Snapshot users = client.query(id, "/users");
+ *   for (FlatRef user : users.root().children()) { ... }
+ *
+ * Documents are parsed into flat form (flat.h) and cached by a hash of their
+ * content, so the same bytes sent twice, or the same file named twice, are
+ * only parsed once. The hash is keyed with a secret the service picks at
+ * startup, so a client can't make up a document with the id of another's.
+ * Answers come back as serialized flat documents, which the client reads in
+ * place without parsing anything.
+ *
+ * Each request and response is one frame: a byte (the op, or 'K'/'E' for a
+ * response), a 64-bit payload length in host byte order, then the payload.
+ *
+ *   'D' json text        -> 8 byte DocumentId
+ *   'F' file path        -> 8 byte DocumentId
+ *   'Q' id + json pointer -> flat snapshot of the value the pointer selects
+ *
+ * An 'E' response carries an error message. A connection can carry any
+ * number of requests. A request over the server's size limit is answered
+ * with an error and the connection closed, as is a connection left idle
+ * for too long, so that a few clients can't tie up every worker. Files are
+ * held to the same size limit, and only regular files are read.
+ *
+ * The socket is created accessible to the daemon's own user only. Should it
+ * be opened up to others, a client of another user may only name files it
+ * owns, as the daemon would otherwise read them with its own rights.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "flat.h"
+
+namespace parsejson {
+
+// a hash of a document's bytes: SipHash-2-4 keyed with a random key chosen
+// once per process, so ids can't be worked out (or collided) without it and
+// mean nothing to another process
+using DocumentId = uint64_t;
+DocumentId content_hash(std::string_view bytes);
+// SipHash-2-4 of bytes under the key (k0, k1)
+uint64_t siphash(uint64_t k0, uint64_t k1, std::string_view bytes);
+
+enum ServiceOp : uint8_t {
+  op_parse_text = 'D',
+  op_parse_file = 'F',
+  op_query = 'Q',
+  op_ok = 'K',
+  op_error = 'E',
+};
+
+// an error reported by the service (bad request, unparseable document...)
+class ServiceError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// parsed documents by content hash, least recently used dropped first once
+// the total serialized size passes the budget. entries are shared_ptrs so a
+// request using a document keeps it alive even if it is evicted meanwhile.
+class DocumentCache {
+  struct Entry {
+    DocumentId id;
+    std::shared_ptr<const FlatDocument> doc;
+    size_t bytes;
+  };
+
+  std::list<Entry> lru; // most recently used first
+  std::unordered_map<DocumentId, std::list<Entry>::iterator> index;
+  size_t max_bytes;
+  size_t total = 0;
+  std::mutex lock;
+
+public:
+  explicit DocumentCache(size_t budget_bytes) : max_bytes(budget_bytes) {}
+
+  std::shared_ptr<const FlatDocument> find(DocumentId id);
+  std::shared_ptr<const FlatDocument> insert(DocumentId id, FlatDocument doc);
+  // whether id is cached, without counting as a use
+  bool contains(DocumentId id);
+  size_t bytes();
+  size_t documents();
+};
+
+// what one request may have the service do on the client's behalf
+struct RequestLimits {
+  // a file bigger than this is refused rather than read
+  size_t max_file_bytes = SIZE_MAX;
+  // when set, only files owned by owner are read
+  bool check_owner = false;
+  uid_t owner = 0;
+};
+
+class ParseService {
+  struct FileStamp {
+    int64_t mtime_ns;
+    uint64_t size;
+    DocumentId id;
+  };
+
+  DocumentCache cache;
+  // which document each file named last held. at most max_files, the ones
+  // whose documents have left the cache going first.
+  std::unordered_map<std::string, FileStamp> files;
+  size_t max_files;
+  std::mutex files_lock;
+
+public:
+  explicit ParseService(size_t cache_bytes = size_t(1) << 30,
+                        size_t file_limit = 4096)
+      : cache(cache_bytes), max_files(file_limit) {}
+
+  // each throws ServiceError (or ParseError, for a bad document)
+  DocumentId parse_text(std::string json);
+  // a file that hasn't changed since it was last parsed isn't read again.
+  // anything but a regular file within limits is a ServiceError.
+  DocumentId parse_file(const std::string &path,
+                        const RequestLimits &limits = RequestLimits());
+  // serialized flat copy of the value pointer selects in document id
+  std::string query(DocumentId id, std::string_view pointer);
+
+  // runs one request, returning the response payload
+  std::string handle(uint8_t op, std::string payload,
+                     const RequestLimits &limits = RequestLimits());
+
+  DocumentCache &documents() { return cache; }
+  size_t file_stamps();
+};
+
+struct ServerOptions {
+  unsigned threads = std::thread::hardware_concurrency();
+  // a request with a longer payload is answered with an error and its
+  // connection closed, before anything is allocated for it. files named in
+  // requests are held to it too.
+  size_t max_request_bytes = size_t(1) << 30;
+  // a connection is dropped once a read or write waits this long, whether
+  // the client is idle between requests or stalls in the middle of one.
+  // 0 waits forever.
+  double timeout_seconds = 60;
+};
+
+// listens on a Unix socket and serves requests with a fixed set of worker
+// threads, each taking one connection at a time
+class ServiceServer {
+  ParseService &service;
+  std::string path;
+  ServerOptions options;
+  int listen_fd = -1;
+  std::vector<std::thread> workers;
+  std::set<int> connections;
+  std::mutex lock;
+  bool stopping = false;
+
+  void run();
+  void serve(int fd, const RequestLimits &limits);
+
+public:
+  // throws std::system_error if the socket can't be set up
+  ServiceServer(ParseService &parse_service, const std::string &socket_path,
+                const ServerOptions &server_options = ServerOptions());
+  ~ServiceServer();
+  ServiceServer(const ServiceServer &) = delete;
+  ServiceServer &operator=(const ServiceServer &) = delete;
+
+  // stops accepting, drops open connections and waits for the workers
+  void stop();
+};
+
+// a flat document received from the service, kept in suitably aligned
+// storage. moving it keeps the view valid; copying isn't allowed.
+class Snapshot {
+  std::vector<uint64_t> words;
+  FlatView flat;
+
+public:
+  // copies bytes and validates them. throws ParseError if they aren't a
+  // flat document.
+  explicit Snapshot(std::string_view bytes);
+  Snapshot(Snapshot &&) = default;
+  Snapshot &operator=(Snapshot &&) = default;
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+
+  const FlatView &view() const { return flat; }
+  FlatRef root() const { return flat.root(); }
+};
+
+class ServiceClient {
+  int fd = -1;
+
+  std::string call(ServiceOp op, std::string_view payload);
+
+public:
+  // throws std::system_error if it can't connect
+  explicit ServiceClient(const std::string &socket_path);
+  ~ServiceClient();
+  ServiceClient(const ServiceClient &) = delete;
+  ServiceClient &operator=(const ServiceClient &) = delete;
+
+  // each throws ServiceError for an error response, std::system_error if
+  // the connection fails
+  DocumentId parse_text(std::string_view json);
+  DocumentId parse_file(const std::string &path);
+  Snapshot query(DocumentId id, std::string_view pointer);
+};
+
+} // namespace parsejson
@@ -0,0 +1,101 @@
+#include "shared.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace parsejson {
+
+void publish_shared(const std::string &name, const FlatView &doc) {
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "can't create shared document " + name);
+  }
+  size_t size = doc.serialized_size();
+  void *base = MAP_FAILED;
+  if (ftruncate(fd, off_t(size)) == 0) {
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  int error = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    throw std::system_error(error, std::generic_category(),
+                            "can't size or map shared document " + name);
+  }
+  // writes the header magic last, so readers racing us are turned away
+  // until the document is complete
+  doc.serialize_to(base);
+  munmap(base, size);
+}
+
+bool unpublish_shared(const std::string &name) {
+  return shm_unlink(name.c_str()) == 0;
+}
+
+SharedView::SharedView(const std::string &name) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "can't open shared document " + name);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(),
+                            "can't stat shared document " + name);
+  }
+  size = size_t(info.st_size);
+  if (size) {
+    base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  int error = errno;
+  close(fd);
+  if (base == MAP_FAILED || !base) {
+    base = NULL;
+    if (size == 0) {
+      throw ParseError("flat document: shared document is empty");
+    }
+    throw std::system_error(error, std::generic_category(),
+                            "can't map shared document " + name);
+  }
+  try {
+    flat = FlatView::from_bytes(base, size);
+  } catch (ParseError &) {
+    munmap(base, size);
+    base = NULL;
+    throw;
+  }
+}
+
+SharedView::~SharedView() {
+  if (base) {
+    munmap(base, size);
+  }
+}
+
+SharedView::SharedView(SharedView &&other) noexcept
+    : base(std::exchange(other.base, nullptr)),
+      size(std::exchange(other.size, 0)), flat(other.flat) {
+  other.flat = FlatView();
+}
+
+SharedView &SharedView::operator=(SharedView &&other) noexcept {
+  if (this != &other) {
+    if (base) {
+      munmap(base, size);
+    }
+    base = std::exchange(other.base, nullptr);
+    size = std::exchange(other.size, 0);
+    flat = other.flat;
+    other.flat = FlatView();
+  }
+  return *this;
+}
+
+} // namespace parsejson
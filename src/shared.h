@@ -0,0 +1,61 @@
+/*
+ * Publishing a parsed document to other processes on the same host through
+ * POSIX shared memory. One process parses and publishes; the others map the
+ * result read-only and read it through the usual FlatRef accessors, so the
+ * document is parsed once and held in memory once however many readers
+ * there are. This works because a flat document has no pointers in it, only
+ * indices and offsets, so it reads the same wherever it is mapped.
+ *
+ *   // publisher
+ *   publish_shared("/reference-data", parse_flat(input).view());
+ *
+ *   // any reader
+ *   SharedView shared("/reference-data");
+ *   FlatRef root = shared.root();
+ *
+ * A published document stays until unpublish_shared() (or a reboot), even if
+ * the publisher exits. Readers that already have it mapped keep their copy
+ * after it is unpublished.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "flat.h"
+
+namespace parsejson {
+
+// creates the shared memory object `name` (which should start with '/') and
+// writes doc into it. fails if the name is already taken, rather than
+// changing a document under readers' feet. throws std::system_error.
+void publish_shared(const std::string &name, const FlatView &doc);
+
+// removes the name. returns false if there was nothing published under it.
+bool unpublish_shared(const std::string &name);
+
+// a read-only mapping of a published document
+class SharedView {
+  void *base = NULL;
+  size_t size = 0;
+  FlatView flat;
+
+public:
+  // maps and validates the document published as name. throws
+  // std::system_error if it can't be opened or mapped, and ParseError if
+  // what's there isn't a complete flat document (including one that is
+  // still being written).
+  explicit SharedView(const std::string &name);
+  ~SharedView();
+  SharedView(SharedView &&other) noexcept;
+  SharedView &operator=(SharedView &&other) noexcept;
+  SharedView(const SharedView &) = delete;
+  SharedView &operator=(const SharedView &) = delete;
+
+  const FlatView &view() const { return flat; }
+  FlatRef root() const { return flat.root(); }
+  size_t mapped_bytes() const { return size; }
+};
+
+} // namespace parsejson
@@ -0,0 +1,474 @@
+#include "sort.h"
+#include "threads.h"
+#include "writer.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace parsejson {
+
+enum SortKeyTag : char {
+  key_missing,
+  key_null,
+  key_false,
+  key_true,
+  key_number,
+  key_string,
+  key_container,
+};
+
+// the value of a number's text. from_chars gives up on numbers too big or
+// too small for a double, which are taken as infinite or zero.
+double sort_number(std::string_view text) {
+  double number;
+  auto parsed =
+      std::from_chars(text.data(), text.data() + text.size(), number);
+  if (parsed.ec == std::errc::result_out_of_range) {
+    size_t exponent = text.find_first_of("eE");
+    bool tiny = exponent != std::string_view::npos &&
+                exponent + 1 < text.size() && text[exponent + 1] == '-';
+    number = tiny ? 0.0 : std::numeric_limits<double>::infinity();
+    return text[0] == '-' ? -number : number;
+  }
+  if (parsed.ec != std::errc()) {
+    throw ParseError("bad number");
+  }
+  return number;
+}
+
+void append_sort_key(std::string &out, const Field &key) {
+  if (!key.found) {
+    out += char(key_missing);
+    return;
+  }
+  switch (key.type) {
+  case j_null:
+    out += char(key_null);
+    break;
+  case j_bool:
+    out += char(key.text[0] == 't' ? key_true : key_false);
+    break;
+  case j_number: {
+    double number = sort_number(key.text);
+    if (number == 0) {
+      number = 0; // -0 sorts with 0
+    }
+    // flipping the sign bit of a positive double, or every bit of a
+    // negative one, gives an unsigned integer in the same order
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    bits = bits >> 63 ? ~bits : bits | uint64_t(1) << 63;
+    out += char(key_number);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out += char(bits >> shift);
+    }
+    break;
+  }
+  case j_string:
+    out += char(key_string);
+    if (key.text.find('\\') == std::string_view::npos) {
+      out.append(key.text.data() + 1, key.text.size() - 2);
+    } else {
+      append_unescaped(out, key.text);
+    }
+    break;
+  default:
+    out += char(key_container);
+    out.append(key.text.data(), key.text.size());
+  }
+}
+
+struct SortEntry {
+  std::string key;
+  uint64_t offset; // of the record in the input
+  uint32_t length;
+};
+
+// spilled, an entry is its key's length, the record's length and offset,
+// then the key
+const size_t spilled_header = 16;
+
+bool entry_before(const SortEntry &a, const SortEntry &b, bool descending) {
+  int order = a.key.compare(b.key);
+  if (order != 0) {
+    return descending ? order > 0 : order < 0;
+  }
+  return a.offset < b.offset;
+}
+
+// the heap memory behind a key, beyond the SortEntry holding it
+size_t key_bytes(const std::string &key) {
+  return key.capacity() > std::string().capacity() ? key.capacity() + 1 : 0;
+}
+
+void pwrite_all(int fd, const char *data, size_t size, uint64_t offset) {
+  while (size) {
+    ssize_t sent = pwrite(fd, data, size, off_t(offset));
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(),
+                              "can't write spill file");
+    }
+    data += sent;
+    size -= size_t(sent);
+    offset += uint64_t(sent);
+  }
+}
+
+// an anonymous file that runs are written to side by side, created the
+// first time one is
+class SortSpill {
+  std::string directory;
+  int fd = -1;
+  uint64_t end = 0;
+  std::mutex lock;
+
+public:
+  explicit SortSpill(const std::string &temp_directory)
+      : directory(temp_directory) {}
+  ~SortSpill() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  SortSpill(const SortSpill &) = delete;
+  SortSpill &operator=(const SortSpill &) = delete;
+
+  // where bytes of run can be written
+  uint64_t reserve(uint64_t bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (fd < 0) {
+      std::string path = directory + "/parsejson-sort-XXXXXX";
+      fd = mkstemp(path.data());
+      if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "can't create spill file in " + directory);
+      }
+      unlink(path.c_str());
+    }
+    uint64_t offset = end;
+    end += bytes;
+    return offset;
+  }
+
+  int descriptor() const { return fd; }
+  uint64_t size() const { return end; }
+};
+
+struct SortRun {
+  uint64_t offset;
+  uint64_t bytes;
+};
+
+// writes entries, in order, to space reserved in the spill file
+class RunWriter {
+  SortSpill &spill;
+  uint64_t pos;
+  std::string staging;
+
+public:
+  static constexpr size_t staging_bytes = size_t(1) << 20;
+
+  RunWriter(SortSpill &file, uint64_t offset) : spill(file), pos(offset) {}
+
+  void add(const SortEntry &entry) {
+    uint32_t header[2] = {uint32_t(entry.key.size()), entry.length};
+    staging.append(reinterpret_cast<const char *>(header), sizeof(header));
+    staging.append(reinterpret_cast<const char *>(&entry.offset),
+                   sizeof(entry.offset));
+    staging += entry.key;
+    if (staging.size() >= staging_bytes) {
+      flush();
+    }
+  }
+
+  void flush() {
+    pwrite_all(spill.descriptor(), staging.data(), staging.size(), pos);
+    pos += staging.size();
+    staging.clear();
+  }
+};
+
+SortRun write_run(SortSpill &spill, const std::vector<SortEntry> &entries) {
+  uint64_t bytes = 0;
+  for (const SortEntry &entry : entries) {
+    bytes += spilled_header + entry.key.size();
+  }
+  SortRun run = {spill.reserve(bytes), bytes};
+  RunWriter writer(spill, run.offset);
+  for (const SortEntry &entry : entries) {
+    writer.add(entry);
+  }
+  writer.flush();
+  return run;
+}
+
+// reads a run back from the spill file, through a buffer
+class RunReader {
+  int fd;
+  uint64_t pos;
+  uint64_t end;
+  std::vector<char> buffer;
+  size_t at = 0;
+  size_t filled = 0;
+
+  // makes sure the next bytes of the run are buffered
+  void need(size_t bytes) {
+    if (filled - at >= bytes) {
+      return;
+    }
+    memmove(buffer.data(), buffer.data() + at, filled - at);
+    filled -= at;
+    at = 0;
+    if (buffer.size() < bytes) {
+      buffer.resize(bytes);
+    }
+    while (filled < bytes) {
+      size_t want = size_t(std::min<uint64_t>(buffer.size() - filled,
+                                              end - pos));
+      ssize_t got = pread(fd, buffer.data() + filled, want, off_t(pos));
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      if (got <= 0) {
+        throw std::system_error(got < 0 ? errno : EIO,
+                                std::generic_category(),
+                                "can't read spill file");
+      }
+      filled += size_t(got);
+      pos += uint64_t(got);
+    }
+  }
+
+public:
+  RunReader(int descriptor, const SortRun &run, size_t buffer_bytes)
+      : fd(descriptor), pos(run.offset), end(run.offset + run.bytes),
+        buffer(buffer_bytes) {}
+
+  bool next(SortEntry &entry) {
+    if (at == filled && pos == end) {
+      return false;
+    }
+    need(spilled_header);
+    uint32_t header[2];
+    memcpy(header, buffer.data() + at, sizeof(header));
+    memcpy(&entry.offset, buffer.data() + at + sizeof(header),
+           sizeof(entry.offset));
+    entry.length = header[1];
+    at += spilled_header;
+    need(header[0]);
+    entry.key.assign(buffer.data() + at, header[0]);
+    at += header[0];
+    return true;
+  }
+};
+
+// one of the sorted sequences being merged: a run in the spill file or, if
+// nothing was spilled, a vector of entries
+struct MergeSource {
+  std::unique_ptr<RunReader> reader;
+  std::vector<SortEntry> *entries = NULL;
+  size_t index = 0;
+  SortEntry current;
+
+  bool next() {
+    if (reader) {
+      return reader->next(current);
+    }
+    if (index == entries->size()) {
+      return false;
+    }
+    current = std::move((*entries)[index++]);
+    return true;
+  }
+};
+
+template <typename Sink>
+void merge_sources(std::vector<MergeSource> &sources, bool descending,
+                   Sink &&sink) {
+  auto after = [&](size_t a, size_t b) {
+    return entry_before(sources[b].current, sources[a].current, descending);
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heap(
+      after);
+  for (size_t i = 0; i < sources.size(); i++) {
+    if (sources[i].next()) {
+      heap.push(i);
+    }
+  }
+  while (!heap.empty()) {
+    size_t source = heap.top();
+    heap.pop();
+    sink(sources[source].current);
+    if (sources[source].next()) {
+      heap.push(source);
+    }
+  }
+}
+
+SortStats sort_jsonl(std::string_view jsonl, const std::string &key_pointer,
+                     int fd, const SortOptions &options) {
+  auto start = std::chrono::steady_clock::now();
+  Projection projection({key_pointer});
+  unsigned threads = std::max(options.threads, 1u);
+  size_t share = std::max<size_t>(options.memory_bytes / threads, 1);
+  bool descending = options.descending;
+  SortSpill spill(options.temp_directory);
+  std::vector<SortRun> runs;
+  std::mutex runs_lock;
+  std::vector<std::vector<SortEntry>> pending(threads);
+  std::atomic<size_t> records = 0;
+
+  auto sort_entries = [&](std::vector<SortEntry> &entries) {
+    std::sort(entries.begin(), entries.end(),
+              [&](const SortEntry &a, const SortEntry &b) {
+                return entry_before(a, b, descending);
+              });
+  };
+  auto spill_entries = [&](std::vector<SortEntry> &entries) {
+    sort_entries(entries);
+    SortRun run = write_run(spill, entries);
+    std::vector<SortEntry>().swap(entries);
+    std::lock_guard<std::mutex> guard(runs_lock);
+    runs.push_back(run);
+  };
+
+  std::vector<size_t> pending_keys(threads);
+  for_each_chunk(
+      jsonl, options.chunk_bytes, threads,
+      [&](unsigned worker, std::string_view chunk) {
+        std::vector<SortEntry> &entries = pending[worker];
+        std::vector<Field> fields;
+        size_t count = 0;
+        for_each_line(chunk, [&](std::string_view record) {
+          SortEntry entry;
+          entry.offset = uint64_t(record.data() - jsonl.data());
+          entry.length = uint32_t(record.size());
+          if (record.size() > UINT32_MAX) {
+            input_record_error(jsonl, record, "record too long");
+          }
+          projection.extract(record, fields, jsonl);
+          try {
+            append_sort_key(entry.key, fields[0]);
+          } catch (ParseError &e) {
+            input_record_error(jsonl, record, e.what());
+          }
+          pending_keys[worker] += key_bytes(entry.key);
+          entries.push_back(std::move(entry));
+          count++;
+          if (entries.capacity() * sizeof(SortEntry) + pending_keys[worker] >=
+              share) {
+            spill_entries(entries);
+            pending_keys[worker] = 0;
+          }
+        });
+        records += count;
+      });
+
+  // what's left is sorted in parallel, and spilled too if anything else was
+  bool in_memory = runs.empty();
+  run_on_threads(threads, [&](size_t worker) {
+    if (in_memory) {
+      sort_entries(pending[worker]);
+    } else if (!pending[worker].empty()) {
+      spill_entries(pending[worker]);
+    }
+  });
+
+  SortStats stats;
+  stats.records = records;
+  // merge buffers share the memory budget, which bounds how many runs are
+  // merged at once
+  size_t buffer_bytes = std::clamp<size_t>(options.memory_bytes / 16,
+                                           size_t(4) << 10, size_t(1) << 20);
+  size_t fan_in = std::max<size_t>(options.memory_bytes / buffer_bytes, 2);
+  std::sort(runs.begin(), runs.end(), [](const SortRun &a, const SortRun &b) {
+    return a.offset < b.offset;
+  });
+  stats.runs = runs.size();
+  while (runs.size() > fan_in) {
+    std::vector<SortRun> merged;
+    for (size_t first = 0; first < runs.size(); first += fan_in) {
+      size_t last = std::min(first + fan_in, runs.size());
+      if (last - first == 1) {
+        merged.push_back(runs[first]);
+        continue;
+      }
+      std::vector<MergeSource> sources(last - first);
+      SortRun out = {0, 0};
+      for (size_t i = first; i < last; i++) {
+        sources[i - first].reader = std::make_unique<RunReader>(
+            spill.descriptor(), runs[i], buffer_bytes);
+        out.bytes += runs[i].bytes;
+      }
+      out.offset = spill.reserve(out.bytes);
+      RunWriter writer(spill, out.offset);
+      merge_sources(sources, descending,
+                    [&](const SortEntry &entry) { writer.add(entry); });
+      writer.flush();
+      merged.push_back(out);
+      stats.runs++;
+    }
+    runs.swap(merged);
+    stats.merge_passes++;
+  }
+
+  std::vector<MergeSource> sources;
+  if (in_memory) {
+    for (std::vector<SortEntry> &entries : pending) {
+      sources.emplace_back();
+      sources.back().entries = &entries;
+    }
+  } else {
+    for (const SortRun &run : runs) {
+      sources.emplace_back();
+      sources.back().reader =
+          std::make_unique<RunReader>(spill.descriptor(), run, buffer_bytes);
+    }
+  }
+  static const char newline = '\n';
+  std::vector<iovec> gather;
+  auto send = [&] {
+    write_vectors(fd, gather.data(), gather.size());
+    gather.clear();
+  };
+  merge_sources(sources, descending, [&](const SortEntry &entry) {
+    char *record = const_cast<char *>(jsonl.data() + entry.offset);
+    size_t length = entry.length;
+    stats.bytes_out += length + 1;
+    if (entry.offset + length < jsonl.size() &&
+        jsonl[entry.offset + length] == '\n') {
+      gather.push_back({record, length + 1});
+    } else {
+      gather.push_back({record, length});
+      gather.push_back({const_cast<char *>(&newline), 1});
+    }
+    if (gather.size() >= 1024) {
+      send();
+    }
+  });
+  send();
+  stats.merge_passes += !in_memory;
+  stats.spilled_bytes = spill.size();
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  return stats;
+}
+
+} // namespace parsejson
@@ -0,0 +1,66 @@
+/*
+ * Sorting JSONL by a field, in bounded memory:
+ *
+ *   MappedFile input("events.jsonl");
+ *   SortOptions options;
+ *   options.memory_bytes = size_t(512) << 20;
+ *   sort_jsonl(input.bytes(), "/timestamp", STDOUT_FILENO, options);
+ *
+ * Only the sort key is pulled out of each record, with a Projection
+ * (jsonl.h), and what is sorted is (key, offset) pairs, not records. Workers
+ * take chunks of the input, collect pairs until their share of
+ * memory_bytes is used, sort them and write them out as a run to a spill
+ * file. If the input fits without spilling there is a single merge in memory.
+ * Otherwise the runs are merged, at most as many at a time as there is room
+ * for read buffers, in more than one pass if need be. Records are written
+ * out straight from the input, byte for byte, each ending in a newline
+ * (a carriage return before it is dropped, and blank lines are left out).
+ *
+ * Keys order by type first: missing, null, false, true, numbers (by value),
+ * strings (by their bytes, once unescaped), then objects and arrays (by their
+ * text). Records with equal keys keep their input order.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "jsonl.h"
+
+namespace parsejson {
+
+struct SortOptions {
+  // held by keys and offsets, and by merge buffers, across all threads.
+  // the input itself is mapped, not counted.
+  size_t memory_bytes = size_t(256) << 20;
+  unsigned threads = std::thread::hardware_concurrency();
+  // where the spill file goes. it is unlinked as soon as it is created.
+  std::string temp_directory = "/tmp";
+  bool descending = false;
+  size_t chunk_bytes = size_t(1) << 20;
+};
+
+struct SortStats {
+  size_t records = 0;
+  // runs written to the spill file, merge passes included
+  size_t runs = 0;
+  size_t merge_passes = 0;
+  size_t spilled_bytes = 0;
+  size_t bytes_out = 0;
+  double seconds = 0;
+};
+
+// the bytes of key, pulled out of a record, that sort as described above
+// when compared with memcmp
+void append_sort_key(std::string &out, const Field &key);
+
+// writes the records of jsonl to fd sorted by the value key_pointer selects.
+// throws ParseError for a bad record (with its byte offset in jsonl) or
+// pointer, and std::system_error if the spill file or fd can't be written.
+SortStats sort_jsonl(std::string_view jsonl, const std::string &key_pointer,
+                     int fd, const SortOptions &options = SortOptions());
+
+} // namespace parsejson
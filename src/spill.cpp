@@ -0,0 +1,86 @@
+#include "spill.h"
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace parsejson {
+
+SpillFileResource::SpillFileResource(const std::string &directory,
+                                     size_t chunk_bytes) {
+  size_t page = size_t(sysconf(_SC_PAGESIZE));
+  chunk_size = (chunk_bytes + page - 1) / page * page;
+  if (chunk_size == 0) {
+    chunk_size = page;
+  }
+  std::string path = directory + "/parsejson-spill-XXXXXX";
+  fd = mkstemp(path.data());
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "can't create spill file in " + directory);
+  }
+  // nobody else needs to find it, and this way it can't be left behind
+  unlink(path.c_str());
+}
+
+SpillFileResource::~SpillFileResource() {
+  for (Chunk &chunk : chunks) {
+    munmap(chunk.base, chunk.size);
+  }
+  close(fd);
+}
+
+void SpillFileResource::add_chunk(size_t min_bytes) {
+  size_t size = chunk_size;
+  if (min_bytes > size) {
+    size = (min_bytes + chunk_size - 1) / chunk_size * chunk_size;
+  }
+  if (ftruncate(fd, off_t(file_size + size)) != 0) {
+    throw std::bad_alloc();
+  }
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                    off_t(file_size));
+  if (base == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  if (!chunks.empty()) {
+    // the chunk being left behind is probably done with. get writeback going
+    // so its pages are clean, and cheap to reclaim, by the time they're cold.
+    Chunk &previous = chunks.back();
+    msync(previous.base, previous.size, MS_ASYNC);
+#ifdef MADV_COLD
+    madvise(previous.base, previous.size, MADV_COLD);
+#endif
+  }
+  chunks.push_back({static_cast<char *>(base), size});
+  file_size += size;
+  cursor = static_cast<char *>(base);
+  limit = cursor + size;
+}
+
+void *SpillFileResource::do_allocate(size_t bytes, size_t alignment) {
+  uintptr_t aligned =
+      (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+  if (!cursor || aligned + bytes > reinterpret_cast<uintptr_t>(limit)) {
+    // chunks are page aligned, which covers any alignment asked of us
+    add_chunk(bytes);
+    aligned = reinterpret_cast<uintptr_t>(cursor);
+  }
+  cursor = reinterpret_cast<char *>(aligned + bytes);
+  used += bytes;
+  return reinterpret_cast<void *>(aligned);
+}
+
+void SpillFileResource::evict() {
+  for (Chunk &chunk : chunks) {
+    msync(chunk.base, chunk.size, MS_ASYNC);
+    // for a shared file mapping this only drops our mapping of the pages;
+    // the contents stay in the page cache / file
+    madvise(chunk.base, chunk.size, MADV_DONTNEED);
+  }
+}
+
+} // namespace parsejson
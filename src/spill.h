@@ -0,0 +1,81 @@
+/*
+ * A memory_resource backed by a spill file, for documents whose parsed tree
+ * won't fit in RAM. Storage is carved out of chunks of a file mapped
+ * MAP_SHARED, so the kernel can write pages back and reclaim them under
+ * memory pressure, and fault them in again when they are touched. Items and
+ * strings are allocated exactly as they are on the heap, so parsing and
+ * traversal are unchanged:
+ *
+ *   Document doc = parse_document(
+ *       input, std::make_unique<SpillFileResource>("/var/tmp"));
+ *
+ * Allocation is monotonic: nothing is given back until the resource itself
+ * is destroyed, at which point the mappings are dropped and the file (which
+ * is unlinked as soon as it is created) goes with them. Handing the resource
+ * to the Document means teardown never pages the tree back in.
+ *
+ * The input needn't fit in RAM either: map it with MappedFile (jsonl.h) and
+ * parse it in place, and its pages are dropped and read back by the kernel
+ * just as the tree's are:
+ *
+ *   MappedFile file(path);
+ *   ParseBuffer input;
+ *   input.raw_json.borrow(file.bytes());
+ *   Document doc = parse_document(
+ *       input, std::make_unique<SpillFileResource>("/var/tmp"));
+ *
+ * The tree doesn't point into the text, so the file can be unmapped once
+ * parsing is done.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace parsejson {
+
+class SpillFileResource : public std::pmr::memory_resource {
+  struct Chunk {
+    char *base;
+    size_t size;
+  };
+
+  int fd = -1;
+  size_t chunk_size;
+  size_t file_size = 0;
+  std::vector<Chunk> chunks;
+  char *cursor = NULL;
+  char *limit = NULL;
+  size_t used = 0;
+
+  void add_chunk(size_t min_bytes);
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *, size_t, size_t) override {}
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+public:
+  // creates an anonymous spill file in directory. throws std::system_error
+  // if it can't.
+  explicit SpillFileResource(const std::string &directory,
+                             size_t chunk_bytes = size_t(64) << 20);
+  ~SpillFileResource();
+  SpillFileResource(const SpillFileResource &) = delete;
+  SpillFileResource &operator=(const SpillFileResource &) = delete;
+
+  // starts writeback of everything allocated so far and drops it from this
+  // process's resident set. it's read back from the file on next touch.
+  void evict();
+
+  // bytes handed out, and bytes of file mapped to hand them out from
+  size_t used_bytes() const { return used; }
+  size_t mapped_bytes() const { return file_size; }
+};
+
+} // namespace parsejson
@@ -0,0 +1,124 @@
+#include "structural.h"
+#include "jsonl.h"
+#include "threads.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace parsejson {
+
+// the offsets of a chunk's tokens. grown ahead so that a block's worth can
+// be written without checking for room.
+struct TokenList {
+  std::vector<uint64_t> offsets;
+  size_t count = 0;
+
+  // adds the offset of each set bit of a block starting at base
+  void append(uint64_t base, uint64_t bits) {
+    if (offsets.size() - count < 64) {
+      offsets.resize(std::max<size_t>(offsets.size() * 2, 1024));
+    }
+    uint64_t *at = offsets.data() + count;
+    count += size_t(__builtin_popcountll(bits));
+    while (bits) {
+      *at++ = base + uint64_t(__builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+};
+
+// the tokens of one chunk, under each assumption about whether it starts
+// inside a string
+struct ChunkTokens {
+  TokenList outside;
+  TokenList inside;
+  bool odd_quotes = false;
+};
+
+void scan_chunk(std::string_view json, size_t begin, size_t end,
+                bool known_outside, ChunkTokens &chunk) {
+  size_t run = 0;
+  while (run < begin && json[begin - 1 - run] == '\\') {
+    run++;
+  }
+  uint64_t escape_carry = run & 1;
+  // whether the byte before the chunk was part of a number or literal, so
+  // that the chunk's first byte doesn't start another
+  char before = begin ? json[begin - 1] : ' ';
+  uint64_t scalar_carry = !std::strchr("{}[]:, \n\t\r\"", before);
+  uint64_t in_string = 0;
+  char padded[64];
+  for (size_t at = begin; at < end; at += 64) {
+    const char *block = json.data() + at;
+    if (end - at < 64) {
+      std::memset(padded, ' ', sizeof(padded));
+      std::memcpy(padded, block, end - at);
+      block = padded;
+    }
+    BlockMasks masks = classify_block(block);
+    uint64_t quotes = masks.quote & ~escaped_bytes(masks.backslash,
+                                                   escape_carry);
+    uint64_t strings = prefix_xor(quotes) ^ in_string;
+    in_string = uint64_t(int64_t(strings) >> 63);
+    uint64_t scalar = ~(masks.punctuation | masks.whitespace);
+    uint64_t plain = scalar & ~quotes;
+    uint64_t starts = scalar & ~(plain << 1 | scalar_carry);
+    scalar_carry = plain >> 63;
+    uint64_t candidates = masks.punctuation | starts;
+    // string contents and closing quotes, if the chunk starts outside a
+    // string. if it starts inside one, it's the complement.
+    uint64_t within = strings ^ quotes;
+    chunk.outside.append(at, candidates & ~within);
+    if (!known_outside) {
+      chunk.inside.append(at, candidates & within);
+    }
+  }
+  chunk.odd_quotes = in_string != 0;
+}
+
+std::vector<uint64_t> index_structurals(std::string_view json,
+                                        const StructuralOptions &options) {
+  size_t chunk_count =
+      std::clamp<size_t>(json.size() / std::max<size_t>(
+                                           options.min_chunk_bytes, 64),
+                         1, std::max(options.threads, 1u));
+  size_t chunk_bytes = ((json.size() / chunk_count) + 63) & ~size_t(63);
+  std::vector<ChunkTokens> chunks(chunk_count);
+  if (chunk_count == 1) {
+    scan_chunk(json, 0, json.size(), true, chunks[0]);
+    if (chunks[0].odd_quotes) {
+      throw ParseError("unterminated string");
+    }
+    chunks[0].outside.offsets.resize(chunks[0].outside.count);
+    return std::move(chunks[0].outside.offsets);
+  }
+  run_on_threads(unsigned(chunk_count), [&](size_t i) {
+    size_t begin = std::min(i * chunk_bytes, json.size());
+    size_t end = i + 1 == chunk_count ? json.size()
+                                      : std::min(begin + chunk_bytes,
+                                                 json.size());
+    scan_chunk(json, begin, end, i == 0, chunks[i]);
+  });
+
+  // which list each chunk keeps follows from the quotes before it
+  std::vector<TokenList *> kept(chunk_count);
+  std::vector<size_t> offsets(chunk_count + 1);
+  bool in_string = false;
+  for (size_t i = 0; i < chunk_count; i++) {
+    kept[i] = in_string ? &chunks[i].inside : &chunks[i].outside;
+    offsets[i + 1] = offsets[i] + kept[i]->count;
+    in_string ^= chunks[i].odd_quotes;
+  }
+  if (in_string) {
+    throw ParseError("unterminated string");
+  }
+  std::vector<uint64_t> tokens(offsets[chunk_count]);
+  run_on_threads(unsigned(chunk_count), [&](size_t i) {
+    const uint64_t *first = kept[i]->offsets.data();
+    std::copy(first, first + kept[i]->count, tokens.begin() + offsets[i]);
+    chunks[i] = ChunkTokens();
+  });
+  return tokens;
+}
+
+} // namespace parsejson
@@ -0,0 +1,186 @@
+/*
+ * A structural index of a JSON document: the offset of every token in it, as
+ * a first pass for readers that would rather jump from token to token than
+ * look at every byte:
+ *
+ *   std::vector<uint64_t> tokens = index_structurals(json);
+ *   for (uint64_t at : tokens) {
+ *     switch (json[at]) { case '{': ... case '"': ... default: ... }
+ *   }
+ *
+ * The tokens are the characters { } [ ] : and , outside strings, the opening
+ * quote of every string and the first byte of every number, true, false and
+ * null. Nothing more is checked than that the last string is closed; finding
+ * out whether the tokens make a valid document is for whoever reads them.
+ *
+ * The input is looked at 64 bytes at a time, each byte class (quote,
+ * backslash, punctuation, whitespace) becoming a 64-bit mask, with SSE2 on
+ * x86-64 and a table elsewhere. Which quotes are escaped and which bytes are
+ * inside strings are worked out on the masks with a few shifts and adds.
+ *
+ * A big input is split into a chunk per thread, scanned at once. Whether a
+ * chunk starts inside a string depends on every quote before it, so each
+ * chunk is scanned both ways in the one pass: inside-string bytes are the
+ * complement under the other assumption, so every token-like position falls
+ * in exactly one of two lists. Whether a backslash escapes a chunk's first
+ * byte is found by counting the backslashes just before it. Once every chunk
+ * knows how many quotes it holds, a pass over the chunks (not the bytes)
+ * says which list each one keeps, and the kept lists are copied together.
+ *
+ * The mask helpers are inline here for skip_value() (jsonl.h), which uses
+ * them to jump over a string or container without a structural index.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// define as 0 to classify bytes without SSE2 where it would be used
+#ifndef PARSER_SSE2
+#if defined(__SSE2__)
+#define PARSER_SSE2 1
+#else
+#define PARSER_SSE2 0
+#endif
+#endif
+
+#if PARSER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace parsejson {
+
+// bit i of each mask is set if byte i of a 64-byte block is one of these
+struct BlockMasks {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t punctuation; // { } [ ] : ,
+  uint64_t whitespace;
+  uint64_t open;  // { [
+  uint64_t close; // } ]
+};
+
+#if PARSER_SSE2
+
+inline BlockMasks classify_block(const char *block) {
+  BlockMasks masks = {0, 0, 0, 0, 0, 0};
+  for (int part = 0; part < 4; part++) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + part * 16));
+    auto is = [&](char c) { return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)); };
+    __m128i open = _mm_or_si128(is('{'), is('['));
+    __m128i close = _mm_or_si128(is('}'), is(']'));
+    __m128i punctuation = _mm_or_si128(_mm_or_si128(open, close),
+                                       _mm_or_si128(is(':'), is(',')));
+    __m128i whitespace = _mm_or_si128(_mm_or_si128(is(' '), is('\n')),
+                                      _mm_or_si128(is('\t'), is('\r')));
+    auto bits = [&](__m128i found) {
+      return uint64_t(uint16_t(_mm_movemask_epi8(found))) << (part * 16);
+    };
+    masks.quote |= bits(is('"'));
+    masks.backslash |= bits(is('\\'));
+    masks.punctuation |= bits(punctuation);
+    masks.whitespace |= bits(whitespace);
+    masks.open |= bits(open);
+    masks.close |= bits(close);
+  }
+  return masks;
+}
+
+#else
+
+inline BlockMasks classify_block(const char *block) {
+  BlockMasks masks = {0, 0, 0, 0, 0, 0};
+  for (int i = 0; i < 64; i++) {
+    uint64_t bit = uint64_t(1) << i;
+    switch (block[i]) {
+    case '"':
+      masks.quote |= bit;
+      break;
+    case '\\':
+      masks.backslash |= bit;
+      break;
+    case '{':
+    case '[':
+      masks.open |= bit;
+      masks.punctuation |= bit;
+      break;
+    case '}':
+    case ']':
+      masks.close |= bit;
+      masks.punctuation |= bit;
+      break;
+    case ':':
+    case ',':
+      masks.punctuation |= bit;
+      break;
+    case ' ':
+    case '\n':
+    case '\t':
+    case '\r':
+      masks.whitespace |= bit;
+      break;
+    }
+  }
+  return masks;
+}
+
+#endif
+
+// which bytes of a block, other than backslashes, are escaped by a
+// backslash, given its backslash mask. escape_carry is 1 if the block's
+// first byte is escaped by the previous block's last backslash, and is left
+// saying the same for the next block.
+inline uint64_t escaped_bytes(uint64_t backslash, uint64_t &escape_carry) {
+  if (!backslash) {
+    uint64_t escaped = escape_carry;
+    escape_carry = 0;
+    return escaped;
+  }
+  const uint64_t even_bits = 0x5555555555555555ull;
+  // a run of backslashes escapes the byte after it if it's of odd length,
+  // which is if it starts on an even bit and ends on an odd one or the other
+  // way round. adding each run's first bit to the run carries it to the
+  // byte after the run. a run carried in from the previous block starts
+  // at bit -1, which is odd.
+  uint64_t starts = backslash & ~(backslash << 1);
+  uint64_t even_start_bits = even_bits ^ escape_carry;
+  uint64_t even_starts = starts & even_start_bits;
+  uint64_t odd_starts = starts & ~even_start_bits;
+  uint64_t even_ends = (backslash + even_starts) & ~backslash;
+  uint64_t odd_ends;
+  bool carried_out = __builtin_add_overflow(backslash, odd_starts, &odd_ends);
+  odd_ends = (odd_ends | escape_carry) & ~backslash;
+  escape_carry = carried_out;
+  return (even_ends & ~even_bits) | (odd_ends & even_bits);
+}
+
+// bit i is the parity of bits 0 to i of bits, so quote masks become masks of
+// what is between quotes (opening quotes included, closing ones not)
+inline uint64_t prefix_xor(uint64_t bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+struct StructuralOptions {
+  unsigned threads = std::thread::hardware_concurrency();
+  // inputs are split no finer than this
+  size_t min_chunk_bytes = size_t(1) << 20;
+};
+
+// the offset of every token in json, in order. throws ParseError if json
+// ends inside a string.
+std::vector<uint64_t>
+index_structurals(std::string_view json,
+                  const StructuralOptions &options = StructuralOptions());
+
+} // namespace parsejson
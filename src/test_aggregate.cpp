@@ -0,0 +1,134 @@
+#include "aggregate.cpp"
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "writer.cpp"
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace parsejson;
+
+int main() {
+  assert(parse_aggregate("count").op == agg_count);
+  assert(parse_aggregate("count").pointer.empty());
+  assert(parse_aggregate("sum(/a/b)").op == agg_sum);
+  assert(parse_aggregate("sum(/a/b)").pointer == "/a/b");
+  assert(parse_aggregate("avg(/x)").label() == "avg(/x)");
+  assert(parse_aggregate("count(/x)").label() == "count(/x)");
+  for (const char *bad : {"", "sum", "sum()", "sum(x)", "total(/x)",
+                          "count(/x"}) {
+    bool threw = false;
+    try {
+      parse_aggregate(bad);
+    } catch (std::invalid_argument &) {
+      threw = true;
+    }
+    assert(threw);
+  }
+
+  std::string jsonl =
+      "{\"country\": \"US\", \"amount\": 10}\n"
+      "{\"amount\": 2.5, \"country\": \"\\u0055S\"}\n"
+      "\n"
+      "{\"country\": \"DE\", \"amount\": \"n/a\"}\r\n"
+      "{\"country\": \"DE\", \"amount\": -4e0}\n"
+      "{\"amount\": 1}\n"
+      "{\"country\": null, \"amount\": null}\n"
+      "{\"country\": \"FR\"}";
+  std::vector<Aggregate> aggregates = {
+      parse_aggregate("count"), parse_aggregate("count(/amount)"),
+      parse_aggregate("sum(/amount)"), parse_aggregate("min(/amount)"),
+      parse_aggregate("max(/amount)"), parse_aggregate("avg(/amount)")};
+  AggregateOptions options;
+  options.threads = 1;
+  AggregateResult result =
+      aggregate_jsonl(jsonl, {"/country"}, aggregates, options);
+  assert(result.stats.records == 7);
+  assert(result.stats.bytes == jsonl.size());
+  assert(result.stats.groups == 4);
+  assert(result.stats.table_bytes > 0);
+  assert(format_aggregate(result) ==
+         "{\"/country\":\"DE\",\"count\":2,\"count(/amount)\":2,"
+         "\"sum(/amount)\":-4,\"min(/amount)\":-4,\"max(/amount)\":-4,"
+         "\"avg(/amount)\":-4}\n"
+         "{\"/country\":\"FR\",\"count\":1,\"count(/amount)\":0,"
+         "\"sum(/amount)\":null,\"min(/amount)\":null,\"max(/amount)\":null,"
+         "\"avg(/amount)\":null}\n"
+         "{\"/country\":\"US\",\"count\":2,\"count(/amount)\":2,"
+         "\"sum(/amount)\":12.5,\"min(/amount)\":2.5,\"max(/amount)\":10,"
+         "\"avg(/amount)\":6.25}\n"
+         "{\"/country\":null,\"count\":2,\"count(/amount)\":1,"
+         "\"sum(/amount)\":1,\"min(/amount)\":1,\"max(/amount)\":1,"
+         "\"avg(/amount)\":1}\n");
+
+  // numbers group by value, and several keys make a compound group
+  result = aggregate_jsonl("{\"a\": 1, \"b\": [1, 2]}\n"
+                           "{\"a\": 1.0, \"b\": [1, 2]}\n"
+                           "{\"a\": 10e-1, \"b\": [1,2]}\n",
+                           {"/a", "/b"}, {parse_aggregate("count")}, options);
+  assert(result.rows.size() == 2);
+  assert(result.rows[0].key == std::vector<std::string>({"1", "[1, 2]"}));
+  assert(result.rows[0].values[0] == 2);
+  assert(result.rows[1].key == std::vector<std::string>({"1", "[1,2]"}));
+
+  // no grouping is one group for everything
+  result = aggregate_jsonl(jsonl, {}, {parse_aggregate("sum(/amount)")},
+                           options);
+  assert(result.rows.size() == 1);
+  assert(result.rows[0].key.empty());
+  assert(result.rows[0].values[0] == 9.5);
+
+  // a bad record is reported with where it starts
+  bool threw = false;
+  try {
+    aggregate_jsonl("{\"country\": \"US\"}\n{\"country\": \"US}\n",
+                    {"/country"}, {parse_aggregate("count")}, options);
+  } catch (ParseError &e) {
+    threw = std::string(e.what()).find("record at byte 18") == 0;
+  }
+  assert(threw);
+
+  // many small chunks on several threads, with groups split across them,
+  // merge to the same totals
+  std::string many;
+  for (int i = 0; i < 20000; i++) {
+    many += "{\"k\": \"g" + std::to_string(i % 37) + "\", \"pad\": [\"" +
+            std::string(size_t(i % 50), 'p') + "\"], \"n\": " +
+            std::to_string(i) + "}\n";
+  }
+  options.chunk_bytes = 4096;
+  AggregateResult serial = aggregate_jsonl(
+      many, {"/k"}, {parse_aggregate("count"), parse_aggregate("sum(/n)")},
+      options);
+  options.threads = 4;
+  AggregateResult parallel = aggregate_jsonl(
+      many, {"/k"}, {parse_aggregate("count"), parse_aggregate("sum(/n)")},
+      options);
+  assert(serial.rows.size() == 37);
+  assert(parallel.stats.records == 20000);
+  assert(format_aggregate(serial) == format_aggregate(parallel));
+  double total = 0;
+  for (const AggregateRow &row : parallel.rows) {
+    total += row.values[1];
+  }
+  assert(total == 19999.0 * 20000 / 2);
+
+  // sampled and limited scans aggregate just the records they pick
+  options.scan.every = 1000;
+  result = aggregate_jsonl(many, {}, {parse_aggregate("sum(/n)")}, options);
+  assert(result.stats.records == 20 && !result.stats.stopped);
+  assert(result.rows[0].values[0] == 1000.0 * 19 * 20 / 2);
+  options.scan = ScanControl();
+  options.scan.max_matches = 3;
+  result = aggregate_jsonl(many, {"/k"}, {parse_aggregate("sum(/n)")},
+                           options);
+  assert(result.stats.records == 3 && result.stats.stopped);
+  assert(result.rows.size() == 3 && result.rows[2].values[0] == 2);
+  assert(result.stats.bytes == many.find("{\"k\": \"g3\""));
+  return 0;
+}
@@ -0,0 +1,156 @@
+#include "binary.cpp"
+#include "parsejson.cpp"
+#include "pull.cpp"
+#include "writer.cpp"
+#include <cassert>
+#include <string>
+
+using namespace parsejson;
+
+std::string bytes(std::initializer_list<int> values) {
+  std::string out;
+  for (int value : values) {
+    out.push_back(char(value));
+  }
+  return out;
+}
+
+JSONItem *parse(const std::string &json) {
+  ParseBuffer input;
+  input.raw_json = json;
+  return parse_json(input);
+}
+
+template <typename Fn> bool rejects(Fn fn) {
+  try {
+    fn();
+  } catch (ParseError &) {
+    return true;
+  }
+  return false;
+}
+
+std::string cbor_json(const std::string &data) {
+  std::string text;
+  JSONWriter writer(text);
+  cbor_to_json(data, writer);
+  writer.flush();
+  return text;
+}
+
+int main() {
+  // exact encodings of a small document
+  JSONItem *small = parse("{\"a\": [1, -1, 1.5, \"x\", true, null, 0.1]}");
+  assert(to_msgpack(small) ==
+         bytes({0x81, 0xa1, 'a', 0x97, 0x01, 0xff, 0xca, 0x3f, 0xc0, 0, 0,
+                0xa1, 'x', 0xc3, 0xc0, 0xcb, 0x3f, 0xb9, 0x99, 0x99, 0x99,
+                0x99, 0x99, 0x9a}));
+  assert(to_cbor(small) ==
+         bytes({0xa1, 0x61, 'a', 0x87, 0x01, 0x20, 0xfa, 0x3f, 0xc0, 0, 0,
+                0x61, 'x', 0xf5, 0xf6, 0xfb, 0x3f, 0xb9, 0x99, 0x99, 0x99,
+                0x99, 0x99, 0x9a}));
+  // streamed, container sizes aren't known up front
+  ParseBuffer input;
+  input.raw_json = "{\"a\": [1, -1]}";
+  assert(json_to_msgpack(input) ==
+         bytes({0xdf, 0, 0, 0, 1, 0xa1, 'a', 0xdd, 0, 0, 0, 2, 0x01, 0xff}));
+  input.pos = 0;
+  assert(json_to_cbor(input) ==
+         bytes({0xbf, 0x61, 'a', 0x9f, 0x01, 0x20, 0xff, 0xff}));
+  destroy_json(small);
+
+  // everything survives a round trip through either format, by either route
+  std::string json = "{\"empty\": {}, \"none\": [], \"numbers\": [0, 127, "
+                     "128, 255, 65536, -32, -33, -129, -40000, 4294967296, "
+                     "-1099511627776, 1e300, -0.5, 0.1, 3.25], "
+                     "\"deep\": [[[[{\"x\": [[]]}]]]], \"long\": \"" +
+                     std::string(300, 'L') + "\", \"longer\": \"" +
+                     std::string(70000, 'M') + "\", \"many\": [";
+  for (int i = 0; i < 70000; i++) {
+    json += (i ? "," : "") + std::to_string(i % 300);
+  }
+  json += "], \"wide\": {";
+  for (int i = 0; i < 40; i++) {
+    json += (i ? ",\"k" : "\"k") + std::to_string(i) + "\": \"v\\n\"";
+  }
+  json += "}, \"" + std::string(40, 'K') + "\": false}";
+  JSONItem *tree = parse(json);
+  std::string expected = to_json(tree);
+  for (int format = 0; format < 2; format++) {
+    std::string packed = format ? to_cbor(tree) : to_msgpack(tree);
+    input.raw_json = json;
+    input.pos = 0;
+    input.depth = 0;
+    std::string streamed =
+        format ? json_to_cbor(input) : json_to_msgpack(input);
+    for (const std::string &data : {packed, streamed}) {
+      JSONItem *copy = format ? parse_cbor(data) : parse_msgpack(data);
+      assert(to_json(copy) == expected);
+      destroy_json(copy);
+      std::string text;
+      JSONWriter writer(text);
+      if (format) {
+        cbor_to_json(data, writer);
+      } else {
+        msgpack_to_json(data, writer);
+      }
+      writer.flush();
+      assert(text == expected);
+    }
+  }
+  destroy_json(tree);
+
+  // integers keep their precision on the way to JSON
+  assert(cbor_json(bytes({0x1b, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                          0xff})) == "18446744073709551615");
+  assert(cbor_json(bytes({0x3b, 0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                          0xff})) == "-9223372036854775808");
+  // half floats, tags, undefined, indefinite strings and byte strings
+  assert(cbor_json(bytes({0x83, 0xf9, 0x3c, 0x00, 0xf9, 0x7b, 0xff, 0xf9,
+                          0x80, 0x00})) == "[1,65504,-0]");
+  assert(cbor_json(bytes({0xc1, 0x1a, 0x51, 0x4b, 0x67, 0xb0})) ==
+         "1363896240");
+  assert(cbor_json(bytes({0x82, 0xf7, 0x7f, 0x61, 'a', 0x62, 'b', 'c',
+                          0xff})) == "[null,\"abc\"]");
+  assert(cbor_json(bytes({0xa1, 0x42, 'k', 'k', 0x40})) == "{\"kk\":\"\"}");
+
+  // malformed or unsupported input
+  for (const std::string &data :
+       {std::string(), bytes({0x92, 0x01}), bytes({0xa3, 'a'}),
+        bytes({0x01, 0x02}), bytes({0x81, 0x01, 0x01}), bytes({0xc1}),
+        bytes({0xd4, 0x01, 0x01}), bytes({0x81, 0xa1, 'a'})}) {
+    assert(rejects([&] { destroy_json(parse_msgpack(data)); }));
+  }
+  for (const std::string &data :
+       {std::string(), bytes({0x82, 0x01}), bytes({0x9f, 0x01}),
+        bytes({0x63, 'a'}), bytes({0xa1, 0x01, 0x01}), bytes({0xf0}),
+        bytes({0x1c}), bytes({0x7f, 0x41, 'a', 0xff}), bytes({0x01, 0x01}),
+        bytes({0x5b, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff})}) {
+    assert(rejects([&] { destroy_json(parse_cbor(data)); }));
+  }
+  // JSON has no NaN or infinity, so they're rejected like any other
+  // unsupported input, whether read into a tree or straight to text
+  for (const std::string &data :
+       {bytes({0xca, 0x7f, 0xc0, 0x00, 0x00}),
+        bytes({0xcb, 0x7f, 0xf0, 0, 0, 0, 0, 0, 0}),
+        bytes({0x91, 0xcb, 0xff, 0xf0, 0, 0, 0, 0, 0, 0})}) {
+    assert(rejects([&] { destroy_json(parse_msgpack(data)); }));
+    std::string text;
+    JSONWriter writer(text);
+    assert(rejects([&] { msgpack_to_json(data, writer); }));
+  }
+  for (const std::string &data :
+       {bytes({0xf9, 0x7e, 0x00}), bytes({0xf9, 0xfc, 0x00}),
+        bytes({0xfa, 0x7f, 0x80, 0x00, 0x00}),
+        bytes({0x81, 0xfb, 0x7f, 0xf8, 0, 0, 0, 0, 0, 0})}) {
+    assert(rejects([&] { destroy_json(parse_cbor(data)); }));
+    assert(rejects([&] { cbor_json(data); }));
+  }
+  std::string deep(2000, char(0x91));
+  deep.push_back(char(0xc0));
+  assert(rejects([&] { destroy_json(parse_msgpack(deep)); }));
+  std::string tagged(100000, char(0xc1));
+  tagged.push_back(char(0x01));
+  assert(rejects([&] { destroy_json(parse_cbor(tagged)); }));
+  return 0;
+}
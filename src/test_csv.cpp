@@ -0,0 +1,89 @@
+#include "csv.cpp"
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "writer.cpp"
+#include <cassert>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace parsejson;
+
+std::string export_to_string(std::string_view jsonl,
+                             const std::vector<std::string> &columns,
+                             const CsvOptions &options) {
+  std::string path = "/tmp/parsejson-csv-" + std::to_string(getpid());
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  ExportStats stats = export_csv(jsonl, columns, fd, options);
+  std::string out(size_t(lseek(fd, 0, SEEK_END)), '\0');
+  ssize_t got = pread(fd, out.data(), out.size(), 0);
+  assert(got == ssize_t(out.size()));
+  assert(stats.bytes_out == out.size());
+  close(fd);
+  unlink(path.c_str());
+  return out;
+}
+
+int main() {
+  std::string jsonl =
+      "{\"id\": 1, \"name\": \"plain\", \"amount\": 2.50, \"ok\": true}\n"
+      "{\"name\": \"comma, \\\"quoted\\\"\", \"id\": 2, \"amount\": null}\n"
+      "\n"
+      "{\"id\": 3, \"name\": \"line\\nbreak\", \"amount\": {\"a\": [1]}}\r\n"
+      "{\"id\": 4, \"name\": \"tab\\there\"}";
+  std::vector<std::string> columns = {"/id", "/name", "/amount", "/ok"};
+  CsvOptions options;
+  options.threads = 1;
+  assert(export_to_string(jsonl, columns, options) ==
+         "/id,/name,/amount,/ok\n"
+         "1,plain,2.50,true\n"
+         "2,\"comma, \"\"quoted\"\"\",,\n"
+         "3,\"line\nbreak\",\"{\"\"a\"\": [1]}\",\n"
+         "4,tab\there,,\n");
+  options.delimiter = '\t';
+  options.header = false;
+  assert(export_to_string(jsonl, columns, options) ==
+         "1\tplain\t2.50\ttrue\n"
+         "2\t\"comma, \"\"quoted\"\"\"\t\t\n"
+         "3\t\"line\nbreak\"\t\"{\"\"a\"\": [1]}\"\t\n"
+         "4\t\"tab\there\"\t\t\n");
+
+  // many small chunks on several threads come out the same, and in order
+  std::string many;
+  for (int i = 0; i < 20000; i++) {
+    many += "{\"n\": " + std::to_string(i) + ", \"pad\": [\"" +
+            std::string(size_t(i % 50), 'p') + "\"], \"s\": \"v" +
+            std::to_string(i) + "\"}\n";
+  }
+  options = CsvOptions();
+  options.threads = 1;
+  std::string serial = export_to_string(many, {"/s", "/n"}, options);
+  options.threads = 8;
+  options.chunk_bytes = 4096;
+  assert(export_to_string(many, {"/s", "/n"}, options) == serial);
+
+  // sampled and limited exports go through the records in order
+  options.scan.every = 1000;
+  assert(export_to_string(many, {"/n"}, options) ==
+         "/n\n0\n1000\n2000\n3000\n4000\n5000\n6000\n7000\n8000\n9000\n"
+         "10000\n11000\n12000\n13000\n14000\n15000\n16000\n17000\n18000\n"
+         "19000\n");
+  options.scan = ScanControl();
+  options.scan.max_matches = 3;
+  assert(export_to_string(many, {"/n"}, options) == "/n\n0\n1\n2\n");
+  options.scan = ScanControl();
+
+  // a bad record says where it is
+  std::string bad = "{\"n\": 1}\n{\"n\" 2}\n";
+  try {
+    export_to_string(bad, {"/n"}, options);
+    assert(false);
+  } catch (ParseError &e) {
+    assert(std::string(e.what()).find("byte 9") != std::string::npos);
+  }
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include "edit.cpp"
+#include "parsejson.cpp"
+#include "writer.cpp"
+#include <cassert>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace parsejson;
+
+std::string reparsed(const std::string &text) {
+  ParseBuffer input;
+  input.raw_json = text;
+  Document doc = parse_document(input);
+  return to_json(doc.root());
+}
+
+void preorder(JSONItem *item, std::vector<JSONItem *> &items) {
+  for (; item; item = item->next) {
+    items.push_back(item);
+#if !PARSER_LEAN_NODES
+    assert(!item->next || item->next->prev == item);
+#endif
+    preorder(item->child, items);
+  }
+}
+
+// the tree is the one parsing the text afresh gives, and every span holds
+// its item's text
+void check(const EditableDocument &doc) {
+  assert(to_json(doc.root()) == reparsed(doc.text()));
+  std::vector<JSONItem *> items;
+  preorder(doc.root(), items);
+  assert(items.size() == doc.spans().size());
+  for (size_t i = 0; i < items.size(); i++) {
+    const SourceSpan &span = doc.spans()[i];
+    assert(span.item == items[i]);
+    assert(span.end <= doc.text().size());
+    assert(to_json(span.item) ==
+           reparsed(doc.text().substr(span.begin, span.end - span.begin)));
+  }
+}
+
+int main() {
+  std::string text = "{\"name\": \"widget\", \"sizes\": [1, 22, 333],\n"
+                     " \"nested\": {\"a\": {\"b\": [true, null]}}, "
+                     "\"a long member name that is not inline\": 7}";
+  EditableDocument doc(text);
+  check(doc);
+  assert(doc.spans()[0].begin == 0 && doc.spans()[0].end == text.size());
+
+  // a digit typed into a number re-parses just the number
+  size_t at = doc.text().find("22");
+  JSONItem *sizes = doc.root()->child->next;
+  EditResult result = doc.apply({at + 1, 0, "5"});
+  assert(!result.full && result.reparsed->type == j_number);
+  assert(result.reparsed->double_val == 252 && result.parsed_bytes == 3);
+  assert(doc.root()->child->next == sizes);
+  assert(sizes->child->next == result.reparsed);
+  check(doc);
+
+  // a string changed in place keeps its member name
+  at = doc.text().find("widget");
+  result = doc.apply({at, 6, "gadget\\n"});
+  assert(!result.full && result.reparsed->string_val == "gadget\n");
+  assert(result.reparsed->name == "name");
+  assert(doc.root()->child == result.reparsed);
+  check(doc);
+
+  // a new element doesn't fit in the number it was typed after, so the array
+  // around it is parsed again
+  at = doc.text().find("333");
+  result = doc.apply({at + 3, 0, ", 4"});
+  assert(!result.full && result.reparsed->type == j_array);
+  assert(result.reparsed->name == "sizes");
+  assert(doc.parse_error().empty());
+  check(doc);
+
+  // the number tried first fails, but the array around it takes the edit
+  EditableDocument pair("[1,2]");
+  result = pair.apply({2, 0, ",3"});
+  assert(!result.full && pair.text() == "[1,3,2]");
+  assert(pair.root() && pair.parse_error().empty());
+  check(pair);
+
+  // so is an object whose member name changes
+  at = doc.text().find("\"b\"");
+  result = doc.apply({at + 1, 1, "renamed"});
+  assert(!result.full && result.reparsed->type == j_object);
+  assert(result.reparsed->child->name == "renamed");
+  check(doc);
+
+  // deleting a whole member, long name and all
+  at = doc.text().find(", \"a long");
+  result = doc.apply({at, doc.text().size() - 1 - at, ""});
+  assert(!result.full && result.reparsed == doc.root());
+  check(doc);
+
+  // space before the root is taken into its span's text, and then is
+  // outside every span
+  result = doc.apply({0, 0, "  "});
+  assert(!result.full && result.reparsed == doc.root());
+  assert(doc.spans()[0].begin == 2);
+  result = doc.apply({0, 0, "\n"});
+  assert(result.full);
+  check(doc);
+
+  // an edit that breaks the document drops the tree until one mends it
+  at = doc.text().find("true");
+  bool threw = false;
+  try {
+    doc.apply({at, 0, "\""});
+  } catch (ParseError &) {
+    threw = true;
+  }
+  assert(threw && !doc.root() && doc.spans().empty());
+  assert(!doc.parse_error().empty());
+  result = doc.apply({at, 1, ""});
+  assert(result.full && doc.root() && doc.parse_error().empty());
+  check(doc);
+
+  threw = false;
+  try {
+    doc.apply({doc.text().size(), 1, ""});
+  } catch (std::out_of_range &) {
+    threw = true;
+  }
+  assert(threw);
+
+  threw = false;
+  try {
+    EditableDocument broken("[1, 2");
+  } catch (ParseError &) {
+    threw = true;
+  }
+  assert(threw);
+
+  // random edits, many of which break the text for a while, always leave
+  // the tree the text parses to
+  const char *pieces[] = {"1", "-", "0.5", "\"", "x", "\\", ",", ":", "[",
+                          "]", "{", "}", " ", "\n", "true", "null",
+                          "\"k\": 2", "[3, {\"q\": \"r\"}]", "\"\\u00e9\""};
+  std::mt19937 random(7);
+  size_t valid = 0;
+  size_t partial = 0;
+  for (int round = 0; round < 20000; round++) {
+    const std::string &now = doc.text();
+    size_t offset = random() % (now.size() + 1);
+    size_t removed = random() % 3 == 0
+                         ? std::min<size_t>(random() % 4, now.size() - offset)
+                         : 0;
+    std::string inserted =
+        removed && random() % 2 ? "" : pieces[random() % std::size(pieces)];
+    std::string expected = now;
+    expected.replace(offset, removed, inserted);
+    bool parses = true;
+    try {
+      reparsed(expected);
+    } catch (ParseError &) {
+      parses = false;
+    }
+    try {
+      result = doc.apply({offset, removed, inserted});
+      assert(parses);
+      valid++;
+      partial += !result.full;
+      check(doc);
+    } catch (ParseError &) {
+      assert(!parses && !doc.root());
+    }
+    assert(doc.text() == expected);
+    // keep the text small and mostly valid
+    if (doc.text().size() > 400 || (!doc.root() && random() % 4 == 0)) {
+      doc.apply({0, doc.text().size(), text});
+    }
+  }
+  assert(valid > 1000 && partial > valid / 2);
+}
@@ -0,0 +1,93 @@
+#include "flat.cpp"
+#include "parsejson.cpp"
+#include "pull.cpp"
+#include <cassert>
+#include <string>
+
+using namespace parsejson;
+
+void check_shape(FlatRef root) {
+  assert(root.type() == JSONType::j_object);
+  assert(root.name().empty());
+  FlatRef test = root.child();
+  assert(test.name() == "test" && test.string_val() == "harry");
+  FlatRef next = root.find("next");
+  assert(next.type() == JSONType::j_object);
+  assert(next.find("inner").double_val() == 6.2);
+  assert(next.find("again").type() == JSONType::j_null);
+  assert(!next.find("missing"));
+  FlatRef arr = root.find("arr");
+  double sum = 0;
+  size_t count = 0;
+  for (FlatRef element : arr.children()) {
+    assert(element.name().empty());
+    sum += element.double_val();
+    count++;
+  }
+  assert(count == 2 && sum == 3.0);
+  assert(root.find("empty").children().empty());
+  assert(root.find("yes").bool_val() && !root.find("no").bool_val());
+  assert(!root.next());
+}
+
+int main() {
+  std::string json =
+      "{\"test\": \"harry\", \"next\": {\"inner\": 6.2, \"again\": null}, "
+      "\"arr\": [1.0, 2.0], \"empty\": [], \"yes\": true, \"no\": false}";
+
+  ParseBuffer input;
+  input.raw_json = json;
+  FlatDocument direct = parse_flat(input);
+  assert(direct.node_count() == 11);
+  check_shape(direct.root());
+
+  input.pos = 0;
+  Document doc = parse_document(input);
+  FlatDocument converted = flatten_json(doc.root());
+  check_shape(converted.root());
+  assert(converted.view().serialize() == direct.view().serialize());
+
+  FlatDocument copied = copy_flat(direct.root());
+  assert(copied.view().serialize() == direct.view().serialize());
+  FlatDocument next = copy_flat(direct.root().find("next"));
+  assert(next.node_count() == 3 && next.root().name().empty());
+  assert(next.root().find("inner").double_val() == 6.2);
+  assert(copy_flat(direct.root().find("yes")).root().bool_val());
+
+  // round trip through bytes, into a buffer that isn't the original
+  std::string bytes = direct.view().serialize();
+  std::vector<uint64_t> aligned(bytes.size() / 8 + 1);
+  std::memcpy(aligned.data(), bytes.data(), bytes.size());
+  FlatView loaded = FlatView::from_bytes(aligned.data(), bytes.size());
+  check_shape(loaded.root());
+
+  bool exception_thrown = false;
+  try {
+    FlatView::from_bytes(aligned.data(), bytes.size() - 1);
+  } catch (ParseError &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown);
+  exception_thrown = false;
+  // point the root's child back at itself
+  reinterpret_cast<FlatNode *>(
+      reinterpret_cast<char *>(aligned.data()) + sizeof(FlatHeader))
+      ->child = 0xffff;
+  try {
+    FlatView::from_bytes(aligned.data(), bytes.size());
+  } catch (ParseError &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown);
+
+  input.raw_json = "[1, 2";
+  input.pos = 0;
+  input.depth = 0;
+  exception_thrown = false;
+  try {
+    parse_flat(input);
+  } catch (ParseError &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown);
+}
@@ -0,0 +1,151 @@
+#include "flat.cpp"
+#include "follow.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace parsejson;
+
+std::mutex lock;
+std::vector<std::string> records;
+
+void append(const std::string &path, const std::string &text) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+  ssize_t written = write(fd, text.data(), text.size());
+  assert(written == ssize_t(text.size()));
+  close(fd);
+}
+
+// waits for count records to have been seen, which should take well under
+// ten seconds
+void wait_for(size_t count) {
+  auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (std::chrono::steady_clock::now() < give_up) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (records.size() >= count) {
+        return;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  assert(false);
+}
+
+int main() {
+  std::string directory =
+      "/tmp/parsejson-follow-" + std::to_string(getpid());
+  int made = mkdir(directory.c_str(), 0700);
+  assert(made == 0);
+  std::string path = directory + "/events.jsonl";
+  append(path, "{\"old\": 1}\n");
+
+  FollowOptions options;
+  options.from_end = true;
+  options.read_bytes = 7; // many small reads, to split lines across them
+  JSONLFollower follower(path, options);
+  std::thread reader([&] {
+    follower.run([&](std::string_view chunk) {
+      assert(!chunk.empty());
+      for_each_line(chunk, [&](std::string_view record) {
+        std::lock_guard<std::mutex> guard(lock);
+        records.emplace_back(record);
+      });
+    });
+  });
+
+  // a line written in pieces is only handed on once it's whole
+  append(path, "{\"n\": 1}\n{\"n\"");
+  wait_for(1);
+  append(path, ": 2}\n");
+  wait_for(2);
+
+  // rotated: renamed away, written to a little more, then a new file made
+  append(path, "{\"n\": 3}\n");
+  wait_for(3);
+  std::string rotated = path + ".1";
+  int renamed = rename(path.c_str(), rotated.c_str());
+  assert(renamed == 0);
+  append(rotated, "{\"n\": 4}\n{\"n\": 5");
+  append(path, "{\"n\": 6}\n");
+  wait_for(6);
+
+  // truncated in place, to less than had been read
+  append(path, "{\"n\": 7, \"pad\": \"xxxxxxxxxxxxxxxxxxxx\"}\n");
+  wait_for(7);
+  append(path, "{\"partial\"");
+  int truncated = truncate(path.c_str(), 0);
+  assert(truncated == 0);
+  append(path, "{\"n\": 8}\n");
+  wait_for(8);
+
+  // deleted, then created again later
+  int unlinked = unlink(path.c_str());
+  assert(unlinked == 0);
+  append(path, "{\"n\": 9}\n");
+  wait_for(9);
+
+  follower.stop();
+  reader.join();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<std::string> expected = {
+        "{\"n\": 1}",
+        "{\"n\": 2}",
+        "{\"n\": 3}",
+        "{\"n\": 4}",
+        "{\"n\": 5",
+        "{\"n\": 6}",
+        "{\"n\": 7, \"pad\": \"xxxxxxxxxxxxxxxxxxxx\"}",
+        "{\"n\": 8}",
+        "{\"n\": 9}"};
+    assert(records == expected);
+  }
+  assert(follower.stats().rotations == 2);
+  assert(follower.stats().truncations == 1);
+  assert(follower.position() == 9);
+
+  // resuming at an offset, and fed through process_chunks
+  records.clear();
+  options = FollowOptions();
+  options.start_offset = 9;
+  append(path, "{\"n\": 10}\n");
+  JSONLFollower resumed(path, options);
+  std::thread worker([&] {
+    resumed.run(
+        [](std::string_view chunk, std::string &out) {
+          for_each_line(chunk, [&](std::string_view record) {
+            out.append(record.data(), record.size());
+            out += ';';
+          });
+        },
+        [](std::string &out) {
+          std::lock_guard<std::mutex> guard(lock);
+          records.push_back(out);
+        });
+  });
+  wait_for(1);
+  resumed.stop();
+  worker.join();
+  assert(records[0] == "{\"n\": 10};");
+
+  // stop() before run() still stops it
+  JSONLFollower idle(path);
+  idle.stop();
+  idle.run([](std::string_view) {});
+
+  unlink(path.c_str());
+  unlink(rotated.c_str());
+  rmdir(directory.c_str());
+  return 0;
+}
@@ -0,0 +1,142 @@
+#include "flat.cpp"
+#include "index.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "sort.cpp"
+#include "writer.cpp"
+#include <cassert>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+using namespace parsejson;
+
+void write_file(const std::string &path, const std::string &text) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  ssize_t written = write(fd, text.data(), text.size());
+  assert(written == ssize_t(text.size()));
+  close(fd);
+}
+
+int main() {
+  std::string base = "/tmp/parsejson-index-" + std::to_string(getpid());
+  std::string jsonl_path = base + ".jsonl";
+  std::string index_path = base + ".idx";
+  std::string jsonl = "{\"id\": \"a\", \"n\": 1}\n"
+                      "{\"id\": 7, \"n\": 2}\r\n"
+                      "\n"
+                      "{\"n\": 3}\n"
+                      "{\"id\": \"\\u0062\", \"n\": 4}\n"
+                      "{\"id\": \"a\", \"n\": 5}\n"
+                      "{\"id\": [1, 2], \"n\": 6}";
+  write_file(jsonl_path, jsonl);
+
+  for (IndexKind kind : {index_sorted, index_hashed}) {
+    IndexOptions options;
+    options.kind = kind;
+    options.threads = 1;
+    IndexStats stats = build_index(jsonl_path, "/id", index_path, options);
+    assert(stats.records == 6);
+    assert(stats.indexed == 5);
+    assert(stats.index_bytes > 0);
+
+    JSONLIndex index(index_path, jsonl_path);
+    assert(index.kind() == kind);
+    assert(index.key_pointer() == "/id");
+    assert(index.size() == 5);
+    std::vector<IndexHit> hits = index.find("\"a\"");
+    assert(hits.size() == 2);
+    assert(index.read(hits[0]) == "{\"id\": \"a\", \"n\": 1}");
+    assert(index.read(hits[1]) == "{\"id\": \"a\", \"n\": 5}");
+    assert(index.find(" \"b\" ").size() == 1);
+    assert(index.find("[1, 2]").size() == 1);
+    assert(index.find("\"c\"").empty());
+    assert(index.find("null").empty());
+    Document record = index.lookup("7.0");
+    assert(record);
+    assert(record->child->next->double_val == 2);
+    assert(!index.lookup("8"));
+    for (const char *bad : {"", "\"a", "1 2"}) {
+      bool threw = false;
+      try {
+        index.find(bad);
+      } catch (std::invalid_argument &) {
+        threw = true;
+      }
+      assert(threw);
+    }
+  }
+
+  // many records on several threads
+  std::string many;
+  for (int i = 0; i < 20000; i++) {
+    many += "{\"pad\": \"" + std::string(size_t(i % 30), 'p') +
+            "\", \"id\": " + std::to_string(i * 3) + "}\n";
+  }
+  write_file(jsonl_path, many);
+  for (IndexKind kind : {index_sorted, index_hashed}) {
+    IndexOptions options;
+    options.kind = kind;
+    options.threads = 4;
+    options.chunk_bytes = 4096;
+    IndexStats stats = build_index(jsonl_path, "/id", index_path, options);
+    assert(stats.indexed == 20000);
+    JSONLIndex index(index_path, jsonl_path);
+    for (int i = 0; i < 20000; i += 7) {
+      std::vector<IndexHit> hits = index.find(std::to_string(i * 3));
+      assert(hits.size() == 1);
+      assert(index.read(hits[0]).find("\"id\": " + std::to_string(i * 3) +
+                                      "}") != std::string::npos);
+      assert(index.find(std::to_string(i * 3 + 1)).empty());
+    }
+  }
+
+  // a changed file, or something that isn't an index, is refused
+  write_file(jsonl_path, many + "{\"id\": -1}\n");
+  bool threw = false;
+  try {
+    JSONLIndex index(index_path, jsonl_path);
+  } catch (std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  threw = false;
+  try {
+    JSONLIndex index(jsonl_path, jsonl_path);
+  } catch (ParseError &) {
+    threw = true;
+  }
+  assert(threw);
+  // an entry whose key lies past the end of the keys is caught on opening,
+  // before any lookup can read past the mapping
+  for (IndexKind kind : {index_sorted, index_hashed}) {
+    IndexOptions options;
+    options.kind = kind;
+    build_index(jsonl_path, "/id", index_path, options);
+    int fd = open(index_path.c_str(), O_RDWR);
+    IndexHeader header;
+    ssize_t got = pread(fd, &header, sizeof(header), 0);
+    assert(got == ssize_t(sizeof(header)));
+    uint64_t key = header.key_bytes;
+    ssize_t written =
+        pwrite(fd, &key, sizeof(key),
+               off_t(sizeof(header) + padded(header.pointer_bytes) +
+                     offsetof(IndexEntry, key)));
+    assert(written == ssize_t(sizeof(key)));
+    close(fd);
+    bool threw = false;
+    try {
+      JSONLIndex index(index_path, jsonl_path);
+    } catch (ParseError &) {
+      threw = true;
+    }
+    assert(threw);
+  }
+
+  unlink(jsonl_path.c_str());
+  unlink(index_path.c_str());
+  return 0;
+}
@@ -0,0 +1,290 @@
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace parsejson;
+
+bool rejects(const Projection &projection, const char *record) {
+  std::vector<Field> fields;
+  try {
+    projection.extract(record, fields);
+  } catch (ParseError &) {
+    return true;
+  }
+  return false;
+}
+
+int main() {
+  // skipping whole values without looking inside more than needed
+  std::string text =
+      "{\"a\": \"x\\\\\\\"}]\", \"b\": [1, {\"c\": \"]\"}]} tail";
+  assert(skip_value(text, 0) == text.size() - 5);
+  assert(skip_value("\"\\\\\" rest", 0) == 4);
+  assert(skip_value("-12.5e3,", 0) == 7);
+  assert(skip_value("true", 0) == 4);
+  for (const char *bad : {"\"open", "[1, [2]", "{\"a\": \"}\"", ","}) {
+    try {
+      skip_value(bad, 0);
+      assert(false);
+    } catch (ParseError &) {
+    }
+  }
+
+  // brackets, quotes and backslash runs on either side of block boundaries
+  std::string nested = "[";
+  for (int i = 0; i < 40; i++) {
+    nested += "{\"s\": \"" + std::string(i % 7, '\\') +
+              (i % 7 % 2 ? "\\" : "") + "]}\\\"[{\", \"n\": [" +
+              std::to_string(i) + ", [], {}]},\n ";
+  }
+  nested += "null] tail";
+  size_t nested_end = nested.size() - 5;
+  assert(skip_value(nested, 0) == nested_end);
+  assert(skip_value(nested, 0, true) == nested_end);
+  for (size_t cut = 1; cut < nested_end; cut += 7) {
+    for (bool validate : {false, true}) {
+      try {
+        skip_value(nested.substr(0, cut), 0, validate);
+        assert(false);
+      } catch (ParseError &) {
+      }
+    }
+  }
+  std::string long_string = "\"" + std::string(300, 'x') + "\\\\\" rest";
+  assert(skip_value(long_string, 0) == 304);
+  assert(skip_value(long_string, 0, true) == 304);
+
+  // validating checks everything skipping lets through
+  for (const char *good :
+       {"0", "-0.5e+10", "1E3", "\"\\u00e9\\ud83d\\ude00\\/\"", "true",
+        "[ ]", "{ }", "{\"a\" : [1, {\"b\": null}], \"c\": false}"}) {
+    std::string_view text(good);
+    assert(skip_value(text, 0, true) == text.size());
+  }
+  for (const char *bad :
+       {"[1,]", "{\"a\" 1}", "{\"a\": 1,}", "{1: 2}", "[01]", "[1.]", "[-]",
+        "[1e]", "[tru]", "truex", "[1 2]", "[1}", "{\"a\": 1]", "\"\\x\"",
+        "\"a\tb\"", "\"\\ud800\"", "\"\\udc00\"", "\"\\u12\"", "[\"a\"",
+        "+1"}) {
+    try {
+      skip_value(bad, 0, true);
+      assert(false);
+    } catch (ParseError &) {
+    }
+  }
+  std::string deep(PARSER_NESTING_LIMIT, '[');
+  deep += std::string(PARSER_NESTING_LIMIT, ']');
+  assert(skip_value(deep, 0, true) == deep.size());
+  deep = "[" + deep + "]";
+  assert(skip_value(deep, 0) == deep.size());
+  try {
+    skip_value(deep, 0, true);
+    assert(false);
+  } catch (ParseError &) {
+  }
+
+  // projection
+  Projection projection(
+      {"/id", "/user/name", "/user/tags/1", "", "/a~1b", "/missing", "/id"});
+  assert(projection.columns() == 7);
+  std::vector<Field> fields;
+  std::string record = " {\"id\": 17, \"skip\": {\"deep\": [1, [2, {}]]}, "
+                       "\"user\": {\"tags\": [\"x\", \"y\\n\"], \"name\": "
+                       "\"n\\u00e9\"}, \"a/b\": null} ";
+  projection.extract(record, fields);
+  assert(fields[0].found && fields[0].type == j_number &&
+         fields[0].text == "17");
+  assert(fields[1].type == j_string && fields[1].text == "\"n\\u00e9\"");
+  std::string name;
+  append_unescaped(name, fields[1].text);
+  assert(name == "n\xc3\xa9");
+  // decoded by the parser's own rules, so a lone surrogate fails the same way
+  name.clear();
+  append_unescaped(name, "\"\\ud83d\\ude00\\/\"");
+  assert(name == "\xf0\x9f\x98\x80/");
+  for (const char *bad : {"\"\\ud83d\"", "\"\\q\"", "\"\\\""}) {
+    try {
+      append_unescaped(name, bad);
+      assert(false);
+    } catch (ParseError &e) {
+      assert(std::string(e.what()).find("escape") != std::string::npos);
+    }
+  }
+  assert(fields[2].text == "\"y\\n\"");
+  assert(fields[3].type == j_object && fields[3].text.front() == '{' &&
+         fields[3].text.back() == '}');
+  assert(fields[4].found && fields[4].type == j_null);
+  assert(!fields[5].found);
+  assert(fields[6].text == "17");
+
+  // escaped member names still match, and the scan stops once everything
+  // wanted has been seen, so what follows isn't looked at
+  Projection first({"/k\"ey"});
+  first.extract("{\"k\\\"ey\": [true] this is not json", fields);
+  assert(fields[0].type == j_array && fields[0].text == "[true]");
+
+  // what is scanned is checked
+  assert(rejects(projection, "{\"id\" 1}"));
+  assert(rejects(projection, "{\"id\": 1 \"user\": 2}"));
+  assert(rejects(projection, "{\"skip\": [1, 2}"));
+  assert(rejects(projection, "{\"user\": {\"name\": }}"));
+  assert(rejects(projection, "{\"id\": 1,"));
+  assert(rejects(projection, ""));
+  // and within a bigger input, the error says where the record starts
+  std::string input = "{\"id\": 1}\n{\"id\" 2}\n";
+  try {
+    projection.extract(std::string_view(input).substr(10, 8), fields, input);
+    assert(false);
+  } catch (ParseError &e) {
+    assert(std::string(e.what()) ==
+           "record at byte 10: expected ':' at pos: 6");
+  }
+  try {
+    Projection bad({"no-slash"});
+    assert(false);
+  } catch (ParseError &) {
+  }
+
+  // lines: blank ones skipped, \r\n handled, no trailing newline needed
+  std::vector<std::string> lines;
+  for_each_line("a\r\n\n  \nb\nc", [&](std::string_view line) {
+    lines.emplace_back(line);
+  });
+  assert((lines == std::vector<std::string>{"a", "b", "c"}));
+
+  // chunks are worked on in parallel but emitted in order
+  std::string data;
+  for (int i = 0; i < 5000; i++) {
+    data += std::to_string(i) + "\n";
+  }
+  for (unsigned threads : {1u, 2u, 7u}) {
+    std::string joined;
+    size_t chunks = 0;
+    process_chunks(
+        data, 100, threads,
+        [](std::string_view chunk, std::string &out) {
+          assert(chunk.back() == '\n');
+          out.assign(chunk.data(), chunk.size());
+        },
+        [&](std::string &out) {
+          joined += out;
+          chunks++;
+        });
+    assert(joined == data && chunks > 100);
+  }
+  try {
+    process_chunks(
+        data, 100, 4,
+        [](std::string_view chunk, std::string &) {
+          if (chunk.find("\n2500\n") != std::string_view::npos) {
+            throw std::runtime_error("stop");
+          }
+        },
+        [](std::string &) {});
+    assert(false);
+  } catch (std::runtime_error &) {
+  }
+
+  // scans: every Nth record, blank lines not counted
+  std::string records = "0\n\n1\r\n2\n  \n3\n4\n5\n6";
+  std::vector<std::string> seen;
+  auto collect = [&](std::string_view record) {
+    seen.emplace_back(record);
+    return record != "3";
+  };
+  ScanControl control;
+  ScanStats scan = scan_jsonl(records, control, collect);
+  assert(seen.size() == 7 && scan.matches == 6 && !scan.stopped);
+  assert(scan.bytes == records.size());
+  seen.clear();
+  control.every = 3;
+  scan = scan_jsonl(records, control, collect);
+  assert((seen == std::vector<std::string>{"0", "3", "6"}));
+  assert(scan.records == 7 && scan.sampled == 3 && scan.matches == 2);
+
+  // stopping after matches, or bytes, says where it got to
+  seen.clear();
+  control = ScanControl();
+  control.max_matches = 4;
+  scan = scan_jsonl(records, control, collect);
+  assert((seen == std::vector<std::string>{"0", "1", "2", "3", "4"}));
+  assert(scan.stopped && scan.bytes == records.find("5"));
+  control = ScanControl();
+  control.max_bytes = 4;
+  seen.clear();
+  scan = scan_jsonl(records, control, collect);
+  assert(seen.size() == 2 && scan.stopped && scan.bytes == 6);
+  control.max_bytes = records.size();
+  scan = scan_jsonl(records, control, collect);
+  assert(!scan.stopped);
+
+  // a random fraction, the same for the same seed
+  control = ScanControl();
+  control.fraction = 0.1;
+  size_t sampled = scan_jsonl(data, control, [](std::string_view) {
+                     return true;
+                   }).sampled;
+  assert(sampled > 350 && sampled < 650);
+  std::vector<std::string> run1;
+  std::vector<std::string> run2;
+  scan_jsonl(data, control, [&](std::string_view record) {
+    run1.emplace_back(record);
+    return true;
+  });
+  scan_jsonl(data, control, [&](std::string_view record) {
+    run2.emplace_back(record);
+    return true;
+  });
+  assert(run1 == run2 && run1.size() == sampled);
+  control.fraction = 0;
+  scan = scan_jsonl(data, control, [](std::string_view) {
+    assert(false);
+    return true;
+  });
+  assert(scan.records == 5000 && scan.sampled == 0);
+
+  // a time budget
+  control = ScanControl();
+  control.max_seconds = 0.05;
+  scan = scan_jsonl(data, control, [](std::string_view) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return true;
+  });
+  assert(scan.stopped && scan.sampled < 1000);
+
+  // mapped files
+  std::string path = "/tmp/parsejson-jsonl-" + std::to_string(getpid());
+  std::ofstream(path) << data;
+  MappedFile mapped(path);
+  assert(mapped.bytes() == data);
+  MappedFile moved(std::move(mapped));
+  assert(moved.bytes() == data && mapped.bytes().empty());
+  std::ofstream(path).close();
+  assert(MappedFile(path).bytes().empty());
+  // a file filling its last page still has a '\0' after it to parse up to
+  std::string page = "[" + std::string(4096 - 8, ' ') + "1, 2.5]";
+  std::ofstream(path) << page;
+  MappedFile whole(path);
+  assert(whole.bytes() == page && whole.bytes().data()[4096] == '\0');
+  ParseBuffer in_place;
+  in_place.raw_json.borrow(whole.bytes());
+  Document numbers = parse_document(in_place);
+  assert(numbers->child->next->double_val == 2.5);
+  unlink(path.c_str());
+  try {
+    MappedFile missing(path);
+    assert(false);
+  } catch (std::system_error &) {
+  }
+  return 0;
+}
@@ -0,0 +1,53 @@
+#include "keyset.h"
+#include "parsejson.cpp"
+#include <cassert>
+#include <string>
+
+using namespace parsejson;
+
+constexpr KeySet fields("id", "name", "tags", "value");
+static_assert(fields.size() == 4);
+static_assert(fields.find("id") == 0);
+static_assert(fields.find("value") == 3);
+static_assert(fields.find("nope") == -1);
+static_assert(fields.find("") == -1);
+
+// keys that only differ in the middle force the whole-key hash
+constexpr KeySet similar("a1b", "a2b", "a3b", "");
+static_assert(similar.find("a2b") == 1);
+static_assert(similar.find("") == 3);
+static_assert(similar.find("a4b") == -1);
+
+int main() {
+  ParseBuffer input;
+  input.raw_json =
+      "{\"tags\": [1], \"id\": 1, \"extra\": null, \"name\": \"x\"}";
+  JSONItem *parsed = parse_json(input);
+  int seen[4] = {0, 0, 0, 0};
+  int unknown = 0;
+  for (JSONItem *member = parsed->child; member; member = member->next) {
+    switch (fields.find(member)) {
+    case fields.find("id"):
+      assert(member->double_val == 1);
+      seen[0]++;
+      break;
+    case fields.find("name"):
+      assert(member->string_val == "x");
+      seen[1]++;
+      break;
+    case fields.find("tags"):
+      assert(member->type == JSONType::j_array);
+      seen[2]++;
+      break;
+    default:
+      unknown++;
+    }
+  }
+  assert(seen[0] == 1 && seen[1] == 1 && seen[2] == 1 && seen[3] == 0);
+  assert(unknown == 1);
+  destroy_json(parsed);
+
+  std::string raw = "xxvaluexx";
+  assert(fields.find(raw.data() + 2, 5) == 3);
+  assert(fields.find(raw.data() + 2, 4) == -1);
+}
@@ -1,8 +1,12 @@
 #include "parsejson.cpp"
 #include <cassert>
 #include <fstream>
+#include <memory>
+#include <memory_resource>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 using namespace parsejson;
 
@@ -20,16 +24,189 @@ int main() {
   input.raw_json = "1five";
   input.pos = 0;
   try {
-    parse_json(input);
+    Document doc = parse_document(input);
   } catch (ParseError &pe) {
     exception_thrown = true;
   }
-  if (!exception_thrown) {
-    destroy_json(parsed);
-  }
   assert(exception_thrown);
   exception_thrown = false;
 
+  // a Document owns its tree and hands it on when moved
+  input.raw_json = "[1, {\"a\": null}]";
+  input.pos = 0;
+  input.depth = 0;
+  Document doc = parse_document(input);
+  assert(doc && doc->type == JSONType::j_array);
+  JSONItem *root = doc.root();
+  Document moved(std::move(doc));
+  assert(!doc && moved.root() == root);
+  doc = std::move(moved);
+  assert(doc.root() == root && !moved);
+  doc.reset();
+  assert(!doc);
+
+  input.raw_json = "{\"a\": [], \"b\": {}}";
+  input.pos = 0;
+  input.depth = 0;
+  doc = parse_document(input);
+  assert(doc->child->type == JSONType::j_array && !doc->child->child);
+  assert(doc->child->next->type == JSONType::j_object);
+  assert(!doc->child->next->child);
+  doc.reset();
+
+  // everything comes from, and goes back to, the buffer's memory_resource
+  struct CountingResource : std::pmr::memory_resource {
+    long live = 0;
+    void *do_allocate(size_t bytes, size_t align) override {
+      live++;
+      return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+      live--;
+      std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const memory_resource &other) const noexcept override {
+      return this == &other;
+    }
+  } counting;
+  input.raw_json = "{\"a long member name, past any sso\": [\"and a long "
+                   "string value to go with it\", 2]}";
+  input.pos = 0;
+  input.depth = 0;
+  input.resource = &counting;
+  doc = parse_document(input);
+  assert(counting.live > 0);
+  assert(doc->child->resource() == &counting);
+  doc.reset();
+  assert(counting.live == 0);
+  input.raw_json = "[1, 2, {\"a\": tru}]";
+  input.pos = 0;
+  input.depth = 0;
+  try {
+    doc = parse_document(input);
+  } catch (ParseError &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown && counting.live == 0);
+  exception_thrown = false;
+  input.resource = std::pmr::get_default_resource();
+
+  // or the document can own an arena outright
+  input.raw_json = "{\"a\": [1, 2, 3], \"b\": \"c\"}";
+  input.pos = 0;
+  input.depth = 0;
+  doc = parse_document(
+      input, std::make_unique<std::pmr::monotonic_buffer_resource>());
+  assert(doc->child->next->string_val == "c");
+  // whose tree stays with it
+  exception_thrown = false;
+  try {
+    doc.release();
+  } catch (std::logic_error &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown && doc->child->name == "a");
+  exception_thrown = false;
+  doc.reset();
+
+  // names: none for elements, short ones in place, long ones allocated from
+  // the item's resource
+  input.raw_json = "{\"short\": [1], \"exactly twenty-five bytes\": 2, "
+                   "\"a name that is too long to be kept inline\": 3}";
+  input.pos = 0;
+  input.depth = 0;
+  input.resource = &counting;
+  doc = parse_document(input);
+  JSONItem *member = doc->child;
+  assert(member->name == "short" && member->name.size() == 5);
+  assert(member->child->name.empty());
+  assert(member->next->name == "exactly twenty-five bytes");
+  assert(member->next->name.size() == JSONKey::inline_capacity + 1);
+  assert(member->next->next->name ==
+         "a name that is too long to be kept inline");
+  assert(member->name != member->next->name);
+  assert(member->name.hash() == JSONKey::hash_of("short"));
+  member->set_name("a renamed member with another long name");
+  assert(member->name == "a renamed member with another long name");
+  // a name set from (part of) itself, whether kept inline or not
+  member->set_name(member->name.view());
+  assert(member->name == "a renamed member with another long name");
+  member->set_name(member->name.view().substr(2));
+  assert(member->name == "renamed member with another long name");
+  member->set_name(member->name.view().substr(8, 6));
+  assert(member->name == "member" &&
+         member->name.hash() == JSONKey::hash_of("member"));
+  member->set_name(member->name.view().substr(2));
+  assert(member->name == "mber");
+  // the length wouldn't fit; it's turned away before a byte is read
+  bool threw = false;
+  try {
+    member->set_name(std::string_view("x", size_t(UINT32_MAX) + 1));
+  } catch (ParseError &) {
+    threw = true;
+  }
+  assert(threw && member->name == "mber");
+  doc.reset();
+  assert(counting.live == 0);
+  input.resource = std::pmr::get_default_resource();
+
+  // escapes, including \u ones decoded to UTF-8 and surrogate pairs
+  input.raw_json = "[\"q\\\"b\\\\s\\/\", "
+                   "\"\\u0041\\u00e9\\u20ac\\ud83d\\ude00\"]";
+  input.pos = 0;
+  input.depth = 0;
+  doc = parse_document(input);
+  assert(doc->child->string_val == "q\"b\\s/");
+  assert(doc->child->next->string_val ==
+         "A\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+  doc.reset();
+  for (const char *bad :
+       {"\"\\u12\"", "\"\\uzzzz\"", "\"\\ud83d\"", "\"\\x\"", "\"abc"}) {
+    input.raw_json = bad;
+    input.pos = 0;
+    input.depth = 0;
+    exception_thrown = false;
+    try {
+      doc = parse_document(input);
+    } catch (ParseError &) {
+      exception_thrown = true;
+    }
+    assert(exception_thrown);
+  }
+
+  // borrowed text is parsed where it lies; copies share it, owned text is
+  // copied
+  std::string backing = "{\"borrowed\": [1, 2]}";
+  input.raw_json.borrow(backing);
+  assert(input.raw_json.data() == backing.data());
+  JSONText shared = input.raw_json;
+  assert(shared.data() == backing.data() && shared.view() == backing);
+  input.pos = 0;
+  input.depth = 0;
+  doc = parse_document(input);
+  assert(doc->child->name == "borrowed" &&
+         doc->child->child->next->double_val == 2);
+  doc.reset();
+  input.raw_json = backing;
+  assert(input.raw_json.data() != backing.data());
+  JSONText copied = input.raw_json;
+  assert(copied.data() != input.raw_json.data() && copied.view() == backing);
+  JSONText taken = std::move(copied);
+  assert(taken.view() == backing && copied.empty());
+  input.raw_json.borrow("");
+  assert(input.raw_json.empty() && input.raw_json[0] == '\0');
+
+  // teardown doesn't recurse, so nesting far past what the parser allows is
+  // fine, as are long chains at every level
+  JSONItem *deep = create_item(JSONType::j_array);
+  JSONItem *level = deep;
+  for (int i = 0; i < 1000000; i++) {
+    level->child = create_item(JSONType::j_array);
+    level->child->next = create_item(JSONType::j_null);
+    level = level->child;
+  }
+  destroy_json(deep);
+
   json = "{\"test\": \"harry\", \"next\": {\"inner\": 6.2, \"again\": null}, "
          "\"arr\": [1.0, 2.0]}";
   input.raw_json = json;
@@ -95,8 +272,8 @@ int main() {
   std::ifstream jsonl_file(
       "~/Downloads/bq-results-20241213-034916-1734061788935.json");
   std::string json_string;
-  while (jsonl_file) {
-    std::getline(jsonl_file, input.raw_json);
+  while (std::getline(jsonl_file, json_string)) {
+    input.raw_json = json_string;
     input.depth = 0;
     input.pos = 0;
     parsed = parse_json(input);
@@ -107,7 +284,7 @@ int main() {
   // std::stringstream buffer;
   // buffer << jsonl_file.rdbuf();
   // json_string = buffer.str();
-  // input.raw_json.swap(json_string);
+  // input.raw_json = std::move(json_string);
   // input.depth = 0;
   // input.pos = 0;
   // parsed = parse_json(input);
@@ -0,0 +1,53 @@
+#include "flat.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include <cassert>
+#include <string>
+#include <vector>
+
+using namespace parsejson;
+
+bool rejects(const char *pointer) {
+  try {
+    parse_pointer(pointer);
+  } catch (ParseError &) {
+    return true;
+  }
+  return false;
+}
+
+int main() {
+  assert(parse_pointer("").empty());
+  std::vector<std::string> tokens = parse_pointer("/a~1b/~0c//0");
+  assert(tokens.size() == 4);
+  assert(tokens[0] == "a/b" && tokens[1] == "~c" && tokens[2].empty());
+  assert(tokens[3] == "0");
+  assert(parse_pointer("/").size() == 1);
+  assert(rejects("a") && rejects("/~") && rejects("/~2"));
+  assert(pointer_index("0") == 0 && pointer_index("12") == 12);
+  assert(pointer_index("012") == -1 && pointer_index("-") == -1);
+  assert(pointer_index("1x") == -1);
+
+  ParseBuffer input;
+  input.raw_json = "{\"a\": [{\"b\": 1}, {\"b\": 2}], \"c/d\": \"x\", "
+                   "\"\": {\"e\": true}}";
+  Document doc = parse_document(input);
+  assert(resolve_pointer(doc.root(), parse_pointer("")) == doc.root());
+  assert(resolve_pointer(doc.root(), parse_pointer("/a/1/b"))->double_val ==
+         2);
+  assert(resolve_pointer(doc.root(), parse_pointer("/c~1d"))->string_val ==
+         "x");
+  assert(resolve_pointer(doc.root(), parse_pointer("//e"))->bool_val);
+  assert(!resolve_pointer(doc.root(), parse_pointer("/a/2")));
+  assert(!resolve_pointer(doc.root(), parse_pointer("/a/b")));
+  assert(!resolve_pointer(doc.root(), parse_pointer("/c~1d/x")));
+
+  input.pos = 0;
+  FlatDocument flat = parse_flat(input);
+  assert(resolve_pointer(flat.root(), parse_pointer("/a/1/b")).double_val() ==
+         2);
+  assert(resolve_pointer(flat.root(), parse_pointer("//e")).bool_val());
+  assert(!resolve_pointer(flat.root(), parse_pointer("/a/2")));
+  assert(!resolve_pointer(flat.root(), parse_pointer("/missing/0")));
+}
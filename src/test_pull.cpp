@@ -0,0 +1,123 @@
+#include "parsejson.cpp"
+#include "pull.cpp"
+#include <cassert>
+#include <string>
+#include <vector>
+
+using namespace parsejson;
+
+std::string trace_events(const std::string &json) {
+  ParseBuffer input;
+  input.raw_json = json;
+  EventReader reader(input);
+  JSONEvent event;
+  std::string trace;
+  while (reader.next(event)) {
+    switch (event.type) {
+    case ev_begin_object:
+      trace += "{";
+      break;
+    case ev_end_object:
+      trace += "}";
+      break;
+    case ev_begin_array:
+      trace += "[";
+      break;
+    case ev_end_array:
+      trace += "]";
+      break;
+    case ev_key:
+      trace += event.text + ":";
+      break;
+    case ev_string:
+      trace += "s";
+      break;
+    case ev_number:
+      trace += "n";
+      break;
+    case ev_bool:
+      trace += event.bool_val ? "t" : "f";
+      break;
+    case ev_null:
+      trace += "0";
+      break;
+    }
+  }
+  return trace;
+}
+
+bool rejects(const std::string &json) {
+  try {
+    trace_events(json);
+  } catch (ParseError &) {
+    return true;
+  }
+  return false;
+}
+
+int main() {
+  assert(trace_events("5.9") == "n");
+  assert(trace_events(" {\"a\": [1, true, {}], \"b\": {\"c\": null}} ") ==
+         "{a:[nt{}]b:{c:0}}");
+  assert(trace_events("[[], [false], \"x\"]") == "[[][f]s]");
+  assert(rejects("1five"));
+  assert(rejects("{\"bad_obj\" \"bad_val\"}"));
+  assert(rejects("[\"bad_arr\" \"bad_val\"]"));
+  assert(rejects("[1, 2"));
+  assert(rejects("[1, 2}"));
+  assert(rejects("{\"a\": 1,}"));
+  assert(rejects("[1] 2"));
+
+#ifdef PARSEJSON_HAS_COROUTINES
+  ParseBuffer input;
+  input.raw_json = "{\"a\": [1, 2]}";
+  std::vector<JSONEventType> types;
+  for (const JSONEvent &event : pull_events(input)) {
+    types.push_back(event.type);
+  }
+  assert(types.size() == 7);
+  assert(types[1] == ev_key && types[6] == ev_end_object);
+
+  input = ParseBuffer();
+  input.raw_json = " [ {\"id\": 1}, \"two\", [3] ] ";
+  std::vector<JSONType> element_types;
+  for (JSONItem *element : pull_elements(input)) {
+    element_types.push_back(element->type);
+    destroy_json(element);
+  }
+  assert(element_types.size() == 3);
+  assert(element_types[0] == JSONType::j_object);
+  assert(element_types[1] == JSONType::j_string);
+  assert(element_types[2] == JSONType::j_array);
+
+  input = ParseBuffer();
+  input.raw_json = "[1, 2,]";
+  bool exception_thrown = false;
+  size_t seen = 0;
+  try {
+    for (JSONItem *element : pull_elements(input)) {
+      seen++;
+      destroy_json(element);
+    }
+  } catch (ParseError &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown && seen == 2 && input.depth == 0);
+
+  // leaving early gives the buffer back as it was lent
+  input = ParseBuffer();
+  input.raw_json = "[1, [2], 3]";
+  seen = 0;
+  {
+    Generator<JSONItem *> elements = pull_elements(input);
+    for (JSONItem *element : elements) {
+      destroy_json(element);
+      if (++seen == 2) {
+        break;
+      }
+    }
+    assert(input.depth == 1);
+  }
+  assert(seen == 2 && input.depth == 0);
+#endif
+}
@@ -0,0 +1,39 @@
+#include "parsejson.cpp"
+#include "reclaim.cpp"
+#include <cassert>
+#include <string>
+#include <utility>
+
+using namespace parsejson;
+
+Document parse(const std::string &json) {
+  ParseBuffer input;
+  input.raw_json = json;
+  return parse_document(input);
+}
+
+int main() {
+  Document doc = parse("{\"a\": [1, 2, 3], \"b\": \"a string that won't fit "
+                       "in the small string buffer\"}");
+  size_t footprint = doc.footprint();
+  assert(footprint > 6 * sizeof(JSONItem));
+
+  {
+    Reclaimer reclaimer(4);
+    assert(reclaimer.reclaim(std::move(doc)));
+    assert(!doc);
+    for (int i = 0; i < 20; i++) {
+      reclaimer.reclaim(parse("[1, [2, [3]]]"));
+    }
+    reclaimer.drain();
+    assert(reclaimer.pending_bytes() == 0);
+    assert(reclaimer.queued_documents() == 0);
+    assert(reclaimer.reclaimed_bytes() >= footprint);
+  }
+
+  // anything still queued is released when the reclaimer goes away
+  Reclaimer reclaimer(1000);
+  for (int i = 0; i < 100; i++) {
+    reclaimer.reclaim(parse("{\"x\": [true, false, null]}"));
+  }
+}
@@ -0,0 +1,226 @@
+#include "flat.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "service.cpp"
+#include "writer.cpp"
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace parsejson;
+
+int main() {
+  const std::string json = "{\"name\": \"reference\", \"values\": [1, 2, 3], "
+                           "\"nested\": {\"ok\": true}}";
+  assert(content_hash(json) == content_hash(std::string(json)));
+  assert(content_hash(json) != content_hash(json + " "));
+  assert(content_hash("") != content_hash(std::string(1, '\0')));
+  // the reference implementation's test vector: key 00 01 .. 0f, message
+  // 00 01 .. 0e
+  std::string message;
+  for (char c = 0; c < 15; c++) {
+    message += c;
+  }
+  assert(siphash(0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull, message) ==
+         0xa129ca6149be45e5ull);
+
+  // the service itself
+  ParseService service;
+  DocumentId id = service.parse_text(json);
+  assert(service.parse_text(json) == id);
+  assert(service.documents().documents() == 1);
+  {
+    std::string bytes = service.query(id, "/values");
+    Snapshot values(bytes);
+    assert(values.root().type() == j_array);
+    double sum = 0;
+    for (FlatRef value : values.root().children()) {
+      sum += value.double_val();
+    }
+    assert(sum == 6);
+    Snapshot whole(service.query(id, ""));
+    assert(whole.root().find("nested").find("ok").bool_val());
+  }
+  for (const char *pointer : {"/missing", "/values/3", "bad"}) {
+    try {
+      service.query(id, pointer);
+      assert(false);
+    } catch (std::exception &) {
+    }
+  }
+  try {
+    service.query(id + 1, "");
+    assert(false);
+  } catch (ServiceError &) {
+  }
+  try {
+    service.parse_text("{\"unterminated\": ");
+    assert(false);
+  } catch (ParseError &) {
+  }
+
+  // files are only read again once they change
+  std::string path = "/tmp/parsejson-service-" + std::to_string(getpid());
+  std::ofstream(path) << json;
+  assert(service.parse_file(path) == id);
+  std::ofstream(path) << "[1, 2]";
+  DocumentId changed = service.parse_file(path);
+  assert(changed != id);
+  assert(service.parse_file(path) == changed);
+  // only regular files within the limit, and only the client's own if
+  // asked, are read: a FIFO would block and /dev/zero never end
+  std::string fifo = path + ".fifo";
+  int made = mkfifo(fifo.c_str(), 0600);
+  assert(made == 0);
+  RequestLimits small_files;
+  small_files.max_file_bytes = 4;
+  RequestLimits someone_else;
+  someone_else.check_owner = true;
+  someone_else.owner = getuid() + 1;
+  for (auto [name, limits] :
+       {std::make_pair(path + ".missing", RequestLimits()),
+        std::make_pair(fifo, RequestLimits()),
+        std::make_pair(std::string("/dev/zero"), RequestLimits()),
+        std::make_pair(std::string("/tmp"), RequestLimits()),
+        std::make_pair(path, small_files),
+        std::make_pair(path, someone_else)}) {
+    try {
+      service.parse_file(name, limits);
+      assert(false);
+    } catch (ServiceError &) {
+    }
+  }
+  unlink(fifo.c_str());
+
+  // stamps are kept for a bounded number of files
+  ParseService few(size_t(1) << 30, 2);
+  for (int i = 0; i < 4; i++) {
+    std::string other = path + "." + std::to_string(i);
+    std::ofstream(other) << "[" << i << "]";
+    few.parse_file(other);
+    unlink(other.c_str());
+  }
+  assert(few.file_stamps() == 2);
+
+  // the cache stays within its budget, but keeps the newest document
+  ParseService small(1);
+  DocumentId first = small.parse_text(json);
+  DocumentId second = small.parse_text("[true]");
+  assert(small.documents().documents() == 1);
+  assert(small.documents().find(second) && !small.documents().find(first));
+
+  // over the socket, from several clients at once
+  std::string socket_path = path + ".sock";
+  {
+    ServerOptions options;
+    options.threads = 4;
+    options.max_request_bytes = 1 << 20;
+    ServiceServer server(service, socket_path, options);
+    struct stat socket_info;
+    int stat_result = stat(socket_path.c_str(), &socket_info);
+    assert(stat_result == 0 && (socket_info.st_mode & 0777) == 0600);
+    std::vector<std::thread> clients;
+    for (int i = 0; i < 8; i++) {
+      clients.emplace_back([&, i] {
+        ServiceClient client(socket_path);
+        std::string text = "{\"client\": " + std::to_string(i) +
+                           ", \"list\": [\"a\", \"b\"]}";
+        DocumentId mine = client.parse_text(text);
+        assert(mine == content_hash(text));
+        for (int round = 0; round < 20; round++) {
+          Snapshot number = client.query(mine, "/client");
+          assert(number.root().double_val() == i);
+          Snapshot letter = client.query(mine, "/list/1");
+          assert(letter.root().string_val() == "b");
+        }
+        assert(client.parse_file(path) == changed);
+        try {
+          client.query(mine, "/nope");
+          assert(false);
+        } catch (ServiceError &) {
+        }
+        // the connection is still usable after an error
+        assert(client.query(mine, "/list").root().type() == j_array);
+      });
+    }
+    for (std::thread &client : clients) {
+      client.join();
+    }
+
+    // a request too big to take is refused, and only its connection closed
+    {
+      ServiceClient liar(socket_path);
+      int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      sockaddr_un address = socket_address(socket_path);
+      int connected = connect(fd, reinterpret_cast<sockaddr *>(&address),
+                              sizeof(address));
+      assert(connected == 0);
+      // just the header of a frame claiming to be huge
+      uint8_t op = op_parse_text;
+      uint64_t length = uint64_t(1) << 62;
+      std::string header(1, char(op));
+      header.append(reinterpret_cast<char *>(&length), sizeof(length));
+      write_all(fd, header);
+      std::string response;
+      assert(read_frame(fd, op, response) && op == op_error);
+      assert(response.find("over the limit") != std::string::npos);
+      assert(!read_frame(fd, op, response));
+      close(fd);
+      assert(liar.parse_text("[1]") == content_hash("[1]"));
+      ServiceClient after(socket_path);
+      assert(after.query(id, "/name").root().string_val() == "reference");
+      // files are held to the request limit too
+      std::string big = path + ".big";
+      std::ofstream(big) << "[\"" << std::string(2 << 20, 'x') << "\"]";
+      try {
+        after.parse_file(big);
+        assert(false);
+      } catch (ServiceError &e) {
+        assert(std::string(e.what()).find("over the limit") !=
+               std::string::npos);
+      }
+      unlink(big.c_str());
+      assert(after.parse_file(path) == changed);
+    }
+
+    // a client left connected doesn't hold up shutdown
+    ServiceClient idle(socket_path);
+    assert(idle.parse_text("[]") == content_hash("[]"));
+    server.stop();
+    try {
+      idle.parse_text("[]");
+      assert(false);
+    } catch (std::system_error &) {
+    }
+  }
+  assert(access(socket_path.c_str(), F_OK) != 0);
+
+  // idle connections are dropped, so they can't keep the only worker from
+  // anyone else
+  {
+    ServerOptions options;
+    options.threads = 1;
+    options.timeout_seconds = 0.2;
+    ServiceServer server(service, socket_path, options);
+    ServiceClient idle(socket_path);
+    assert(idle.parse_text("[]") == content_hash("[]"));
+    auto start = std::chrono::steady_clock::now();
+    ServiceClient waiting(socket_path);
+    assert(waiting.parse_text("[2]") == content_hash("[2]"));
+    assert(std::chrono::steady_clock::now() - start >=
+           std::chrono::milliseconds(150));
+    try {
+      idle.parse_text("[]");
+      assert(false);
+    } catch (std::system_error &) {
+    }
+  }
+  unlink(path.c_str());
+  return 0;
+}
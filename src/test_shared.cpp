@@ -0,0 +1,62 @@
+#include "flat.cpp"
+#include "parsejson.cpp"
+#include "pull.cpp"
+#include "shared.cpp"
+#include <cassert>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace parsejson;
+
+int main() {
+  std::string name = "/parsejson-test-" + std::to_string(getpid());
+  ParseBuffer input;
+  input.raw_json = "{\"name\": \"reference\", \"values\": [1, 2, 3], "
+                   "\"nested\": {\"ok\": true}}";
+  FlatDocument doc = parse_flat(input);
+  publish_shared(name, doc.view());
+
+  // can't publish over the top of an existing document
+  bool exception_thrown = false;
+  try {
+    publish_shared(name, doc.view());
+  } catch (std::system_error &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown);
+
+  // another process maps it and reads it through the normal accessors
+  pid_t child = fork();
+  if (child == 0) {
+    SharedView shared(name);
+    FlatRef root = shared.root();
+    bool ok = root.find("name").string_val() == "reference" &&
+              root.find("nested").find("ok").bool_val();
+    double sum = 0;
+    for (FlatRef value : root.find("values").children()) {
+      sum += value.double_val();
+    }
+    _exit(ok && sum == 6 ? 0 : 1);
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  SharedView shared(name);
+  assert(shared.mapped_bytes() == doc.view().serialized_size());
+  SharedView moved(std::move(shared));
+  assert(moved.root().find("values").child().double_val() == 1);
+
+  // existing mappings outlive the name
+  assert(unpublish_shared(name));
+  assert(!unpublish_shared(name));
+  assert(moved.root().find("name").string_val() == "reference");
+  exception_thrown = false;
+  try {
+    SharedView gone(name);
+  } catch (std::system_error &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown);
+}
@@ -0,0 +1,120 @@
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "sort.cpp"
+#include "writer.cpp"
+#include <algorithm>
+#include <cassert>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace parsejson;
+
+std::string sort_to_string(std::string_view jsonl, const std::string &key,
+                           const SortOptions &options,
+                           SortStats *stats = NULL) {
+  std::string path = "/tmp/parsejson-sorted-" + std::to_string(getpid());
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  SortStats result = sort_jsonl(jsonl, key, fd, options);
+  std::string out(size_t(lseek(fd, 0, SEEK_END)), '\0');
+  ssize_t got = pread(fd, out.data(), out.size(), 0);
+  assert(got == ssize_t(out.size()));
+  assert(result.bytes_out == out.size());
+  close(fd);
+  unlink(path.c_str());
+  if (stats) {
+    *stats = result;
+  }
+  return out;
+}
+
+int main() {
+  // every kind of key, in the order they sort in, with ties kept in input
+  // order
+  std::string jsonl = "{\"k\": \"b\", \"i\": 1}\n"
+                      "{\"k\": 2.5}\n"
+                      "{\"k\": [1]}\n"
+                      "{\"k\": -10}\n"
+                      "{\"i\": 2}\r\n"
+                      "\n"
+                      "{\"k\": true}\n"
+                      "{\"k\": \"\\u0061\"}\n"
+                      "{\"k\": null}\n"
+                      "{\"k\": 1e400}\n"
+                      "{\"k\": false}\n"
+                      "{\"k\": -0.0}\n"
+                      "{\"k\": 0, \"i\": 3}\n"
+                      "{\"k\": \"b\", \"i\": 4}";
+  SortOptions options;
+  options.threads = 1;
+  SortStats stats;
+  assert(sort_to_string(jsonl, "/k", options, &stats) ==
+         "{\"i\": 2}\n"
+         "{\"k\": null}\n"
+         "{\"k\": false}\n"
+         "{\"k\": true}\n"
+         "{\"k\": -10}\n"
+         "{\"k\": -0.0}\n"
+         "{\"k\": 0, \"i\": 3}\n"
+         "{\"k\": 2.5}\n"
+         "{\"k\": 1e400}\n"
+         "{\"k\": \"\\u0061\"}\n"
+         "{\"k\": \"b\", \"i\": 1}\n"
+         "{\"k\": \"b\", \"i\": 4}\n"
+         "{\"k\": [1]}\n");
+  assert(stats.records == 13);
+  assert(stats.runs == 0);
+  assert(stats.spilled_bytes == 0);
+  options.descending = true;
+  assert(sort_to_string("{\"k\": 1}\n{\"k\": 3, \"i\": 1}\n{\"k\": 2}\n"
+                        "{\"k\": 3, \"i\": 2}\n",
+                        "/k", options) ==
+         "{\"k\": 3, \"i\": 1}\n{\"k\": 3, \"i\": 2}\n{\"k\": 2}\n"
+         "{\"k\": 1}\n");
+
+  bool threw = false;
+  try {
+    sort_to_string("{\"k\": 1}\n{\"k\": \"1}\n", "/k", options);
+  } catch (ParseError &e) {
+    threw = std::string(e.what()).find("record at byte 9") == 0;
+  }
+  assert(threw);
+
+  // a budget far too small for the input spills many runs, merged in more
+  // than one pass, and comes out the same as sorting in memory
+  std::vector<std::pair<long, std::string>> expected;
+  std::string many;
+  unsigned seed = 1;
+  for (int i = 0; i < 30000; i++) {
+    seed = seed * 1103515245 + 12345;
+    long key = long(seed >> 8) % 5000 - 2500;
+    std::string record = "{\"pad\": \"" + std::string(size_t(i % 40), 'p') +
+                         "\", \"t\": " + std::to_string(key) +
+                         ", \"i\": " + std::to_string(i) + "}";
+    many += record + "\n";
+    expected.push_back({key, record});
+  }
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](auto &a, auto &b) { return a.first < b.first; });
+  std::string want;
+  for (auto &record : expected) {
+    want += record.second + "\n";
+  }
+  options = SortOptions();
+  options.threads = 1;
+  assert(sort_to_string(many, "/t", options, &stats) == want);
+  assert(stats.runs == 0);
+  options.memory_bytes = 64 << 10;
+  options.chunk_bytes = 16 << 10;
+  options.threads = 3;
+  assert(sort_to_string(many, "/t", options, &stats) == want);
+  assert(stats.records == 30000);
+  assert(stats.runs > 16);
+  assert(stats.merge_passes >= 2);
+  assert(stats.spilled_bytes > 0);
+  return 0;
+}
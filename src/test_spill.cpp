@@ -0,0 +1,71 @@
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "spill.cpp"
+#include "traverse.h"
+#include <cassert>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+using namespace parsejson;
+
+int main() {
+  std::string json = "[";
+  for (int i = 0; i < 5000; i++) {
+    if (i) {
+      json += ",";
+    }
+    json += "{\"id\": " + std::to_string(i) +
+            ", \"a member name long enough to be stored out of line\": "
+            "\"and a value long enough to need its own allocation too\"}";
+  }
+  json += "]";
+
+  // parsed in place from a mapped file, so the text isn't copied into memory
+  std::string path = "/tmp/parsejson-spill-" + std::to_string(getpid());
+  std::ofstream(path) << json;
+  MappedFile file(path);
+  unlink(path.c_str());
+  ParseBuffer input;
+  input.raw_json.borrow(file.bytes());
+  assert(input.raw_json.data() == file.bytes().data());
+  // small chunks, so the tree spans many of them
+  auto spill = std::make_unique<SpillFileResource>("/tmp", 64 * 1024);
+  SpillFileResource *resource = spill.get();
+  Document doc = parse_document(input, std::move(spill));
+  assert(resource->used_bytes() > 5000 * 3 * sizeof(JSONItem));
+  assert(resource->mapped_bytes() >= resource->used_bytes());
+  // the tree keeps nothing of the text, so it can be unmapped straight away
+  { MappedFile done(std::move(file)); }
+
+  // everything reads back from the file after being evicted
+  double sum = 0;
+  size_t count = 0;
+  for (JSONItem &record : children(doc.root())) {
+    sum += record.child->double_val;
+    assert(record.child->next->name ==
+           "a member name long enough to be stored out of line");
+    assert(record.child->next->string_val ==
+           "and a value long enough to need its own allocation too");
+    count++;
+  }
+  assert(count == 5000 && sum == 4999.0 * 5000 / 2);
+
+  // a single allocation bigger than a chunk gets a chunk of its own
+  SpillFileResource small("/tmp", 4096);
+  void *big = small.allocate(3 * 4096 + 1, 64);
+  assert(big && reinterpret_cast<uintptr_t>(big) % 64 == 0);
+  std::memset(big, 1, 3 * 4096 + 1);
+
+  bool exception_thrown = false;
+  try {
+    SpillFileResource missing("/nonexistent/directory");
+  } catch (std::system_error &) {
+    exception_thrown = true;
+  }
+  assert(exception_thrown);
+}
@@ -0,0 +1,182 @@
+#include "flat.cpp"
+#include "jsonl.cpp"
+#include "parsejson.cpp"
+#include "pointer.cpp"
+#include "pull.cpp"
+#include "structural.cpp"
+#include <cassert>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace parsejson;
+
+// the tokens of json found a byte at a time
+std::vector<uint64_t> reference(const std::string &json) {
+  std::vector<uint64_t> tokens;
+  bool in_string = false;
+  bool escaped = false;
+  bool after_scalar = false;
+  for (size_t i = 0; i < json.size(); i++) {
+    char c = json[i];
+    if (in_string) {
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        escaped = true;
+      } else if (c == '"') {
+        in_string = false;
+      }
+      continue;
+    }
+    bool scalar = !std::strchr("{}[]:, \n\t\r\"", c);
+    if (std::strchr("{}[]:,\"", c) || (scalar && !after_scalar)) {
+      tokens.push_back(i);
+    }
+    in_string = c == '"';
+    after_scalar = scalar;
+  }
+  return tokens;
+}
+
+// a random document with plenty of escapes and long strings, so that chunks
+// often start inside strings and after backslashes
+void generate(std::mt19937 &random, std::string &out, int depth) {
+  switch (random() % (depth > 5 ? 3 : 5)) {
+  case 0: {
+    out += '"';
+    size_t length = random() % 200;
+    for (size_t i = 0; i < length; i++) {
+      switch (random() % 8) {
+      case 0:
+        out += random() % 2 ? "\\\\" : "\\\"";
+        break;
+      case 1:
+        // escaping the letter after them or not
+        out.append(random() % 6, '\\');
+        out += 'q';
+        break;
+      case 2:
+        out += "{[:,]} ";
+        break;
+      default:
+        out += char('a' + random() % 26);
+      }
+    }
+    // an odd run of backslashes would escape the closing quote
+    size_t run = 0;
+    while (out[out.size() - 1 - run] == '\\') {
+      run++;
+    }
+    if (run % 2) {
+      out += '\\';
+    }
+    out += '"';
+    break;
+  }
+  case 1:
+    out += std::to_string(int(random() % 100000) - 50000) + ".5e3";
+    break;
+  case 2:
+    out += random() % 2 ? "true" : "null";
+    break;
+  case 3: {
+    out += "[ ";
+    int count = random() % 6;
+    for (int i = 0; i < count; i++) {
+      out += i ? " ,\n" : "";
+      generate(random, out, depth + 1);
+    }
+    out += "]";
+    break;
+  }
+  default: {
+    out += "{";
+    int count = random() % 6;
+    for (int i = 0; i < count; i++) {
+      out += i ? ",\t" : "";
+      out += "\"k\\\"" + std::to_string(i) + "\": ";
+      generate(random, out, depth + 1);
+    }
+    out += "}";
+  }
+  }
+}
+
+int main() {
+  // escapes worked out on masks against a byte at a time, including runs
+  // carried in from the block before
+  std::mt19937_64 random64(3);
+  for (int round = 0; round < 200000; round++) {
+    uint64_t backslash = random64() & random64();
+    if (round % 3 == 0) {
+      backslash |= random64();
+    }
+    uint64_t carry_in = random64() & 1;
+    uint64_t carry = carry_in;
+    uint64_t escaped = escaped_bytes(backslash, carry);
+    uint64_t expected = 0;
+    bool escaping = carry_in;
+    for (int i = 0; i < 64; i++) {
+      bool is_backslash = backslash >> i & 1;
+      if (escaping) {
+        expected |= uint64_t(!is_backslash) << i;
+        escaping = false;
+      } else if (is_backslash) {
+        escaping = true;
+      }
+    }
+    assert(escaped == expected);
+    assert(carry == uint64_t(escaping));
+  }
+  assert(prefix_xor(0x11) == 0x0f);
+
+  std::string block(64, 'x');
+  block[0] = '"';
+  block[5] = '\\';
+  block[10] = '{';
+  block[63] = ',';
+  block[20] = ' ';
+  block[21] = '\n';
+  BlockMasks masks = classify_block(block.data());
+  assert(masks.quote == 1 && masks.backslash == uint64_t(1) << 5);
+  assert(masks.punctuation == (uint64_t(1) << 10 | uint64_t(1) << 63));
+  assert(masks.whitespace == (uint64_t(3) << 20));
+
+  std::string json =
+      "{\"a\": [1, -2.5, true], \"b\\\"\": \"x,y\", \"c\": null}";
+  std::vector<uint64_t> tokens = index_structurals(json);
+  assert(tokens == reference(json));
+  std::string starts;
+  for (uint64_t at : tokens) {
+    starts += json[at];
+  }
+  assert(starts == "{\":[1,-,t],\":\",\":n}");
+
+  bool threw = false;
+  try {
+    index_structurals("[\"abc\\\"]");
+  } catch (ParseError &) {
+    threw = true;
+  }
+  assert(threw);
+
+  // chunks of every size and split points against the whole done at once
+  std::mt19937 random(11);
+  for (int round = 0; round < 300; round++) {
+    std::string doc;
+    while (doc.size() < size_t(round) * 40) {
+      doc += doc.empty() ? "[" : ",";
+      generate(random, doc, 0);
+    }
+    doc += doc.empty() ? "0" : "]";
+    std::vector<uint64_t> expected = reference(doc);
+    StructuralOptions options;
+    options.min_chunk_bytes = 1 + random() % 512;
+    options.threads = 1 + random() % 8;
+    assert(index_structurals(doc, options) == expected);
+    options.threads = 1;
+    assert(index_structurals(doc, options) == expected);
+  }
+}
@@ -0,0 +1,45 @@
+#include "threads.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace parsejson;
+
+int main() {
+  // every index runs once, the first on the calling thread
+  std::vector<int> runs(8);
+  std::thread::id first;
+  run_on_threads(8, [&](unsigned index) {
+    runs[index]++;
+    if (index == 0) {
+      first = std::this_thread::get_id();
+    }
+  });
+  assert(first == std::this_thread::get_id());
+  for (int count : runs) {
+    assert(count == 1);
+  }
+  run_on_threads(0, [&](unsigned index) { runs[index]++; });
+  assert(runs[0] == 2);
+
+  // a throw is passed on, but only once everything else has finished
+  std::atomic<int> finished = 0;
+  bool threw = false;
+  try {
+    run_on_threads(4, [&](unsigned index) {
+      if (index == 2) {
+        throw std::runtime_error("two");
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      finished++;
+    });
+  } catch (std::runtime_error &e) {
+    threw = std::string(e.what()) == "two";
+  }
+  assert(threw && finished == 3);
+  return 0;
+}
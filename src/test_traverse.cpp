@@ -0,0 +1,83 @@
+#include "parsejson.cpp"
+#include "traverse.h"
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <vector>
+
+using namespace parsejson;
+
+struct Recorder {
+  std::string trace;
+  bool enter(const JSONItem *item) {
+    switch (item->type) {
+    case JSONType::j_object:
+      trace += "{";
+      break;
+    case JSONType::j_array:
+      trace += "[";
+      break;
+    case JSONType::j_string:
+      trace += "s";
+      break;
+    case JSONType::j_number:
+      trace += "n";
+      break;
+    default:
+      trace += "v";
+    }
+    // don't look inside objects named "skip"
+    return item->name != "skip";
+  }
+  void leave(const JSONItem *item) {
+    trace += item->type == JSONType::j_object ? "}" : "]";
+  }
+};
+
+int main() {
+  ParseBuffer input;
+  input.raw_json = "{\"a\": [1, 2, {\"b\": \"x\"}], \"skip\": {\"c\": 3}, "
+                   "\"d\": null}";
+  JSONItem *parsed = parse_json(input);
+
+  size_t count = 0;
+  for (JSONItem &member : children(parsed)) {
+    assert(!member.name.empty());
+    count++;
+  }
+  assert(count == 3);
+  const JSONItem *croot = parsed;
+  auto members = children(croot);
+  assert(std::distance(members.begin(), members.end()) == 3);
+  auto found = std::find_if(members.begin(), members.end(),
+                            [](const JSONItem &m) { return m.name == "d"; });
+  assert(found != members.end() && found->type == JSONType::j_null);
+  assert(children(parsed->child->next->next).empty());
+
+  Recorder recorder;
+  visit_json(croot, recorder);
+  assert(recorder.trace == "{[nn{s}]{v}");
+
+  // a subtree walk stays inside the subtree
+  Recorder sub;
+  visit_json(croot->child, sub);
+  assert(sub.trace == "[nn{s}]");
+
+  // prefetching or not, the walk is the same
+  Recorder prefetched;
+  visit_json<true>(croot, prefetched);
+  Recorder plain;
+  visit_json<false>(croot, plain);
+  assert(prefetched.trace == recorder.trace && plain.trace == recorder.trace);
+
+  std::vector<JSONItem *> reversed = children_reversed(parsed);
+  assert(reversed.size() == 3 && reversed[0]->name == "d");
+  assert(reversed[2] == parsed->child);
+  assert(prev_sibling(parsed, reversed[0]) == reversed[1]);
+  assert(prev_sibling(parsed, parsed->child) == NULL);
+
+  size_t total = 0;
+  for_each_json(parsed, [&](JSONItem *) { total++; });
+  assert(total == 9);
+  destroy_json(parsed);
+}
@@ -0,0 +1,215 @@
+#include "parsejson.cpp"
+#include "writer.cpp"
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+using namespace parsejson;
+
+template <typename Fn> bool rejects(Fn fn) {
+  std::string text;
+  JSONWriter writer(text);
+  try {
+    fn(writer);
+  } catch (std::logic_error &) {
+    return true;
+  }
+  return false;
+}
+
+int main() {
+  std::string text = "prefix:";
+  {
+    JSONWriter writer(text);
+    writer.begin_object();
+    writer.key("name");
+    writer.value("quote \" slash \\ newline \n tab \t bell \x07");
+    writer.key("numbers");
+    writer.begin_array();
+    writer.value(1);
+    writer.value(-2);
+    writer.value(uint64_t(18446744073709551615ull));
+    writer.value(0.1);
+    writer.value(1e300);
+    writer.end_array();
+    writer.key("empty");
+    writer.begin_object();
+    writer.end_object();
+    writer.key("flags");
+    writer.begin_array();
+    writer.value(true);
+    writer.value(false);
+    writer.null();
+    writer.raw("{\"pre\":[]}");
+    writer.begin_array();
+    writer.end_array();
+    writer.end_array();
+    writer.end_object();
+    assert(writer.complete() && writer.depth() == 0);
+    writer.flush();
+    assert(writer.bytes_written() == text.size() - 7);
+  }
+  assert(text == "prefix:{\"name\":\"quote \\\" slash \\\\ newline \\n tab \\t "
+                 "bell \\u0007\",\"numbers\":[1,-2,18446744073709551615,0.1,"
+                 "1e+300],\"empty\":{},\"flags\":[true,false,null,"
+                 "{\"pre\":[]},[]]}");
+
+  // malformed output is refused as it's attempted
+  assert(rejects([](JSONWriter &w) { w.end_array(); }));
+  assert(rejects([](JSONWriter &w) { w.key("top"); }));
+  assert(rejects([](JSONWriter &w) {
+    w.begin_object();
+    w.value(1);
+  }));
+  assert(rejects([](JSONWriter &w) {
+    w.begin_object();
+    w.key("a");
+    w.key("b");
+  }));
+  assert(rejects([](JSONWriter &w) {
+    w.begin_object();
+    w.key("a");
+    w.end_object();
+  }));
+  assert(rejects([](JSONWriter &w) {
+    w.begin_array();
+    w.end_object();
+  }));
+  assert(rejects([](JSONWriter &w) {
+    w.value(1);
+    w.value(2);
+  }));
+  assert(!rejects([](JSONWriter &w) { w.value("alone"); }));
+  try {
+    std::string out;
+    JSONWriter writer(out);
+    writer.value(std::nan(""));
+    assert(false);
+  } catch (std::invalid_argument &) {
+  }
+
+  // a parsed tree writes back out, and reads back to the same text
+  ParseBuffer input;
+  input.raw_json = "{\"a\": [1, 2.5, \"x\\u0001y\", {\"\": null}], "
+                   "\"b\": {\"c\": true, \"d\": []}, \"e\": -0.001}";
+  JSONItem *root = parse_json(input);
+  std::string once = to_json(root);
+  assert(once == "{\"a\":[1,2.5,\"x\\u0001y\",{\"\":null}],\"b\":{\"c\":true,"
+                 "\"d\":[]},\"e\":-0.001}");
+  ParseBuffer again;
+  again.raw_json = once;
+  JSONItem *reparsed = parse_json(again);
+  assert(to_json(reparsed) == once);
+  destroy_json(reparsed);
+
+  // callback sink, with a buffer small enough that long strings bypass it
+  std::string collected;
+  size_t calls = 0;
+  std::string big(1000, 'z');
+  {
+    JSONWriter writer(
+        [&](const char *data, size_t size) {
+          collected.append(data, size);
+          calls++;
+        },
+        64);
+    writer.begin_array();
+    for (int i = 0; i < 50; i++) {
+      writer.value(i);
+      writer.raw(big);
+      write_json(writer, root);
+    }
+    writer.end_array();
+  }
+  assert(calls > 50);
+  std::string expected = "[";
+  for (int i = 0; i < 50; i++) {
+    expected += (i ? "," : "") + std::to_string(i) + "," + big + "," + once;
+  }
+  expected += "]";
+  assert(collected == expected);
+
+  // descriptor sink, through a pipe
+  int fds[2];
+  int piped_made = pipe(fds);
+  assert(piped_made == 0);
+  {
+    JSONWriter writer(fds[1], 16);
+    writer.begin_object();
+    writer.key("tree");
+    write_json(writer, root);
+    writer.key("big");
+    writer.value(big);
+    writer.end_object();
+    writer.flush();
+    assert(writer.bytes_written() == once.size() + big.size() + 18);
+  }
+  close(fds[1]);
+  std::string piped;
+  char chunk[256];
+  ssize_t got;
+  while ((got = read(fds[0], chunk, sizeof(chunk))) > 0) {
+    piped.append(chunk, size_t(got));
+  }
+  close(fds[0]);
+  assert(piped == "{\"tree\":" + once + ",\"big\":\"" + big + "\"}");
+
+  destroy_json(root);
+
+  // the parallel writers produce exactly what the plain one does
+  std::string records = "{";
+  for (int i = 0; i < 2000; i++) {
+    records += (i ? ",\"" : "\"") + std::to_string(i) + "\": {\"id\": " +
+               std::to_string(i) + ", \"tags\": [\"a\\n\", \"" +
+               std::string(size_t(i % 97), 'x') + "\"], \"ok\": " +
+               (i % 3 ? "true" : "null") + "}";
+  }
+  records += "}";
+  std::string elements = "[[], {}, " + records + ", 1.5, \"s\", " + records +
+                         ", false]";
+  std::string file = "/tmp/parsejson-writer-" + std::to_string(getpid());
+  std::vector<std::string> documents = {records, elements, "[1]", "{}",
+                                        "\"alone\""};
+  for (const std::string &json : documents) {
+    ParseBuffer parallel_input;
+    parallel_input.raw_json = json;
+    JSONItem *tree = parse_json(parallel_input);
+    std::string plain = to_json(tree);
+    assert(estimate_json_size(tree) > plain.size() / 2);
+    for (unsigned threads : {1u, 2u, 3u, 8u, 64u}) {
+      assert(to_json_parallel(tree, threads) == plain);
+      int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+      write_json_parallel(fd, tree, threads);
+      std::string written(plain.size() + 1, '\0');
+      ssize_t read_back = pread(fd, written.data(), written.size(), 0);
+      assert(read_back == ssize_t(plain.size()));
+      written.resize(plain.size());
+      assert(written == plain);
+      close(fd);
+    }
+    destroy_json(tree);
+  }
+  unlink(file.c_str());
+
+  // a socket whose peer has gone is an error, not a SIGPIPE
+  int pair[2];
+  int made = socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+  assert(made == 0);
+  close(pair[1]);
+  bool threw = false;
+  try {
+    write_all(pair[0], "lost");
+  } catch (std::system_error &e) {
+    threw = e.code().value() == EPIPE;
+  }
+  assert(threw);
+  close(pair[0]);
+  return 0;
+}
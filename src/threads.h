@@ -0,0 +1,48 @@
+/*
+ * Runs work on a fixed number of threads and waits for all of them, for the
+ * parallel parts of this directory:
+ *
+ *   run_on_threads(threads, [&](unsigned index) { ... });
+ *
+ * The calling thread does its share as index 0 rather than sitting idle.
+ */
+
+#pragma once
+
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parsejson {
+
+// runs work(index) for each index below threads (at least one), index 0 on
+// the calling thread. the first exception thrown is rethrown once they have
+// all finished.
+template <typename Work> void run_on_threads(unsigned threads, Work &&work) {
+  std::exception_ptr failure;
+  std::mutex lock;
+  auto run = [&](unsigned index) {
+    try {
+      work(index);
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (!failure) {
+        failure = std::current_exception();
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; i++) {
+    pool.emplace_back(run, i);
+  }
+  run(0);
+  for (std::thread &thread : pool) {
+    thread.join();
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
+
+} // namespace parsejson
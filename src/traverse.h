@@ -0,0 +1,198 @@
+/*
+ * Generic traversal over the JSONItem tree. children() gives an STL style
+ * range over the members of an object or the elements of an array, so that
+ * the usual `for (JSONItem *m = obj->child; m; m = m->next)` loop can be
+ * written as a range-for or handed to <algorithm>. visit_json() is a
+ * non-recursive depth first walk which calls back into a visitor on the way
+ * into and out of each item.
+ *
+ * Walking the tree is pointer chasing, so the walk prefetches two steps
+ * ahead. The item it will most likely go to next (the child of a container,
+ * else the next sibling) was prefetched on the step before, so by the time
+ * the walk arrives it can be read to prefetch the two places it leads to,
+ * and those loads overlap with the visitor's work on two items rather than
+ * one. A container's next sibling is prefetched when the container is
+ * entered, well before its children are done with.
+ *
+ * Measured with bench_parser (on a 4.4M item tree, in parse order and
+ * scattered), this hasn't beaten the hardware prefetcher: parse order lays
+ * a tree out nearly sequentially, and reading the next item early to find
+ * where it leads stalls about as often as it saves. So it's off unless
+ * PARSER_TRAVERSAL_PREFETCH is defined as 1; visit_json<true>() and
+ * visit_json<false>() choose either way per call.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "parsejson.h"
+
+#ifndef PARSER_TRAVERSAL_PREFETCH
+#define PARSER_TRAVERSAL_PREFETCH 0
+#endif
+
+#if defined(__GNUC__)
+#define PARSEJSON_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PARSEJSON_PREFETCH(addr) ((void)(addr))
+#endif
+
+namespace parsejson {
+
+template <typename Item> class ChildIterator {
+  Item *item;
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = std::remove_const_t<Item>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = Item *;
+  using reference = Item &;
+
+  ChildIterator(Item *start = NULL) : item(start) {}
+
+  reference operator*() const { return *item; }
+  pointer operator->() const { return item; }
+  pointer get() const { return item; }
+
+  ChildIterator &operator++() {
+    item = item->next;
+    return *this;
+  }
+  ChildIterator operator++(int) {
+    ChildIterator prior = *this;
+    item = item->next;
+    return prior;
+  }
+
+  bool operator==(const ChildIterator &other) const {
+    return item == other.item;
+  }
+  bool operator!=(const ChildIterator &other) const {
+    return item != other.item;
+  }
+};
+
+template <typename Item> class ChildRange {
+  Item *head;
+
+public:
+  ChildRange(Item *first) : head(first) {}
+  ChildIterator<Item> begin() const { return ChildIterator<Item>(head); }
+  ChildIterator<Item> end() const { return ChildIterator<Item>(); }
+  bool empty() const { return head == NULL; }
+};
+
+// members of an object or elements of an array. scalars have no children, so
+// their range is empty.
+inline ChildRange<JSONItem> children(JSONItem *container) {
+  return ChildRange<JSONItem>(container ? container->child : NULL);
+}
+inline ChildRange<const JSONItem> children(const JSONItem *container) {
+  return ChildRange<const JSONItem>(container ? container->child : NULL);
+}
+
+// the sibling before item in container, or NULL if item is the first. with
+// PARSER_LEAN_NODES there's no prev link to follow, so this walks forward from
+// the first child.
+template <typename Item> Item *prev_sibling(Item *container, Item *item) {
+#if !PARSER_LEAN_NODES
+  (void)container;
+  return item->prev;
+#else
+  Item *prev = NULL;
+  for (Item *sibling = container->child; sibling != item;
+       sibling = sibling->next) {
+    prev = sibling;
+  }
+  return prev;
+#endif
+}
+
+// members/elements of container, last first. one forward pass, so it costs
+// the same whether or not items have a prev link.
+template <typename Item>
+std::vector<Item *> children_reversed(Item *container) {
+  std::vector<Item *> reversed;
+  for (Item &item : children(container)) {
+    reversed.push_back(&item);
+  }
+  std::reverse(reversed.begin(), reversed.end());
+  return reversed;
+}
+
+/*
+ * Depth first, pre-order walk of the tree rooted at `root`. The root's own
+ * siblings are not visited. The visitor must provide:
+ *
+ *   bool enter(Item *item);  // false skips the children of an object/array
+ *   void leave(Item *item);  // after the children of an entered object/array
+ *
+ * Item may be JSONItem or const JSONItem. The only state kept is a stack of
+ * the containers currently open, so stack use doesn't depend on depth.
+ * Prefetch says whether to prefetch ahead of the walk (see above).
+ */
+template <bool Prefetch = PARSER_TRAVERSAL_PREFETCH != 0, typename Item,
+          typename Visitor>
+void visit_json(Item *root, Visitor &&visitor) {
+  std::vector<Item *> parents;
+  Item *item = root;
+  if (Prefetch && root) {
+    PARSEJSON_PREFETCH(root->child);
+  }
+  while (item) {
+    if (Prefetch) {
+      // item's next sibling comes after all of item's children, and the
+      // item after item is ready to be read
+      PARSEJSON_PREFETCH(item->next);
+      Item *ahead = item->child ? item->child : item->next;
+      if (ahead) {
+        PARSEJSON_PREFETCH(ahead->child);
+        PARSEJSON_PREFETCH(ahead->next);
+      }
+    }
+    if (visitor.enter(item) &&
+        (item->type == JSONType::j_object || item->type == JSONType::j_array)) {
+      if (item->child) {
+        parents.push_back(item);
+        item = item->child;
+        continue;
+      }
+      visitor.leave(item);
+    }
+    // move on to the next sibling, closing containers as they run out
+    while (true) {
+      if (item == root) {
+        item = NULL;
+        break;
+      }
+      if (item->next) {
+        item = item->next;
+        break;
+      }
+      item = parents.back();
+      parents.pop_back();
+      visitor.leave(item);
+    }
+  }
+}
+
+// convenience for when only the pre-order callback matters
+template <typename Item, typename Fn> void for_each_json(Item *root, Fn &&fn) {
+  struct Adapter {
+    Fn &fn;
+    bool enter(Item *item) {
+      fn(item);
+      return true;
+    }
+    void leave(Item *) {}
+  } adapter{fn};
+  visit_json(root, adapter);
+}
+
+} // namespace parsejson
@@ -0,0 +1,560 @@
+#include "writer.h"
+#include "threads.h"
+#include "traverse.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <exception>
+#include <charconv>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace parsejson {
+
+JSONWriter::JSONWriter(std::string &output) : sink(sink_string), out(&output) {
+  delivered = output.size();
+  base = output.data();
+  cursor = limit = base + output.size();
+}
+
+JSONWriter::JSONWriter(Callback consumer, size_t buffer_bytes)
+    : sink(sink_callback), callback(std::move(consumer)),
+      storage(new char[buffer_bytes ? buffer_bytes : 1]),
+      capacity(buffer_bytes ? buffer_bytes : 1) {
+  base = cursor = storage.get();
+  limit = base + capacity;
+}
+
+JSONWriter::JSONWriter(int descriptor, size_t buffer_bytes)
+    : sink(sink_fd), fd(descriptor),
+      storage(new char[buffer_bytes ? buffer_bytes : 1]),
+      capacity(buffer_bytes ? buffer_bytes : 1) {
+  base = cursor = storage.get();
+  limit = base + capacity;
+}
+
+JSONWriter::~JSONWriter() {
+  try {
+    flush();
+  } catch (...) {
+  }
+}
+
+size_t JSONWriter::bytes_written() const {
+  if (sink == sink_string) {
+    return size_t(cursor - base) - delivered;
+  }
+  return delivered + size_t(cursor - base);
+}
+
+// writes all of pieces to fd, however many calls that takes
+void write_vectors(int fd, iovec *pieces, size_t count) {
+  // sockets are written with sendmsg(), which can be told not to raise
+  // SIGPIPE; the first call finds out whether fd is one
+  bool socket = true;
+  while (count) {
+    int batch = int(std::min<size_t>(count, IOV_MAX));
+    ssize_t sent;
+    if (socket) {
+      msghdr message = {};
+      message.msg_iov = pieces;
+      message.msg_iovlen = size_t(batch);
+      sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+      if (sent < 0 && errno == ENOTSOCK) {
+        socket = false;
+        continue;
+      }
+    } else {
+      sent = writev(fd, pieces, batch);
+    }
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "write");
+    }
+    // step over whatever was written, which may end mid piece
+    size_t done = size_t(sent);
+    while (count && done >= pieces->iov_len) {
+      done -= pieces->iov_len;
+      pieces++;
+      count--;
+    }
+    if (count) {
+      pieces->iov_base = static_cast<char *>(pieces->iov_base) + done;
+      pieces->iov_len -= done;
+    }
+  }
+}
+
+void write_all(int fd, std::string_view data) {
+  iovec piece = {const_cast<char *>(data.data()), data.size()};
+  write_vectors(fd, &piece, 1);
+}
+
+// passes the buffer, then extra, on to the sink and empties the buffer
+void JSONWriter::deliver(const char *extra, size_t extra_size) {
+  size_t buffered = size_t(cursor - base);
+  if (sink == sink_callback) {
+    if (buffered) {
+      callback(base, buffered);
+    }
+    if (extra_size) {
+      callback(extra, extra_size);
+    }
+  } else {
+    iovec pieces[2];
+    int count = 0;
+    if (buffered) {
+      pieces[count++] = {base, buffered};
+    }
+    if (extra_size) {
+      pieces[count++] = {const_cast<char *>(extra), extra_size};
+    }
+    try {
+      write_vectors(fd, pieces, size_t(count));
+    } catch (...) {
+      // drop what couldn't be written rather than retrying it forever
+      cursor = base;
+      throw;
+    }
+  }
+  delivered += buffered + extra_size;
+  cursor = base;
+}
+
+void JSONWriter::make_room(size_t bytes) {
+  if (sink == sink_string) {
+    size_t used = size_t(cursor - base);
+    out->resize(std::max({out->size() * 2, used + bytes, size_t(256)}));
+    base = out->data();
+    cursor = base + used;
+    limit = base + out->size();
+    return;
+  }
+  deliver(NULL, 0);
+  if (bytes > capacity) {
+    // only ever asked for a handful of bytes at a time
+    throw std::logic_error("JSONWriter buffer too small");
+  }
+}
+
+void JSONWriter::put_slow(const char *data, size_t size) {
+  if (sink != sink_string && size >= capacity / 2) {
+    // not worth copying, send it straight after what's buffered
+    deliver(data, size);
+    return;
+  }
+  make_room(size);
+  memcpy(cursor, data, size);
+  cursor += size;
+}
+
+void JSONWriter::flush() {
+  if (sink == sink_string) {
+    out->resize(size_t(cursor - base));
+    base = out->data();
+    cursor = limit = base + out->size();
+    return;
+  }
+  deliver(NULL, 0);
+}
+
+void JSONWriter::before_value() {
+  if (after_key) {
+    after_key = false;
+    return;
+  }
+  if (scopes.empty()) {
+    if (finished) {
+      throw std::logic_error("JSONWriter: more than one top-level value");
+    }
+    return;
+  }
+  if (scopes.back() == scope_object) {
+    throw std::logic_error("JSONWriter: value where a key was expected");
+  }
+  if (need_comma) {
+    put(',');
+  }
+}
+
+void JSONWriter::after_value() {
+  need_comma = true;
+  if (scopes.empty()) {
+    finished = true;
+  }
+}
+
+void JSONWriter::begin_object() {
+  before_value();
+  put('{');
+  scopes.push_back(scope_object);
+  need_comma = false;
+}
+
+void JSONWriter::end_object() {
+  if (scopes.empty() || scopes.back() != scope_object || after_key) {
+    throw std::logic_error("JSONWriter: end_object doesn't close an object");
+  }
+  put('}');
+  scopes.pop_back();
+  after_value();
+}
+
+void JSONWriter::begin_array() {
+  before_value();
+  put('[');
+  scopes.push_back(scope_array);
+  need_comma = false;
+}
+
+void JSONWriter::end_array() {
+  if (scopes.empty() || scopes.back() != scope_array) {
+    throw std::logic_error("JSONWriter: end_array doesn't close an array");
+  }
+  put(']');
+  scopes.pop_back();
+  after_value();
+}
+
+void JSONWriter::key(std::string_view name) {
+  if (!expecting_key()) {
+    throw std::logic_error("JSONWriter: key outside an object");
+  }
+  if (need_comma) {
+    put(',');
+  }
+  put_string(name);
+  put(':');
+  after_key = true;
+}
+
+void JSONWriter::put_string(std::string_view text) {
+  static const char hex[] = "0123456789abcdef";
+  put('"');
+  const char *run = text.data();
+  const char *end = run + text.size();
+  for (const char *p = run; p != end; p++) {
+    unsigned char c = static_cast<unsigned char>(*p);
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    // copy the plain run up to here, then the escape
+    put(run, size_t(p - run));
+    run = p + 1;
+    char escape[6] = {'\\', 0, '0', '0', 0, 0};
+    size_t length = 2;
+    switch (c) {
+    case '"':
+    case '\\':
+      escape[1] = char(c);
+      break;
+    case '\b':
+      escape[1] = 'b';
+      break;
+    case '\f':
+      escape[1] = 'f';
+      break;
+    case '\n':
+      escape[1] = 'n';
+      break;
+    case '\r':
+      escape[1] = 'r';
+      break;
+    case '\t':
+      escape[1] = 't';
+      break;
+    default:
+      escape[1] = 'u';
+      escape[4] = hex[c >> 4];
+      escape[5] = hex[c & 0xf];
+      length = 6;
+    }
+    put(escape, length);
+  }
+  put(run, size_t(end - run));
+  put('"');
+}
+
+void JSONWriter::value(std::string_view text) {
+  before_value();
+  put_string(text);
+  after_value();
+}
+
+void JSONWriter::value(double number) {
+  if (!std::isfinite(number)) {
+    throw std::invalid_argument("JSONWriter: NaN and infinity aren't JSON");
+  }
+  before_value();
+  // shortest text that reads back as the same double
+  char text[32];
+  char *end = std::to_chars(text, text + sizeof(text), number).ptr;
+  put(text, size_t(end - text));
+  after_value();
+}
+
+void JSONWriter::write_signed(int64_t number) {
+  before_value();
+  char text[24];
+  char *end = std::to_chars(text, text + sizeof(text), number).ptr;
+  put(text, size_t(end - text));
+  after_value();
+}
+
+void JSONWriter::write_unsigned(uint64_t number) {
+  before_value();
+  char text[24];
+  char *end = std::to_chars(text, text + sizeof(text), number).ptr;
+  put(text, size_t(end - text));
+  after_value();
+}
+
+void JSONWriter::value(bool flag) {
+  before_value();
+  if (flag) {
+    put("true", 4);
+  } else {
+    put("false", 5);
+  }
+  after_value();
+}
+
+void JSONWriter::null() {
+  before_value();
+  put("null", 4);
+  after_value();
+}
+
+void JSONWriter::raw(std::string_view json) {
+  before_value();
+  put(json.data(), json.size());
+  after_value();
+}
+
+struct WriteVisitor {
+  JSONWriter &writer;
+
+  bool enter(const JSONItem *item) {
+    if (writer.expecting_key()) {
+      writer.key(item->name.view());
+    }
+    switch (item->type) {
+    case j_object:
+      writer.begin_object();
+      break;
+    case j_array:
+      writer.begin_array();
+      break;
+    case j_string:
+      writer.value(std::string_view(item->string_val));
+      break;
+    case j_number:
+      writer.value(double(item->double_val));
+      break;
+    case j_bool:
+      writer.value(item->bool_val);
+      break;
+    case j_null:
+      writer.null();
+      break;
+    }
+    return true;
+  }
+
+  void leave(const JSONItem *item) {
+    if (item->type == j_object) {
+      writer.end_object();
+    } else {
+      writer.end_array();
+    }
+  }
+};
+
+void write_json(JSONWriter &writer, const JSONItem *item) {
+  if (writer.expecting_key()) {
+    throw std::logic_error("JSONWriter: value where a key was expected");
+  }
+  visit_json(item, WriteVisitor{writer});
+}
+
+std::string to_json(const JSONItem *item) {
+  std::string text;
+  JSONWriter writer(text);
+  write_json(writer, item);
+  writer.flush();
+  return text;
+}
+
+struct EstimateVisitor {
+  size_t total = 0;
+
+  bool enter(const JSONItem *item) {
+    // separator, plus quotes and colon for a member. only the root has no
+    // separator and every member has a name, so this is close enough.
+    total += 1 + (item->name.empty() ? 0 : item->name.size() + 3);
+    switch (item->type) {
+    case j_object:
+    case j_array:
+      total += 2;
+      break;
+    case j_string:
+      total += item->string_val.size() + 2;
+      break;
+    case j_number:
+      total += 8;
+      break;
+    case j_bool:
+      total += 5;
+      break;
+    case j_null:
+      total += 4;
+      break;
+    }
+    return true;
+  }
+  void leave(const JSONItem *) {}
+};
+
+size_t estimate_json_size(const JSONItem *item) {
+  EstimateVisitor estimate;
+  visit_json(item, estimate);
+  return estimate.total;
+}
+
+// a run of the root's children written on its own, opening bracket first (as
+// the writer requires) so that text.substr(1) is what goes into the output
+struct Piece {
+  const JSONItem *first;
+  size_t count;
+  std::string text;
+};
+
+std::vector<Piece> write_pieces(const JSONItem *item, unsigned threads) {
+  std::vector<const JSONItem *> children;
+  for (const JSONItem *child = item->child; child; child = child->next) {
+    children.push_back(child);
+  }
+  std::vector<size_t> sizes(children.size());
+  run_on_threads(threads, [&](unsigned index) {
+    for (size_t i = index; i < children.size(); i += threads) {
+      sizes[i] = estimate_json_size(children[i]);
+    }
+  });
+  size_t total = 0;
+  for (size_t size : sizes) {
+    total += size;
+  }
+
+  // several runs per thread, handed out as threads come free, evens out
+  // estimates that are off
+  size_t target = total / (size_t(threads) * 4) + 1;
+  std::vector<Piece> pieces;
+  size_t run_bytes = 0;
+  for (size_t i = 0; i < children.size(); i++) {
+    if (pieces.empty() || run_bytes >= target) {
+      pieces.push_back({children[i], 0, std::string()});
+      run_bytes = 0;
+    }
+    pieces.back().count++;
+    run_bytes += sizes[i];
+  }
+
+  std::atomic<size_t> next_piece = 0;
+  std::exception_ptr failure;
+  std::mutex failure_lock;
+  run_on_threads(threads, [&](unsigned) {
+    size_t index;
+    while ((index = next_piece++) < pieces.size()) {
+      Piece &piece = pieces[index];
+      try {
+        JSONWriter writer(piece.text);
+        const JSONItem *child = piece.first;
+        if (item->type == j_object) {
+          writer.begin_object();
+          for (size_t i = 0; i < piece.count; i++, child = child->next) {
+            writer.key(child->name.view());
+            write_json(writer, child);
+          }
+        } else {
+          writer.begin_array();
+          for (size_t i = 0; i < piece.count; i++, child = child->next) {
+            write_json(writer, child);
+          }
+        }
+        writer.flush();
+      } catch (...) {
+        std::lock_guard<std::mutex> guard(failure_lock);
+        failure = std::current_exception();
+        next_piece = pieces.size();
+      }
+    }
+  });
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+  return pieces;
+}
+
+bool worth_splitting(const JSONItem *item, unsigned threads) {
+  return threads > 1 && item && item->child && item->child->next &&
+         (item->type == j_object || item->type == j_array);
+}
+
+std::string to_json_parallel(const JSONItem *item, unsigned threads) {
+  if (!worth_splitting(item, threads)) {
+    return to_json(item);
+  }
+  std::vector<Piece> pieces = write_pieces(item, threads);
+  std::vector<size_t> offsets(pieces.size());
+  size_t total = 1;
+  for (size_t i = 0; i < pieces.size(); i++) {
+    offsets[i] = total;
+    // the piece without its bracket, then a separator (or the close)
+    total += pieces[i].text.size();
+  }
+  std::string out(total, ',');
+  out.front() = item->type == j_object ? '{' : '[';
+  out.back() = item->type == j_object ? '}' : ']';
+  run_on_threads(threads, [&](unsigned index) {
+    for (size_t i = index; i < pieces.size(); i += threads) {
+      memcpy(&out[offsets[i]], pieces[i].text.data() + 1,
+             pieces[i].text.size() - 1);
+      // done with it, and it may be big
+      std::string().swap(pieces[i].text);
+    }
+  });
+  return out;
+}
+
+void write_json_parallel(int fd, const JSONItem *item, unsigned threads) {
+  if (!worth_splitting(item, threads)) {
+    JSONWriter writer(fd);
+    write_json(writer, item);
+    writer.flush();
+    return;
+  }
+  std::vector<Piece> pieces = write_pieces(item, threads);
+  static char brackets[] = "{}[],";
+  char *pair = &brackets[item->type == j_object ? 0 : 2];
+  std::vector<iovec> gather;
+  gather.push_back({pair, 1});
+  for (size_t i = 0; i < pieces.size(); i++) {
+    if (i) {
+      gather.push_back({&brackets[4], 1});
+    }
+    gather.push_back({pieces[i].text.data() + 1, pieces[i].text.size() - 1});
+  }
+  gather.push_back({pair + 1, 1});
+  write_vectors(fd, gather.data(), gather.size());
+}
+
+} // namespace parsejson
@@ -0,0 +1,183 @@
+/*
+ * Streaming JSON output. A JSONWriter is driven with one call per token and
+ * writes text as it goes, so large responses can be produced without
+ * building a tree of JSONItems first:
+ *
+ *   JSONWriter out(STDOUT_FILENO);
+ *   out.begin_object();
+ *   out.key("ids");
+ *   out.begin_array();
+ *   for (uint64_t id : ids) {
+ *     out.value(id);
+ *   }
+ *   out.end_array();
+ *   out.end_object();
+ *   out.flush();
+ *
+ * Output goes to one of three sinks: a std::string that grows as needed, a
+ * callback, or a file descriptor. The last two are fed from a fixed buffer in
+ * large blocks. Strings too big to be worth copying into the buffer are handed
+ * over directly, alongside whatever was buffered (with writev() for a
+ * descriptor).
+ *
+ * The writer keeps a stack of open containers, one byte each, and throws
+ * std::logic_error as soon as a call would produce malformed JSON: a value
+ * where a key belongs, a close that doesn't match, a second top-level value.
+ *
+ * write_json() writes out an existing tree the same way. For very large trees
+ * to_json_parallel() and write_json_parallel() split the work across threads:
+ * the root's members (or elements) are divided into runs of about the same
+ * estimated output size, each run is written into its own buffer by whichever
+ * thread picks it up, and the buffers are then joined in order, copied into
+ * place at offsets known from their sizes, or gathered with writev(). The
+ * output is byte for byte what write_json() produces. Only the root is split,
+ * so a document whose bulk sits in a single member gains little.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "parsejson.h"
+
+namespace parsejson {
+
+class JSONWriter {
+public:
+  using Callback = std::function<void(const char *data, size_t size)>;
+
+private:
+  enum Sink { sink_string, sink_callback, sink_fd };
+  enum Scope : uint8_t { scope_object, scope_array };
+
+  Sink sink;
+  std::string *out = NULL;
+  Callback callback;
+  int fd = -1;
+  std::unique_ptr<char[]> storage;
+  size_t capacity = 0;
+  // free space is [cursor, limit). for a string sink base is out->data().
+  char *base = NULL;
+  char *cursor = NULL;
+  char *limit = NULL;
+  // bytes already passed to the sink, or for a string sink, what was in it
+  // before we started
+  size_t delivered = 0;
+
+  std::vector<uint8_t> scopes;
+  bool need_comma = false;
+  bool after_key = false;
+  bool finished = false;
+
+  void make_room(size_t bytes);
+  void deliver(const char *extra, size_t extra_size);
+  void put_slow(const char *data, size_t size);
+  void put(const char *data, size_t size) {
+    if (size_t(limit - cursor) < size) {
+      put_slow(data, size);
+      return;
+    }
+    memcpy(cursor, data, size);
+    cursor += size;
+  }
+  void put(char c) {
+    if (cursor == limit) {
+      make_room(1);
+    }
+    *cursor++ = c;
+  }
+  void put_string(std::string_view text);
+  void before_value();
+  void after_value();
+  void write_signed(int64_t number);
+  void write_unsigned(uint64_t number);
+
+public:
+  // appends to *output. its contents are only complete after flush().
+  explicit JSONWriter(std::string &output);
+  // each block of output is passed to sink as it fills
+  explicit JSONWriter(Callback sink, size_t buffer_bytes = size_t(1) << 16);
+  // writes to a descriptor, which the writer does not close
+  explicit JSONWriter(int descriptor, size_t buffer_bytes = size_t(1) << 16);
+  // flushes, ignoring any error. call flush() first to see them.
+  ~JSONWriter();
+  JSONWriter(const JSONWriter &) = delete;
+  JSONWriter &operator=(const JSONWriter &) = delete;
+
+  void begin_object();
+  void end_object();
+  void begin_array();
+  void end_array();
+  void key(std::string_view name);
+
+  void value(std::string_view text);
+  void value(const char *text) { value(std::string_view(text)); }
+  // throws std::invalid_argument for NaN or infinity, which JSON can't hold
+  void value(double number);
+  void value(bool flag);
+  template <typename Integer,
+            typename = std::enable_if_t<std::is_integral_v<Integer>>>
+  void value(Integer number) {
+    if constexpr (std::is_signed_v<Integer>) {
+      write_signed(number);
+    } else {
+      write_unsigned(number);
+    }
+  }
+  void null();
+  // a value that is already JSON text, written as is
+  void raw(std::string_view json);
+
+  // passes everything buffered on to the sink. throws std::system_error if
+  // writing to a descriptor fails.
+  void flush();
+
+  // whether a whole top-level value has been written
+  bool complete() const { return finished; }
+  // bytes produced so far, buffered or not
+  size_t bytes_written() const;
+  // open containers
+  size_t depth() const { return scopes.size(); }
+  // true straight after begin_object() or a member, when a key is next
+  bool expecting_key() const {
+    return !scopes.empty() && scopes.back() == scope_object && !after_key;
+  }
+};
+
+// writes item (and everything under it) as one value. item's own name is not
+// written; use key() first when it's a member of an object being written.
+void write_json(JSONWriter &writer, const JSONItem *item);
+std::string to_json(const JSONItem *item);
+
+// rough size of item written as JSON, for dividing up work
+size_t estimate_json_size(const JSONItem *item);
+
+// the same output as to_json(item) and write_json(JSONWriter(fd), item), built
+// on up to threads threads. write_json_parallel throws std::system_error if
+// writing fails.
+std::string to_json_parallel(
+    const JSONItem *item,
+    unsigned threads = std::thread::hardware_concurrency());
+void write_json_parallel(
+    int fd, const JSONItem *item,
+    unsigned threads = std::thread::hardware_concurrency());
+
+// writes all of pieces to fd, in as many writev() calls as it takes. pieces
+// is used up along the way. throws std::system_error if writing fails,
+// including to a socket whose peer has gone, which raises no SIGPIPE. this
+// and write_all are what everything in this directory writes to fds with.
+void write_vectors(int fd, iovec *pieces, size_t count);
+// writes all of data to fd, as write_vectors does
+void write_all(int fd, std::string_view data);
+
+} // namespace parsejson